@@ -81,6 +81,7 @@ static void log_by_usart3(uint8_t * data, uint16_t data_size)
 
 #include "API_spi_flash.h"
 #include "app_bootloader.h"
+#include "API_profile.h"
 #include <stdbool.h>
 /* USER CODE END 0 */
 
@@ -92,7 +93,7 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
-
+  uint32_t profile_start = 0;
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -108,7 +109,8 @@ int main(void)
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
-
+  /* Cycle counter starts once the core runs at its final clock, clock setup itself is not measured */
+  profile_init();
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
@@ -132,7 +134,9 @@ int main(void)
 
   /* Initialize SPI flash API.  */
   spi_flash_cs_t cs_gpio = {.port = (uint32_t)GPIOC, .pin = GPIO_PIN_7};
+  profile_start = profile_begin();
   rt = spi_flash_init(&hspi1, cs_gpio);
+  profile_end(PROFILE_SPAN_SPI_FLASH_INIT, 0, profile_start);
   if(rt == SPI_FLASH_OK)
 	  print_serial_info("SPI flash OK!");
   else
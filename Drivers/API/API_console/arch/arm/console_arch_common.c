@@ -17,6 +17,137 @@
 #define CONSOLE_ARCH_UART_LISTEN_BYTE_SIZE (1)
 #define CONSOLE_ARCH_CHECK_READY_NR() if(uart_handle == NULL || console_state == NULL) return;
 #define CONSOLE_ARCH_CHECK_READY() if(uart_handle == NULL || console_state == NULL) return CONSOLE_ARCH_E_READY;
+/* Max baud rate error in per mille. Both ends together must stay within the ~4% a receiver takes */
+#define CONSOLE_ARCH_BAUDRATE_TOLERANCE (20)
+#define CONSOLE_ARCH_BAUDRATE_ERROR(actual, baudrate) ((((actual) > (baudrate))? (actual) - (baudrate) : (baudrate) - (actual)) * 1000ULL / (baudrate))
+
+/* USART2 RX request is mapped to DMA1 Stream 5 Channel 4 (RM0090 DMA1 request mapping) */
+#define CONSOLE_ARCH_DMA_RX_STREAM 	DMA1_Stream5
+#define CONSOLE_ARCH_DMA_RX_CHANNEL DMA_CHANNEL_4
+#define CONSOLE_ARCH_DMA_RX_IRQ		DMA1_Stream5_IRQn
+
+static UART_HandleTypeDef * uart_handle = NULL;
+static volatile console_state_t * console_state = NULL;
+
+static volatile uint8_t console_buffer[CONSOLE_MAX_RECV_SIZE] = {0};
+
+/**
+ * @brief Find the oversampling that reaches a baud rate with the lowest error from the UART clock.
+ *
+ * @param baudrate Baud rate.
+ * @param oversampling Pointer where UART_OVERSAMPLING_* will be put.
+ * @return
+ * 			- CONSOLE_ARCH_OK if the error is within CONSOLE_ARCH_BAUDRATE_TOLERANCE.
+ */
+static int console_arch_get_oversampling(uint32_t baudrate, uint32_t * oversampling);
+
+#if CONSOLE_RECV_DMA_IDLE
+
+static DMA_HandleTypeDef console_hdma_rx = {0};
+static volatile uint16_t console_dma_head = 0; /* Last position written by DMA, updated on IDLE/HT/TC events */
+static uint16_t console_dma_tail = 0; /* Next position to hand to user */
+
+/**
+ * @brief Initialize the DMA stream used for console reception and link it with the UART handle.
+ *
+ * @param UartHandle UART handle.
+ * @return
+ * 			- HAL_OK if no error.
+ */
+static int console_dma_init(UART_HandleTypeDef * UartHandle);
+/**
+ * @brief Start circular DMA reception with IDLE line detection.
+ *
+ * @return
+ * 			- HAL_OK if no error.
+ */
+static int console_dma_start(void);
+/**
+ * @brief Copy pending bytes of the circular buffer into user buffer.
+ *
+ * @param head Position written by DMA.
+ * @param user_buffer User buffer.
+ * @param recv_len Pointer where copied size will be put.
+ */
+static void console_copy_ring_to_user_buffer(uint16_t head, uint8_t * user_buffer, uint16_t * recv_len);
+
+static int console_dma_init(UART_HandleTypeDef * UartHandle)
+{
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	console_hdma_rx.Instance = CONSOLE_ARCH_DMA_RX_STREAM;
+	console_hdma_rx.Init.Channel = CONSOLE_ARCH_DMA_RX_CHANNEL;
+	console_hdma_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+	console_hdma_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+	console_hdma_rx.Init.MemInc = DMA_MINC_ENABLE;
+	console_hdma_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+	console_hdma_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	console_hdma_rx.Init.Mode = DMA_CIRCULAR;
+	console_hdma_rx.Init.Priority = DMA_PRIORITY_HIGH;
+	console_hdma_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+
+	int rt = HAL_DMA_Init(&console_hdma_rx);
+	if(rt != HAL_OK)
+		return rt;
+
+	__HAL_LINKDMA(UartHandle, hdmarx, console_hdma_rx);
+
+	HAL_NVIC_SetPriority(CONSOLE_ARCH_DMA_RX_IRQ, 0, 0);
+	HAL_NVIC_EnableIRQ(CONSOLE_ARCH_DMA_RX_IRQ);
+	return HAL_OK;
+}
+
+static int console_dma_start(void)
+{
+	console_dma_head = 0;
+	console_dma_tail = 0;
+	return HAL_UARTEx_ReceiveToIdle_DMA(uart_handle, (uint8_t *)console_buffer, CONSOLE_MAX_RECV_SIZE);
+}
+
+static void console_copy_ring_to_user_buffer(uint16_t head, uint8_t * user_buffer, uint16_t * recv_len)
+{
+	uint16_t copied = 0;
+	if(head < console_dma_tail)
+	{
+		/* DMA wrapped around. Copy until the end of buffer first */
+		copied = CONSOLE_MAX_RECV_SIZE - console_dma_tail;
+		memcpy(user_buffer, (void *)(console_buffer + console_dma_tail), copied);
+		console_dma_tail = 0;
+	}
+	memcpy(user_buffer + copied, (void *)(console_buffer + console_dma_tail), head - console_dma_tail);
+	copied += head - console_dma_tail;
+	console_dma_tail = head;
+	*recv_len = copied;
+}
+
+void DMA1_Stream5_IRQHandler(void)
+{
+	HAL_DMA_IRQHandler(&console_hdma_rx);
+}
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+	if(uart_handle != NULL && huart->Instance == uart_handle->Instance)
+	{
+		/* 'Size' is the position reached by DMA inside the circular buffer */
+		console_dma_head = (Size >= CONSOLE_MAX_RECV_SIZE)? 0 : Size;
+		*console_state = CONSOLE_STATE_RECV_COMPLETE;
+	}
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+	if(uart_handle != NULL && huart->Instance == uart_handle->Instance)
+	{
+		/* HAL stops the reception on errors. Bytes in flight are lost, upper layers ask for retransmission */
+		if(console_dma_start() != HAL_OK)
+			*console_state = CONSOLE_STATE_ERROR;
+		else
+			*console_state = CONSOLE_STATE_LISTEN;
+	}
+}
+
+#else
 
 typedef struct
 {
@@ -25,10 +156,6 @@ typedef struct
 	bool 		running; /* Is timeout running? */
 }console_timeout_t;
 
-static UART_HandleTypeDef * uart_handle = NULL;
-static volatile console_state_t * console_state = NULL;
-
-static volatile uint8_t console_buffer[CONSOLE_MAX_RECV_SIZE] = {0};
 static volatile uint16_t console_buffer_index = 0;
 static volatile console_timeout_t console_timeout = {0};
 
@@ -84,7 +211,8 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 	if(huart->Instance == uart_handle->Instance)
 	{
 		console_buffer_index++;
-		if(console_timeout_read())
+		/* A burst bigger than our buffer is cut here. Upper layers will detect the incomplete frames */
+		if(console_timeout_read() || console_buffer_index >= CONSOLE_MAX_RECV_SIZE)
 		{
 			*console_state = CONSOLE_STATE_RECV_COMPLETE;
 		}
@@ -103,6 +231,34 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 	}
 }
 
+#endif /* CONSOLE_RECV_DMA_IDLE */
+
+static int console_arch_get_oversampling(uint32_t baudrate, uint32_t * oversampling)
+{
+	CONSOLE_ARCH_CHECK_READY()
+	if(baudrate == 0) return CONSOLE_ARCH_E_PARAM;
+
+	/* USART1 and USART6 hang from APB2, the others from APB1 */
+	uint32_t pclk = (uart_handle->Instance == USART1 || uart_handle->Instance == USART6)? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+
+	/* Rate really reached with the divider HAL programs. USARTDIV must be at least 1, and with
+	 * 8 times oversampling its fraction only has 3 bits */
+	uint64_t error16 = UINT64_MAX;
+	uint64_t error8 = UINT64_MAX;
+	uint32_t div16 = UART_BRR_SAMPLING16(pclk, baudrate);
+	uint32_t brr8 = UART_BRR_SAMPLING8(pclk, baudrate);
+	uint32_t div8 = (brr8 & 0xFFF0U) | ((brr8 & 0x7U) << 1);
+	if(div16 >= 16)
+		error16 = CONSOLE_ARCH_BAUDRATE_ERROR(pclk / div16, baudrate);
+	if(div8 >= 16)
+		error8 = CONSOLE_ARCH_BAUDRATE_ERROR(2ULL * pclk / div8, baudrate);
+
+	*oversampling = (error16 <= error8)? UART_OVERSAMPLING_16 : UART_OVERSAMPLING_8;
+	if(((error16 <= error8)? error16 : error8) > CONSOLE_ARCH_BAUDRATE_TOLERANCE)
+		return CONSOLE_ARCH_E_PARAM;
+	return CONSOLE_ARCH_OK;
+}
+
 int console_arch_common_comm_channel_init(void * channel_hdle, volatile console_state_t * state_ref)
 {
 	if(uart_handle != NULL && console_state != NULL) return CONSOLE_ARCH_OK;
@@ -123,6 +279,11 @@ int console_arch_common_comm_channel_init(void * channel_hdle, volatile console_
 	/* Initialize UART */
 	rt = HAL_UART_Init(UartHandle);
 
+#if CONSOLE_RECV_DMA_IDLE
+	if(rt == 0)
+		rt = console_dma_init(UartHandle);
+#endif
+
 	if(rt == 0)
 	{
 		uart_handle = UartHandle;
@@ -143,6 +304,47 @@ int console_arch_common_comm_channel_send(uint8_t * data, uint16_t data_size)
 	return rt;
 }
 
+#if CONSOLE_RECV_DMA_IDLE
+
+int console_arch_common_comm_channel_receive(uint8_t * data, uint16_t * data_size)
+{
+	CONSOLE_ARCH_CHECK_READY()
+	int rt = CONSOLE_ARCH_OK;
+
+	switch(*console_state)
+	{
+		case CONSOLE_STATE_LISTEN:
+		case CONSOLE_STATE_RECV_COMPLETE:
+		{
+			rt = CONSOLE_ARCH_E_BUSY;
+			/* Take the head once, the DMA keeps running while we copy */
+			uint16_t head = console_dma_head;
+			if(head != console_dma_tail)
+			{
+				rt = CONSOLE_ARCH_OK;
+				console_copy_ring_to_user_buffer(head, data, data_size);
+			}
+			break;
+		}
+		case CONSOLE_STATE_ERROR:
+		{
+			rt = CONSOLE_ARCH_E_IO;
+			break;
+		}
+		default:
+		{
+			/* Reception is started once and never stopped: no per byte IT and no inter-frame timeout */
+			rt = console_dma_start();
+			if(rt == 0)
+				*console_state = CONSOLE_STATE_LISTEN;
+			break;
+		}
+	}
+	return rt;
+}
+
+#else
+
 int console_arch_common_comm_channel_receive(uint8_t * data, uint16_t * data_size)
 {
 	CONSOLE_ARCH_CHECK_READY()
@@ -189,3 +391,29 @@ int console_arch_common_comm_channel_receive(uint8_t * data, uint16_t * data_siz
 	}
 	return rt;
 }
+
+#endif /* CONSOLE_RECV_DMA_IDLE */
+
+int console_arch_common_comm_channel_check_baudrate(uint32_t baudrate)
+{
+	uint32_t oversampling = UART_OVERSAMPLING_16;
+	return console_arch_get_oversampling(baudrate, &oversampling);
+}
+
+int console_arch_common_comm_channel_set_baudrate(uint32_t baudrate)
+{
+	uint32_t oversampling = UART_OVERSAMPLING_16;
+	int rt = console_arch_get_oversampling(baudrate, &oversampling);
+	if(rt != CONSOLE_ARCH_OK)
+		return rt;
+
+	/* Transmit is blocking and returns after the last stop bit, only reception has to be stopped */
+	HAL_UART_AbortReceive(uart_handle);
+	uart_handle->Init.BaudRate = baudrate;
+	uart_handle->Init.OverSampling = oversampling;
+	rt = HAL_UART_Init(uart_handle);
+
+	/* Reception starts again on next receive call */
+	*console_state = (rt == HAL_OK)? CONSOLE_STATE_READY : CONSOLE_STATE_ERROR;
+	return rt;
+}
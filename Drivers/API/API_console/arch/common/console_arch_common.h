@@ -13,6 +13,7 @@
 
 typedef enum
 {
+	CONSOLE_ARCH_E_PARAM = -4, /*< Value not supported by channel */
 	CONSOLE_ARCH_E_IO	 = -3, /*< Error related to input/output of arch related functions */
 	CONSOLE_ARCH_E_BUSY	 = -2, /*< Ongoing operation */
 	CONSOLE_ARCH_E_READY = -1, /*< Operation is in progress or is already set */
@@ -47,5 +48,23 @@ int console_arch_common_comm_channel_send(uint8_t * data, uint16_t data_size);
  * 			- CONSOLE_ARCH_BUSY if waiting to receive more data.
  */
 int console_arch_common_comm_channel_receive(uint8_t * data, uint16_t * data_size);
+/**
+ * @brief Check if communication channel can run at a baud rate.
+ *
+ * @param baudrate Baud rate.
+ * @return
+ * 			- CONSOLE_ARCH_OK if supported.
+ * 			- CONSOLE_ARCH_E_PARAM if not reachable within tolerance.
+ */
+int console_arch_common_comm_channel_check_baudrate(uint32_t baudrate);
+/**
+ * @brief Change communication channel baud rate.
+ *
+ * @param baudrate Baud rate.
+ * @return
+ * 			- CONSOLE_ARCH_OK if no error.
+ * 			- CONSOLE_ARCH_E_PARAM if not reachable within tolerance.
+ */
+int console_arch_common_comm_channel_set_baudrate(uint32_t baudrate);
 
 #endif /* API_API_CONSOLE_ARCH_COMMON_CONSOLE_ARCH_COMMON_H_ */
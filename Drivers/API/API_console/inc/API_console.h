@@ -8,6 +8,7 @@
 #ifndef API_API_CONSOLE_INC_API_CONSOLE_H_
 #define API_API_CONSOLE_INC_API_CONSOLE_H_
 
+#include <stdint.h>
 #include "API_console_def.h"
 
 typedef void * comm_channel_hdle;
@@ -38,5 +39,21 @@ int console_send_data(uint8_t * data, uint16_t data_size);
  * 			- 0 if received finish.
  */
 int console_recv_data(uint8_t * buffer, uint16_t * recv_length);
+/**
+ * @brief Check if console can run at a baud rate.
+ *
+ * @param baudrate Baud rate.
+ * @return
+ * 			- 0 if supported.
+ */
+int console_check_baudrate(uint32_t baudrate);
+/**
+ * @brief Change console baud rate. Data being sent is sent at the previous rate, data being received is lost.
+ *
+ * @param baudrate Baud rate.
+ * @return
+ * 			- 0 if no error.
+ */
+int console_set_baudrate(uint32_t baudrate);
 
 #endif /* API_API_CONSOLE_INC_API_CONSOLE_H_ */
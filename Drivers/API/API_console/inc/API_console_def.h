@@ -8,8 +8,10 @@
 #ifndef API_API_CONSOLE_INC_API_CONSOLE_DEF_H_
 #define API_API_CONSOLE_INC_API_CONSOLE_DEF_H_
 
-#define CONSOLE_MAX_RECV_SIZE (8*1024)
-#define CONSOLE_UART_BAUDRATE (115200)
+#define CONSOLE_MAX_RECV_SIZE (17*1024) /* Enough for a burst of 4 download blocks of 4 kB */
+#define CONSOLE_UART_BAUDRATE (115200) /* Rate at reset. Host and client may agree a faster one later */
+/* Receive through a DMA circular buffer and USART IDLE line detection. Set to 0 to receive byte by byte through IT */
+#define CONSOLE_RECV_DMA_IDLE (1)
 
 typedef enum
 {
@@ -24,3 +24,13 @@ int console_recv_data(uint8_t * buffer, uint16_t * recv_length)
 {
 	return console_arch_common_comm_channel_receive(buffer, recv_length);
 }
+
+int console_check_baudrate(uint32_t baudrate)
+{
+	return console_arch_common_comm_channel_check_baudrate(baudrate);
+}
+
+int console_set_baudrate(uint32_t baudrate)
+{
+	return console_arch_common_comm_channel_set_baudrate(baudrate);
+}
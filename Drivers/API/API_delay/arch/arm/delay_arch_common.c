@@ -0,0 +1,14 @@
+/*
+ * delay_arch_common.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+#include "stm32f4xx_hal.h"
+
+#include "delay_arch_common.h"
+
+uint32_t delay_arch_common_tick(void)
+{
+	return HAL_GetTick();
+}
@@ -0,0 +1,20 @@
+/*
+ * delay_arch_common.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef API_API_DELAY_ARCH_COMMON_DELAY_ARCH_COMMON_H_
+#define API_API_DELAY_ARCH_COMMON_DELAY_ARCH_COMMON_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Get arch specific millisecond tick.
+ *
+ * @return Milliseconds since boot.
+ */
+uint32_t delay_arch_common_tick(void);
+
+#endif /* API_API_DELAY_ARCH_COMMON_DELAY_ARCH_COMMON_H_ */
@@ -47,6 +47,12 @@ void delay_write(delay_t *delay, tick_t duration);
  * @param duration Duration of delay.
  */
 void delay_task(tick_t duration);
+/**
+ * @brief Get milliseconds since boot.
+ *
+ * @return Tick in milliseconds.
+ */
+tick_t delay_get_tick(void);
 /**
  * @brief Return is the delay is running.
  *
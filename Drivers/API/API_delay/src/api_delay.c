@@ -7,7 +7,7 @@
 #include "api_delay.h"
 
 #include <stdio.h>
-#include "stm32f4xx_hal.h"
+#include "delay_arch_common.h"
 
 void delay_init(delay_t *delay, tick_t duration) {
 	if (delay == NULL)
@@ -24,10 +24,10 @@ bool delay_read(delay_t *delay) {
 	bool rt = false;
 
 	if (delay->running == false) {
-		delay->startTime = HAL_GetTick();
+		delay->startTime = delay_arch_common_tick();
 		delay->running = true;
 	} else {
-		rt = (HAL_GetTick() - delay->startTime) > delay->duration;
+		rt = (delay_arch_common_tick() - delay->startTime) > delay->duration;
 		if (rt == true)
 			delay->running = false;
 	}
@@ -51,6 +51,11 @@ void delay_task(tick_t duration) {
 		;
 }
 
+tick_t delay_get_tick(void)
+{
+	return delay_arch_common_tick();
+}
+
 bool delay_is_running(delay_t * delay)
 {
 	bool rt =  delay->running;
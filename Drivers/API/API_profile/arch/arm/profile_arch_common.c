@@ -0,0 +1,27 @@
+/*
+ * profile_arch_common.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+#include "stm32f4xx_hal.h"
+
+#include "profile_arch_common.h"
+
+void profile_arch_common_init(void)
+{
+	/* DWT is part of the debug block, it only counts with trace enabled */
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t profile_arch_common_cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+uint32_t profile_arch_common_cycle_hz(void)
+{
+	return SystemCoreClock;
+}
@@ -0,0 +1,31 @@
+/*
+ * profile_arch_common.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef API_API_PROFILE_ARCH_COMMON_PROFILE_ARCH_COMMON_H_
+#define API_API_PROFILE_ARCH_COMMON_PROFILE_ARCH_COMMON_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Start the arch specific cycle counter.
+ *
+ */
+void profile_arch_common_init(void);
+/**
+ * @brief Get arch specific cycle counter. Wraps around at 32 bits.
+ *
+ * @return Cycles.
+ */
+uint32_t profile_arch_common_cycles(void);
+/**
+ * @brief Get the cycle counter rate.
+ *
+ * @return Cycles per second.
+ */
+uint32_t profile_arch_common_cycle_hz(void);
+
+#endif /* API_API_PROFILE_ARCH_COMMON_PROFILE_ARCH_COMMON_H_ */
@@ -0,0 +1,94 @@
+/*
+ * API_profile.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef API_API_PROFILE_INC_API_PROFILE_H_
+#define API_API_PROFILE_INC_API_PROFILE_H_
+
+#include <stdint.h>
+
+/* Set to 0 to build the span calls as nothing */
+#define PROFILE_ENABLE (1)
+/* Last spans kept. Older ones are overwritten */
+#define PROFILE_RING_SIZE (128)
+
+typedef enum
+{
+	PROFILE_OK = 0,
+	PROFILE_E_PARAM = -1,
+}profile_err_t;
+
+typedef enum
+{
+	PROFILE_SPAN_SPI_FLASH_INIT = 0, /*< spi_flash_init. Clock setup is not a span, the cycle rate changes inside it */
+	PROFILE_SPAN_SPI_FLASH_ERASE, /*< One SPI flash erase, issued to ready. Argument is the spi_flash_busy_op_t */
+	PROFILE_SPAN_SPI_FLASH_PROGRAM, /*< One SPI flash page program, issued to ready */
+	PROFILE_SPAN_FRAME, /*< One console frame, checked, processed and answered. Argument is the command */
+	PROFILE_SPAN_INSTALL, /*< Copy of an image out of SPI flash. Argument is the boot mode */
+	PROFILE_SPAN_MAX,
+}profile_span_id_t;
+
+/**
+ * @brief Recorded span.
+ *
+ */
+typedef struct
+{
+	uint8_t id; /*< profile_span_id_t */
+	uint8_t arg; /*< Span specific argument */
+	uint32_t start; /*< Cycle counter at start */
+	uint32_t cycles; /*< Duration */
+}profile_span_t;
+
+/**
+ * @brief Start the cycle counter. Spans ended before are meaningless.
+ *
+ */
+void profile_init(void);
+/**
+ * @brief Start a span.
+ *
+ * @return Cycle counter, to give back to profile_end.
+ */
+uint32_t profile_begin(void);
+/**
+ * @brief End a span and record it. Not interrupt safe, spans are recorded from the main loop only.
+ *
+ * @param id Span id.
+ * @param arg Span specific argument.
+ * @param start Value returned by profile_begin.
+ */
+void profile_end(profile_span_id_t id, uint8_t arg, uint32_t start);
+/**
+ * @brief Get the cycle counter rate. It is the core clock, so spans are only taken after clock setup.
+ *
+ * @return Cycles per second.
+ */
+uint32_t profile_get_cycle_hz(void);
+/**
+ * @brief Get spans recorded since start, overwritten ones included.
+ *
+ * @return Number of spans. Span 'n' is the 'n'th one recorded.
+ */
+uint32_t profile_get_span_total(void);
+/**
+ * @brief Read recorded spans in order.
+ *
+ * @param first First span wanted. Moved to the oldest one kept if it was overwritten.
+ * @param spans Buffer where spans are copied.
+ * @param span_nbr Size of 'spans' in spans. Spans copied on return.
+ * @return
+ * 			- PROFILE_OK if no error.
+ * 			- PROFILE_E_PARAM if a pointer is NULL.
+ */
+int profile_read(uint32_t * first, profile_span_t * spans, uint8_t * span_nbr);
+/**
+ * @brief Forget every recorded span.
+ *
+ */
+void profile_reset(void);
+
+#endif /* API_API_PROFILE_INC_API_PROFILE_H_ */
@@ -0,0 +1,72 @@
+/*
+ * API_profile.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+#include <stddef.h>
+#include "API_profile.h"
+#include "profile_arch_common.h"
+
+static profile_span_t profile_ring[PROFILE_RING_SIZE];
+static uint32_t profile_span_total = 0; /* Spans recorded. Next one goes to 'profile_span_total % PROFILE_RING_SIZE' */
+
+void profile_init(void)
+{
+#if PROFILE_ENABLE
+	profile_arch_common_init();
+#endif
+}
+
+uint32_t profile_begin(void)
+{
+#if PROFILE_ENABLE
+	return profile_arch_common_cycles();
+#else
+	return 0;
+#endif
+}
+
+void profile_end(profile_span_id_t id, uint8_t arg, uint32_t start)
+{
+#if PROFILE_ENABLE
+	/* Unsigned difference stays right across one counter wrap */
+	uint32_t cycles = profile_arch_common_cycles() - start;
+	profile_span_t * span = &profile_ring[profile_span_total % PROFILE_RING_SIZE];
+	span->id = id;
+	span->arg = arg;
+	span->start = start;
+	span->cycles = cycles;
+	profile_span_total++;
+#endif
+}
+
+uint32_t profile_get_cycle_hz(void)
+{
+	return profile_arch_common_cycle_hz();
+}
+
+uint32_t profile_get_span_total(void)
+{
+	return profile_span_total;
+}
+
+int profile_read(uint32_t * first, profile_span_t * spans, uint8_t * span_nbr)
+{
+	if(first == NULL || spans == NULL || span_nbr == NULL) return PROFILE_E_PARAM;
+
+	uint32_t oldest = (profile_span_total > PROFILE_RING_SIZE)? profile_span_total - PROFILE_RING_SIZE : 0;
+	if(*first < oldest)
+		*first = oldest;
+
+	uint8_t nbr = 0;
+	for(uint32_t i = *first; i < profile_span_total && nbr < *span_nbr; i++)
+		spans[nbr++] = profile_ring[i % PROFILE_RING_SIZE];
+	*span_nbr = nbr;
+	return PROFILE_OK;
+}
+
+void profile_reset(void)
+{
+	profile_span_total = 0;
+}
@@ -11,6 +11,8 @@
 #include <spi_flash_arch_common.h>
 #include <stdbool.h>
 
+#include "API_spi_flash_def.h"
+
 #include "stm32f4xx_hal.h"
 #include "stm32f4xx_hal_conf.h"
 #include "stm32f4xx_hal_spi.h"
@@ -18,8 +20,19 @@
 
 #define ARCH_STM32F4XX_SPI_HDLE ((SPI_HandleTypeDef *) ARCH_SPI_HANDLE_NAME)
 
+/* SPI1 requests are mapped to DMA2 Channel 3: RX on Stream 2, TX on Stream 3 (RM0090 DMA2 request mapping) */
+#define ARCH_STM32F4XX_DMA_RX_STREAM 	DMA2_Stream2
+#define ARCH_STM32F4XX_DMA_TX_STREAM 	DMA2_Stream3
+#define ARCH_STM32F4XX_DMA_CHANNEL 		DMA_CHANNEL_3
+#define ARCH_STM32F4XX_DMA_RX_IRQ 		DMA2_Stream2_IRQn
+#define ARCH_STM32F4XX_DMA_TX_IRQ 		DMA2_Stream3_IRQn
+
 static void * ARCH_SPI_HANDLE_NAME = NULL;
 static spi_flash_arch_rx_it_hdle _spi_rx_hdle = NULL;
+static spi_flash_arch_tx_it_hdle _spi_tx_hdle = NULL;
+static DMA_HandleTypeDef _hdma_rx = {0};
+static DMA_HandleTypeDef _hdma_tx = {0};
+static volatile bool _dma_rx_ongoing = false; /* Last DMA transfer was a receive */
 static uint32_t _port = 0;
 static uint16_t _pin = 0;
 
@@ -29,12 +42,55 @@ static uint16_t _pin = 0;
  * @return true: read. false: not ready.
  */
 static inline bool spi_flash_arch_ready(void);
+/**
+ * @brief Initialize a DMA stream for SPI transfers.
+ *
+ * @param hdma DMA handle.
+ * @param stream DMA stream.
+ * @param direction DMA direction.
+ * @param irq DMA stream IRQ.
+ * @return
+ * 			- HAL_OK if no error.
+ */
+static int spi_flash_arch_init_dma(DMA_HandleTypeDef * hdma, DMA_Stream_TypeDef * stream, uint32_t direction, IRQn_Type irq);
 
 static inline bool spi_flash_arch_ready(void)
 {
 	return (_spi_hdle == NULL?false:true);
 }
 
+static int spi_flash_arch_init_dma(DMA_HandleTypeDef * hdma, DMA_Stream_TypeDef * stream, uint32_t direction, IRQn_Type irq)
+{
+	hdma->Instance = stream;
+	hdma->Init.Channel = ARCH_STM32F4XX_DMA_CHANNEL;
+	hdma->Init.Direction = direction;
+	hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma->Init.MemInc = DMA_MINC_ENABLE;
+	hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+	hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	hdma->Init.Mode = DMA_NORMAL;
+	hdma->Init.Priority = DMA_PRIORITY_HIGH;
+	hdma->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+
+	int rt = HAL_DMA_Init(hdma);
+	if(rt != HAL_OK)
+		return rt;
+
+	HAL_NVIC_SetPriority(irq, 0, 0);
+	HAL_NVIC_EnableIRQ(irq);
+	return HAL_OK;
+}
+
+void DMA2_Stream2_IRQHandler(void)
+{
+	HAL_DMA_IRQHandler(&_hdma_rx);
+}
+
+void DMA2_Stream3_IRQHandler(void)
+{
+	HAL_DMA_IRQHandler(&_hdma_tx);
+}
+
 void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef * hspi)
 {
 	if(hspi->Instance == ARCH_STM32F4XX_SPI_HDLE->Instance)
@@ -44,7 +100,31 @@ void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef * hspi)
 	}
 }
 
-int spi_flash_arch_init_spi(void * spi_hdle, spi_flash_arch_rx_it_hdle spi_rx_it_hdle)
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef * hspi)
+{
+	if(hspi->Instance == ARCH_STM32F4XX_SPI_HDLE->Instance)
+	{
+		if(_spi_tx_hdle != NULL)
+			_spi_tx_hdle((void *) hspi, (uint8_t *)hspi->pTxBuffPtr, hspi->TxXferSize);
+	}
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef * hspi)
+{
+	if(hspi->Instance == ARCH_STM32F4XX_SPI_HDLE->Instance)
+	{
+		/* Report the error to whoever is waiting for the transfer */
+		if(_dma_rx_ongoing)
+		{
+			if(_spi_rx_hdle != NULL)
+				_spi_rx_hdle((void *) hspi, NULL, 0);
+		}
+		else if(_spi_tx_hdle != NULL)
+			_spi_tx_hdle((void *) hspi, NULL, 0);
+	}
+}
+
+int spi_flash_arch_init_spi(void * spi_hdle, spi_flash_arch_rx_it_hdle spi_rx_it_hdle, spi_flash_arch_tx_it_hdle spi_tx_it_hdle)
 {
 	if(spi_flash_arch_ready() == true) return SPI_FLASH_ARCH_E_READY;
 
@@ -68,8 +148,21 @@ int spi_flash_arch_init_spi(void * spi_hdle, spi_flash_arch_rx_it_hdle spi_rx_it
 	if(rt != HAL_OK)
 		return rt;
 
+	__HAL_RCC_DMA2_CLK_ENABLE();
+	rt = spi_flash_arch_init_dma(&_hdma_rx, ARCH_STM32F4XX_DMA_RX_STREAM, DMA_PERIPH_TO_MEMORY, ARCH_STM32F4XX_DMA_RX_IRQ);
+	if(rt != HAL_OK)
+		return rt;
+	rt = spi_flash_arch_init_dma(&_hdma_tx, ARCH_STM32F4XX_DMA_TX_STREAM, DMA_MEMORY_TO_PERIPH, ARCH_STM32F4XX_DMA_TX_IRQ);
+	if(rt != HAL_OK)
+		return rt;
+
+	/* Full duplex master receive also clocks the TX stream, so both are always linked */
+	__HAL_LINKDMA(hspi1, hdmarx, _hdma_rx);
+	__HAL_LINKDMA(hspi1, hdmatx, _hdma_tx);
+
 	_spi_hdle = spi_hdle;
 	_spi_rx_hdle = spi_rx_it_hdle;
+	_spi_tx_hdle = spi_tx_it_hdle;
 	return SPI_FLASH_ARCH_OK;
 }
 
@@ -116,6 +209,17 @@ int spi_flash_arch_write_spi(uint8_t * data, uint16_t data_size, uint32_t timeou
 	return 	HAL_SPI_Transmit(ARCH_STM32F4XX_SPI_HDLE, data, data_size, timeout);
 }
 
+int spi_flash_arch_read_spi_lines(uint8_t * buffer, uint16_t buffer_size, uint8_t lines, uint32_t timeout)
+{
+	/* SPI1 only has one MISO line. Dual/quad output needs a QSPI capable peripheral */
+	return SPI_FLASH_ARCH_E_SUPPORT;
+}
+
+uint32_t spi_flash_arch_get_read_modes(void)
+{
+	return SPI_FLASH_READ_MODE_BIT(SPI_FLASH_READ_MODE_SINGLE) | SPI_FLASH_READ_MODE_BIT(SPI_FLASH_READ_MODE_FAST);
+}
+
 int spi_flash_arch_read_it_spi(uint8_t * data, uint16_t data_size)
 {
 	if(spi_flash_arch_ready() == false) return SPI_FLASH_ARCH_E_READY;
@@ -123,6 +227,22 @@ int spi_flash_arch_read_it_spi(uint8_t * data, uint16_t data_size)
 	return HAL_SPI_Receive_IT(ARCH_STM32F4XX_SPI_HDLE, data, data_size);
 }
 
+int spi_flash_arch_read_dma_spi(uint8_t * buffer, uint16_t buffer_size)
+{
+	if(spi_flash_arch_ready() == false) return SPI_FLASH_ARCH_E_READY;
+
+	_dma_rx_ongoing = true;
+	return HAL_SPI_Receive_DMA(ARCH_STM32F4XX_SPI_HDLE, buffer, buffer_size);
+}
+
+int spi_flash_arch_write_dma_spi(uint8_t * data, uint16_t data_size)
+{
+	if(spi_flash_arch_ready() == false) return SPI_FLASH_ARCH_E_READY;
+
+	_dma_rx_ongoing = false;
+	return HAL_SPI_Transmit_DMA(ARCH_STM32F4XX_SPI_HDLE, data, data_size);
+}
+
 void spi_flash_arch_block_delay(uint32_t milliseconds)
 {
 	HAL_Delay(milliseconds);
@@ -14,11 +14,14 @@
 
 typedef enum
 {
+	SPI_FLASH_ARCH_E_SUPPORT = -2,
 	SPI_FLASH_ARCH_E_READY = -1,
 	SPI_FLASH_ARCH_OK = 0,
 }arch_spi_flash_err_t;
 
+/* Transfer complete handlers. Called from interrupt context. 'data' is NULL and 'data_size' 0 on transfer error */
 typedef void (*spi_flash_arch_rx_it_hdle)(void * spi_hdle, uint8_t * data, uint16_t data_size);
+typedef void (*spi_flash_arch_tx_it_hdle)(void * spi_hdle, uint8_t * data, uint16_t data_size);
 
 /**
  * @brief Initialize chip select (CS) pin.
@@ -43,10 +46,11 @@ void spi_flash_arch_deselect_cs(void);
  * @brief Initialize SPI handle.
  *
  * @param spi_hdle arch specific SPI handle.
- * @param spi_rx_it_hdle Optional function to receive via IT through SPI.
+ * @param spi_rx_it_hdle Optional function to receive via IT/DMA through SPI.
+ * @param spi_tx_it_hdle Optional function called when a DMA transmit is complete.
  * @return
  */
-int spi_flash_arch_init_spi(void * spi_hdle, spi_flash_arch_rx_it_hdle spi_rx_it_hdle);
+int spi_flash_arch_init_spi(void * spi_hdle, spi_flash_arch_rx_it_hdle spi_rx_it_hdle, spi_flash_arch_tx_it_hdle spi_tx_it_hdle);
 /**
  * @brief Poll read SPI.
  *
@@ -67,6 +71,24 @@ int spi_flash_arch_read_spi(uint8_t * buffer, uint16_t buffer_size, uint32_t tim
  * 			- SPI_FLASH_ARCH_OK if no error.
  */
 int spi_flash_arch_write_spi(uint8_t * data, uint16_t data_size, uint32_t timeout);
+/**
+ * @brief Poll read SPI using several data lines. Used by dual/quad output read modes.
+ *
+ * @param buffer Buffer.
+ * @param buffer_size Buffer size expected.
+ * @param lines Data lines to read from (2 or 4).
+ * @param timeout Timeout for operation.
+ * @return
+ * 			- SPI_FLASH_ARCH_OK if no error.
+ * 			- SPI_FLASH_ARCH_E_SUPPORT if arch can not read with 'lines' data lines.
+ */
+int spi_flash_arch_read_spi_lines(uint8_t * buffer, uint16_t buffer_size, uint8_t lines, uint32_t timeout);
+/**
+ * @brief Get read modes the arch can drive.
+ *
+ * @return Mask of SPI_FLASH_READ_MODE_BIT(spi_flash_read_mode_t).
+ */
+uint32_t spi_flash_arch_get_read_modes(void);
 /**
  * @brief IT read through SPI.
  *
@@ -76,6 +98,24 @@ int spi_flash_arch_write_spi(uint8_t * data, uint16_t data_size, uint32_t timeou
  * 			- SPI_FLASH_ARCH_OK if no error.
  */
 int spi_flash_arch_read_it_spi(uint8_t * data, uint16_t data_size);
+/**
+ * @brief DMA read through SPI. Completion is reported through 'spi_rx_it_hdle'.
+ *
+ * @param buffer Buffer. Must stay valid until completion.
+ * @param buffer_size Expected size.
+ * @return
+ * 			- SPI_FLASH_ARCH_OK if no error.
+ */
+int spi_flash_arch_read_dma_spi(uint8_t * buffer, uint16_t buffer_size);
+/**
+ * @brief DMA write through SPI. Completion is reported through 'spi_tx_it_hdle'.
+ *
+ * @param data Data. Must stay valid until completion.
+ * @param data_size Data size.
+ * @return
+ * 			- SPI_FLASH_ARCH_OK if no error.
+ */
+int spi_flash_arch_write_dma_spi(uint8_t * data, uint16_t data_size);
 /**
  * @brief Arch specific block delay.
  *
@@ -9,6 +9,9 @@
 #define API_API_SPI_FLASH_INC_API_SPI_FLASH_H_
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include "API_spi_flash_def.h"
 
 typedef void * spi_if_hdle;
 
@@ -45,6 +48,44 @@ typedef struct
 	uint16_t pin;
 }spi_flash_cs_t;
 
+typedef enum
+{
+	SPI_FLASH_JOB_READ = 0, /*< Asynchronous read, see spi_flash_read_async */
+	SPI_FLASH_JOB_WRITE, /*< Asynchronous write, see spi_flash_write_async */
+	SPI_FLASH_JOB_ERASE, /*< Asynchronous erase, see spi_flash_erase_async. No buffer */
+	SPI_FLASH_JOB_MAX,
+}spi_flash_job_type_t;
+
+/* Operations that keep the chip busy, polled through status register 1 */
+typedef enum
+{
+	SPI_FLASH_BUSY_WRITE_ENABLE = 0, /*< Wait for WEL after write enable */
+	SPI_FLASH_BUSY_WRITE_STATUS, /*< Status register write */
+	SPI_FLASH_BUSY_PAGE_PROGRAM, /*< Page program */
+	SPI_FLASH_BUSY_SECTOR_ERASE, /*< 4 KiB sector erase */
+	SPI_FLASH_BUSY_BLOCK32_ERASE, /*< 32 KiB block erase */
+	SPI_FLASH_BUSY_BLOCK64_ERASE, /*< 64 KiB block erase */
+	SPI_FLASH_BUSY_CHIP_ERASE, /*< Chip erase */
+	SPI_FLASH_BUSY_SUSPEND, /*< Wait for BUSY to drop after erase/program suspend */
+	SPI_FLASH_BUSY_MAX,
+}spi_flash_busy_op_t;
+
+typedef struct
+{
+	uint32_t op_nbr; /*< Operations waited */
+	uint32_t poll_nbr; /*< Status register 1 reads */
+	uint32_t busy_ms; /*< Time from first poll until ready */
+	uint32_t busy_max_ms; /*< Longest operation */
+}spi_flash_busy_stats_t;
+
+/**
+ * @brief Asynchronous operation complete callback. Called from spi_flash_process.
+ *
+ * @param result SPI_FLASH_OK if no error.
+ * @param arg User argument given when the operation was started.
+ */
+typedef void (*spi_flash_cplt_cb)(int result, void * arg);
+
 /**
  * @brief Initialize SPI flash.
  *
@@ -55,7 +96,9 @@ typedef struct
  */
 int spi_flash_init(spi_if_hdle spi_if_hdle, spi_flash_cs_t cs_gpio);
 /**
- * @brief Read SPI flash.
+ * @brief Read SPI flash. When an asynchronous erase or write keeps the chip busy, it is suspended for the read
+ * and resumed afterwards, so the read does not wait for it. Reads that suspend are spaced by a couple of ticks,
+ * callers reading in a loop should gather their reads.
  *
  * @param buffer Buffer.
  * @param address Address to read.
@@ -63,6 +106,9 @@ int spi_flash_init(spi_if_hdle spi_if_hdle, spi_flash_cs_t cs_gpio);
  * @return
  * 			- SPI_FLASH_OK if no error.
  * 			- SPI_FLASH_E_BOUNDARIES Out of boundaries operation.
+ * 			- SPI_FLASH_E_ADDRESS range overlaps the sector or page being erased or programmed.
+ * 			- SPI_FLASH_E_BUSY asynchronous operation can not be suspended right now: a DMA transfer is ongoing, or it
+ * 			  was resumed too recently.
  */
 int spi_flash_read(uint8_t * buffer, uint32_t address, uint32_t size);
 /**
@@ -87,5 +133,105 @@ int spi_flash_write(uint8_t * buffer, uint32_t address, uint32_t size);
  * 			- SPI_FLASH_E_ADDRESS invalid address to erase.
  */
 int spi_flash_erase_range(size_t address, uint32_t size);
+/**
+ * @brief Start an asynchronous read. Data phase is done by DMA, completion is reported through 'cplt_cb'.
+ * Dual/quad read modes fall back to fast read.
+ *
+ * @param buffer Buffer. Must stay valid until completion.
+ * @param address Address to read.
+ * @param size Size to read.
+ * @param cplt_cb Completion callback. Can be NULL.
+ * @param arg User argument for 'cplt_cb'.
+ * @return
+ * 			- SPI_FLASH_OK if operation started.
+ * 			- SPI_FLASH_E_BUSY another operation is ongoing.
+ * 			- SPI_FLASH_E_BOUNDARIES Out of boundaries operation.
+ */
+int spi_flash_read_async(uint8_t * buffer, uint32_t address, uint32_t size, spi_flash_cplt_cb cplt_cb, void * arg);
+/**
+ * @brief Start an asynchronous write. Each page is sent by DMA and the chip busy state is polled by spi_flash_process.
+ *
+ * @param buffer Data to write. Must stay valid until completion.
+ * @param address Address to write.
+ * @param size Size to write.
+ * @param cplt_cb Completion callback. Can be NULL.
+ * @param arg User argument for 'cplt_cb'.
+ * @return
+ * 			- SPI_FLASH_OK if operation started.
+ * 			- SPI_FLASH_E_BUSY another operation is ongoing.
+ * 			- SPI_FLASH_E_BOUNDARIES Out of boundaries operation.
+ */
+int spi_flash_write_async(uint8_t * buffer, uint32_t address, uint32_t size, spi_flash_cplt_cb cplt_cb, void * arg);
+/**
+ * @brief Start an asynchronous erase. Each sector or block erase is polled by spi_flash_process, and spi_flash_read
+ * can suspend it. Address and size should be sector aligned.
+ *
+ * @param address Start address.
+ * @param size Size to erase.
+ * @param cplt_cb Completion callback. Can be NULL.
+ * @param arg User argument for 'cplt_cb'.
+ * @return
+ * 			- SPI_FLASH_OK if operation started.
+ * 			- SPI_FLASH_E_BUSY another operation is ongoing.
+ * 			- SPI_FLASH_E_BOUNDARIES Out of boundaries operation.
+ * 			- SPI_FLASH_E_ADDRESS invalid address to erase.
+ */
+int spi_flash_erase_async(uint32_t address, uint32_t size, spi_flash_cplt_cb cplt_cb, void * arg);
+/**
+ * @brief Queue an asynchronous operation. Jobs run one after the other in submission order, each one is started by
+ * spi_flash_process once the previous one completes. Parameters are checked now, start errors are reported through
+ * 'cplt_cb'.
+ *
+ * @param type Operation.
+ * @param buffer Buffer to read into or write from. Must stay valid until completion. Not used by erase.
+ * @param address Start address.
+ * @param size Size to operate.
+ * @param cplt_cb Completion callback. Can be NULL.
+ * @param arg User argument for 'cplt_cb'.
+ * @return
+ * 			- SPI_FLASH_OK if operation queued.
+ * 			- SPI_FLASH_E_BUSY queue is full.
+ * 			- SPI_FLASH_E_BOUNDARIES Out of boundaries operation.
+ * 			- SPI_FLASH_E_ADDRESS invalid address to erase.
+ */
+int spi_flash_submit(spi_flash_job_type_t type, uint8_t * buffer, uint32_t address, uint32_t size, spi_flash_cplt_cb cplt_cb, void * arg);
+/**
+ * @brief Advance asynchronous operations, start queued jobs and call completion callbacks. Call it from the superloop.
+ *
+ * @return
+ * 			- SPI_FLASH_OK if no asynchronous operation is ongoing nor queued.
+ * 			- SPI_FLASH_E_BUSY asynchronous operation still ongoing or queued.
+ */
+int spi_flash_process(void);
+/**
+ * @brief Get busy wait instrumentation of an operation, accumulated since init or last reset.
+ *
+ * @param op Operation.
+ * @param stats Where statistics are saved.
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ * 			- SPI_FLASH_E_PARAM invalid operation.
+ */
+int spi_flash_get_busy_stats(spi_flash_busy_op_t op, spi_flash_busy_stats_t * stats);
+/**
+ * @brief Reset busy wait instrumentation of every operation.
+ *
+ */
+void spi_flash_reset_busy_stats(void);
+/**
+ * @brief Set read mode used by spi_flash_read. Default is the fastest mode advertised by arch layer.
+ *
+ * @param mode Read mode.
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ * 			- SPI_FLASH_E_PARAM mode not supported by arch layer.
+ */
+int spi_flash_set_read_mode(spi_flash_read_mode_t mode);
+/**
+ * @brief Get read mode used by spi_flash_read.
+ *
+ * @return Read mode.
+ */
+spi_flash_read_mode_t spi_flash_get_read_mode(void);
 
 #endif /* API_API_SPI_FLASH_INC_API_SPI_FLASH_H_ */
@@ -8,6 +8,12 @@
 #ifndef API_API_SPI_FLASH_INC_API_SPI_FLASH_DEF_H_
 #define API_API_SPI_FLASH_INC_API_SPI_FLASH_DEF_H_
 
+/* Erase and program granularity */
+#define SPI_FLASH_BLOCK64_SIZE (1024*64)
+#define SPI_FLASH_BLOCK32_SIZE (1024*32)
+#define SPI_FLASH_SECTOR_SIZE (1024*4)
+#define SPI_FLASH_PAGE_SIZE (256)
+
 /* (CFI) Common Flash Interface commands. Refer to JEDEC standards.*/
 
 #define API_SPI_FLASH_CMD_READ_UNIQUE_ID_NUMBER (0x4BU)
@@ -18,6 +24,9 @@
 #define API_SPI_FLASH_CMD_READ_STATUS_REG_3  (0x15U)
 
 #define API_SPI_FLASH_CMD_READ_DATA (0x03U)
+#define API_SPI_FLASH_CMD_FAST_READ (0x0BU)
+#define API_SPI_FLASH_CMD_FAST_READ_DUAL_OUTPUT (0x3BU)
+#define API_SPI_FLASH_CMD_FAST_READ_QUAD_OUTPUT (0x6BU)
 
 #define API_SPI_FLASH_CMD_WRITE_EN (0x06U)
 #define API_SPI_FLASH_CMD_WRITE_DIS (0x04U)
@@ -33,6 +42,9 @@
 #define API_SPI_FLASH_CMD_DEL_64KB_BLOCK (0xD8U)
 #define API_SPI_FLASH_CMD_DEL_CHIP (0xC7U)
 
+#define API_SPI_FLASH_CMD_SUSPEND (0x75U) /*< Erase/Program suspend */
+#define API_SPI_FLASH_CMD_RESUME (0x7AU) /*< Erase/Program resume */
+
 #define API_SPI_FLASH_CMD_ENABLE_RESET (0x66U)
 #define API_SPI_FLASH_CMD_RESET_DEVICE (0x99U)
 
@@ -42,6 +54,25 @@
 #define API_SPI_FLASH_BSY_IS_SET(reg)	((reg & API_SPI_FLASH_BSY_BIT) == API_SPI_FLASH_BSY_BIT)
 #define API_SPI_FLASH_WEL_IS_SET(reg)	((reg & API_SPI_FLASH_WEL_BIT) == API_SPI_FLASH_WEL_BIT)
 
+#define API_SPI_FLASH_QE_BIT (1<<1) /*< Quad enable, status register 2 */
+
+#define API_SPI_FLASH_SUS_BIT (1<<7) /*< Erase/Program suspended, status register 2 */
+
+#define API_SPI_FLASH_QE_IS_SET(reg)	((reg & API_SPI_FLASH_QE_BIT) == API_SPI_FLASH_QE_BIT)
+#define API_SPI_FLASH_SUS_IS_SET(reg)	((reg & API_SPI_FLASH_SUS_BIT) == API_SPI_FLASH_SUS_BIT)
+
+/* Read modes. Arch layer advertises which ones it can drive as a mask of SPI_FLASH_READ_MODE_BIT */
+typedef enum
+{
+	SPI_FLASH_READ_MODE_SINGLE = 0, /*< Read Data (0x03). No dummy cycles, lowest max clock */
+	SPI_FLASH_READ_MODE_FAST, /*< Fast Read (0x0B). One dummy byte, full clock range */
+	SPI_FLASH_READ_MODE_DUAL_OUTPUT, /*< Fast Read Dual Output (0x3B). One dummy byte, data on IO0-IO1 */
+	SPI_FLASH_READ_MODE_QUAD_OUTPUT, /*< Fast Read Quad Output (0x6B). One dummy byte, data on IO0-IO3. Needs QE bit */
+	SPI_FLASH_READ_MODE_MAX,
+}spi_flash_read_mode_t;
+
+#define SPI_FLASH_READ_MODE_BIT(mode) (1U << (mode))
+
 /* JEDEC has an unique ID for each manufacturer. It also give us the memory capacity.
  * Each vendor must describe the meaning of 'memory_type' and 'memory_capacity' field */
 typedef struct __attribute__((packed))
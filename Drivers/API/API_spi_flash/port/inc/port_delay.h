@@ -35,5 +35,11 @@ bool port_delay_read(port_delay_hdle delay_hdle);
  * @param delay_hdle Previously initialized delay handle pointer.
  */
 void port_delay_deinit(port_delay_hdle * delay_hdle);
+/**
+ * @brief Get current tick.
+ *
+ * @return Tick in milliseconds.
+ */
+uint32_t port_delay_get_tick(void);
 
 #endif /* API_API_SPI_FLASH_PORT_INC_PORT_DELAY_H_ */
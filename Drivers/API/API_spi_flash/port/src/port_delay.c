@@ -30,3 +30,8 @@ void port_delay_deinit(port_delay_hdle * delay_hdle)
 		*delay_hdle = NULL;
 	}
 }
+
+uint32_t port_delay_get_tick(void)
+{
+	return delay_get_tick();
+}
@@ -13,6 +13,7 @@
 #include "API_spi_flash.h"
 
 #include "port_delay.h"
+#include "API_profile.h"
 
 #define SPI_FLASH_GET_CHIP_STATE (spi_flash_chip.chip_state)
 #define SPI_FLASH_SET_CHIP_STATE(new_state) (spi_flash_chip.chip_state = new_state)
@@ -20,22 +21,34 @@
 #define SPI_FLASH_DEFAULT_READ_TIMEOUT (10) /* 10 milliseconds */
 #define SPI_FLASH_RESET_DEVICE_WAIT (1) /* 1 millisecond*/
 
-#define SPI_FLASH_BLOCK64_SIZE (1024*64)
-#define SPI_FLASH_BLOCK32_SIZE (1024*32)
-#define SPI_FLASH_SECTOR_SIZE (1024*4)
-#define SPI_FLASH_PAGE_SIZE (256)
-
 #define SPI_FLASH_COMMAND_AND_ADDRESS_SIZE (4) /*One byte for command, three bytes for 24-bit address of chip */
+#define SPI_FLASH_READ_DUMMY_MAX_SIZE (1) /* Fast read opcodes need 8 dummy clocks after the address */
+#define SPI_FLASH_READ_CHUNK_SIZE (32*1024) /* Max bytes per arch read call, CS stays low between chunks */
+#define SPI_FLASH_READ_CHUNK_TIMEOUT (50) /* milliseconds */
+#define SPI_FLASH_QUEUE_SIZE (8) /* Jobs waiting for the chip */
 
 #define SPI_FLASH_HTONL(address) (((address & 0x000000ff)<<24)|((address & 0x0000ff00)<<8|((address & 0x00ff0000)>>8)|(address & 0xff000000)>>24))
 
-/* The following values are set based in W25Q64JV datasheet and the max time for each operarion */
+/* The following values are set based in W25Q64JV datasheet and the typical and max time for each operarion */
 #define SPI_FLASH_WRITE_STATUS_MAX_TIMEOUT 	(15) /*< milliseconds */
 #define SPI_FLASH_PROGRAM_PAGE_MAX_TIMEOUT 	(3) /*< milliseconds */
 #define SPI_FLASH_SECTOR_ERASE_MAX_TIMEOUT 	(400) /*< milliseconds */
 #define SPI_FLASH_BLOCK32_ERASE_MAX_TIMEOUT (1600) /*< milliseconds */
 #define SPI_FLASH_BLOCK64_ERASE_MAX_TIMEOUT (2000) /*< milliseconds */
 #define SPI_FLASH_CHIP_ERASE_MAX_TIMEOUT 	(100*1000) /*< milliseconds */
+#define SPI_FLASH_SUSPEND_MAX_TIMEOUT 		(2) /*< milliseconds. tSUS is 20 us, but one tick may be about to elapse */
+#define SPI_FLASH_RESUME_HOLD_TIME 			(2) /*< milliseconds. tSUS from resume to next suspend is 20 us, but a tick is the least we measure */
+#define SPI_FLASH_WRITE_STATUS_TYP_TIME 	(10) /*< milliseconds */
+#define SPI_FLASH_PROGRAM_PAGE_TYP_TIME 	(0) /*< milliseconds. 0.4 ms */
+#define SPI_FLASH_SECTOR_ERASE_TYP_TIME 	(45) /*< milliseconds */
+#define SPI_FLASH_BLOCK32_ERASE_TYP_TIME 	(120) /*< milliseconds */
+#define SPI_FLASH_BLOCK64_ERASE_TYP_TIME 	(150) /*< milliseconds */
+#define SPI_FLASH_CHIP_ERASE_TYP_TIME 		(20*1000) /*< milliseconds */
+
+/* Busy polling. Nothing is polled before half the typical time, then the interval doubles from 1 ms up to
+ * 1/16 of the typical time, so the end is seen at most ~6% late. Operations under 8 ms are polled back to back */
+#define SPI_FLASH_POLL_BACKOFF_MIN_TYP_TIME (8) /*< milliseconds */
+#define SPI_FLASH_POLL_INTERVAL_DIVIDER 	(16)
 
 typedef struct
 {
@@ -43,10 +56,99 @@ typedef struct
 	uint8_t chip_type; /* Memory type */
 	uint32_t chip_size; /* Chip size to check boundaries */
 	spi_flash_state_t chip_state; /*  Chip state */
+	spi_flash_read_mode_t read_mode; /* Read mode used by spi_flash_read */
 }spi_flash_chip_t;
 
+typedef struct
+{
+	uint32_t typical_ms; /* Datasheet typical time */
+	uint32_t max_ms; /* Datasheet max time, used as timeout */
+}spi_flash_busy_time_t;
+
+typedef struct
+{
+	uint8_t command; /* Read opcode */
+	uint8_t dummy_size; /* Dummy bytes after address */
+	uint8_t lines; /* Data lines */
+}spi_flash_read_mode_info_t;
+
+typedef enum
+{
+	SPI_FLASH_ASYNC_IDLE = 0, /* No asynchronous operation */
+	SPI_FLASH_ASYNC_READ, /* DMA read ongoing */
+	SPI_FLASH_ASYNC_PAGE_TX, /* DMA page data transmit ongoing */
+	SPI_FLASH_ASYNC_PAGE_PROGRAM, /* Chip programming a page, polled by spi_flash_process */
+	SPI_FLASH_ASYNC_ERASE, /* Chip erasing a sector or block, polled by spi_flash_process */
+	SPI_FLASH_ASYNC_DONE, /* Operation done, callback pending */
+}spi_flash_async_step_t;
+
+typedef struct
+{
+	volatile spi_flash_async_step_t step; /* Current step */
+	volatile int result; /* Result of operation once done */
+	uint8_t * buffer; /* User buffer */
+	uint32_t address; /* Start address */
+	uint32_t size; /* Total size */
+	volatile uint32_t done; /* Bytes already transferred. Includes the chunk being programmed or erased by the chip */
+	volatile uint32_t chunk; /* Bytes of the ongoing DMA transfer, page program or erase */
+	spi_flash_busy_op_t busy_op; /* Page program or erase kind the chip is busy with */
+	bool busy_started; /* Busy time is being counted, from first poll */
+	uint32_t busy_start_tick; /* Tick of first poll */
+	uint32_t busy_start_cycles; /* Profiling cycle counter when the page program or erase was issued */
+	uint32_t busy_poll_ms; /* Elapsed time of next poll, since 'busy_start_tick' */
+	uint32_t busy_interval; /* Current poll interval in milliseconds, 0 polls on every call */
+	uint32_t busy_poll_nbr; /* Status register 1 reads of the ongoing page program or erase */
+	bool resumed; /* A suspended operation was resumed at 'resume_tick' */
+	uint32_t resume_tick; /* Tick of last resume. Next suspend waits SPI_FLASH_RESUME_HOLD_TIME from it */
+	spi_flash_state_t last_state; /* Chip state to restore when operation is done */
+	bool modify; /* Operation is a write or an erase. If it fails the chip may still be busy, so it is left in error like spi_flash_write */
+	spi_flash_cplt_cb cplt_cb; /* Completion callback */
+	void * cplt_arg; /* Completion callback argument */
+}spi_flash_async_t;
+
+typedef struct
+{
+	spi_flash_job_type_t type; /* Operation */
+	uint8_t * buffer; /* User buffer */
+	uint32_t address; /* Start address */
+	uint32_t size; /* Total size */
+	spi_flash_cplt_cb cplt_cb; /* Completion callback */
+	void * cplt_arg; /* Completion callback argument */
+}spi_flash_job_t;
+
+typedef struct
+{
+	spi_flash_job_t job[SPI_FLASH_QUEUE_SIZE]; /* Circular buffer of jobs */
+	uint8_t head; /* Next free job */
+	uint8_t tail; /* Oldest job */
+	uint8_t count; /* Jobs queued */
+}spi_flash_queue_t;
+
 /* We initialize the chip state to SPI_FLASH_STATE_DISABLE */
 static spi_flash_chip_t spi_flash_chip = {0};
+static spi_flash_async_t spi_flash_async = {0};
+static spi_flash_queue_t spi_flash_queue = {0};
+static spi_flash_busy_stats_t spi_flash_busy_stats[SPI_FLASH_BUSY_MAX] = {0};
+
+static const spi_flash_busy_time_t spi_flash_busy_time[SPI_FLASH_BUSY_MAX] =
+{
+	[SPI_FLASH_BUSY_WRITE_ENABLE] 	= {.typical_ms = 0, 								.max_ms = SPI_FLASH_WRITE_STATUS_MAX_TIMEOUT},
+	[SPI_FLASH_BUSY_WRITE_STATUS] 	= {.typical_ms = SPI_FLASH_WRITE_STATUS_TYP_TIME, 	.max_ms = SPI_FLASH_WRITE_STATUS_MAX_TIMEOUT},
+	[SPI_FLASH_BUSY_PAGE_PROGRAM] 	= {.typical_ms = SPI_FLASH_PROGRAM_PAGE_TYP_TIME, 	.max_ms = SPI_FLASH_PROGRAM_PAGE_MAX_TIMEOUT},
+	[SPI_FLASH_BUSY_SECTOR_ERASE] 	= {.typical_ms = SPI_FLASH_SECTOR_ERASE_TYP_TIME, 	.max_ms = SPI_FLASH_SECTOR_ERASE_MAX_TIMEOUT},
+	[SPI_FLASH_BUSY_BLOCK32_ERASE] 	= {.typical_ms = SPI_FLASH_BLOCK32_ERASE_TYP_TIME, 	.max_ms = SPI_FLASH_BLOCK32_ERASE_MAX_TIMEOUT},
+	[SPI_FLASH_BUSY_BLOCK64_ERASE] 	= {.typical_ms = SPI_FLASH_BLOCK64_ERASE_TYP_TIME, 	.max_ms = SPI_FLASH_BLOCK64_ERASE_MAX_TIMEOUT},
+	[SPI_FLASH_BUSY_CHIP_ERASE] 	= {.typical_ms = SPI_FLASH_CHIP_ERASE_TYP_TIME, 	.max_ms = SPI_FLASH_CHIP_ERASE_MAX_TIMEOUT},
+	[SPI_FLASH_BUSY_SUSPEND] 		= {.typical_ms = 0, 								.max_ms = SPI_FLASH_SUSPEND_MAX_TIMEOUT},
+};
+
+static const spi_flash_read_mode_info_t spi_flash_read_mode_info[SPI_FLASH_READ_MODE_MAX] =
+{
+	[SPI_FLASH_READ_MODE_SINGLE] 		= {.command = API_SPI_FLASH_CMD_READ_DATA, 				.dummy_size = 0, .lines = 1},
+	[SPI_FLASH_READ_MODE_FAST] 			= {.command = API_SPI_FLASH_CMD_FAST_READ, 				.dummy_size = 1, .lines = 1},
+	[SPI_FLASH_READ_MODE_DUAL_OUTPUT] 	= {.command = API_SPI_FLASH_CMD_FAST_READ_DUAL_OUTPUT, 	.dummy_size = 1, .lines = 2},
+	[SPI_FLASH_READ_MODE_QUAD_OUTPUT] 	= {.command = API_SPI_FLASH_CMD_FAST_READ_QUAD_OUTPUT, 	.dummy_size = 1, .lines = 4},
+};
 
 /**
  * @brief SPI IT rx handler.
@@ -57,16 +159,83 @@ static spi_flash_chip_t spi_flash_chip = {0};
  */
 static void spi_flash_rx_it_hdle(void * spi_hdle, uint8_t * data, uint16_t size);
 /**
- * @brief Send a command with arguments and poll to receive.
+ * @brief SPI DMA tx complete handler.
+ *
+ * @param spi_hdle SPI handle.
+ * @param data Data sent.
+ * @param size Data size sent.
+ */
+static void spi_flash_tx_it_hdle(void * spi_hdle, uint8_t * data, uint16_t size);
+/**
+ * @brief Select chip and send read command with address and dummy bytes. Chip is left selected.
+ *
+ * @param mode Read mode.
+ * @param address Address to read.
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ */
+static int spi_flash_read_command_start(spi_flash_read_mode_t mode, uint32_t address);
+/**
+ * @brief Start DMA read of next chunk of the asynchronous read.
+ *
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ */
+static int spi_flash_async_read_chunk(void);
+/**
+ * @brief Start programming next page of the asynchronous write.
+ *
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ */
+static int spi_flash_async_write_page(void);
+/**
+ * @brief Start erasing next sector or block of the asynchronous erase. The biggest aligned unit that fits is used.
+ *
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ */
+static int spi_flash_async_erase_unit(void);
+/**
+ * @brief Suspend the ongoing asynchronous page program or erase. A failure after the suspend command resumes the chip.
+ *
+ * @param suspended Set to false when the chip had already finished, so there is nothing to resume.
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ * 			- SPI_FLASH_E_TIMEOUT timeout reached.
+ */
+static int spi_flash_suspend(bool * suspended);
+/**
+ * @brief Resume the suspended asynchronous page program or erase.
  *
- * @param command Command with arguments array.
- * @param command_size Command size.
- * @param response Response buffer.
- * @param response_size Expcted response size.
  * @return
  * 			- SPI_FLASH_OK if no error.
  */
-static int spi_flash_send_advanced_command_receive(uint8_t * command, uint16_t command_size, uint8_t * response, uint16_t response_size);
+static int spi_flash_resume(void);
+/**
+ * @brief End asynchronous operation, restore chip state and call completion callback.
+ *
+ * @param result Operation result.
+ */
+static void spi_flash_async_finish(int result);
+/**
+ * @brief Check that an operation fits the chip.
+ *
+ * @param type Operation.
+ * @param buffer Buffer.
+ * @param address Start address.
+ * @param size Size to operate.
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ * 			- SPI_FLASH_E_BOUNDARIES Out of boundaries operation.
+ * 			- SPI_FLASH_E_ADDRESS invalid address to erase.
+ */
+static int spi_flash_job_check(spi_flash_job_type_t type, uint8_t * buffer, uint32_t address, uint32_t size);
+/**
+ * @brief Start queued jobs while the chip is free. A job that fails to start is completed with the error.
+ *
+ */
+static void spi_flash_queue_run(void);
 /**
  * @brief Send a command with arguments. No response expected.
  *
@@ -102,6 +271,27 @@ static int spi_flash_send_basic_command_receive(uint8_t command, uint8_t * respo
  * 			- SPI_FLASH_OK if no error.
  */
 static int spi_flash_get_status_reg_1(uint8_t * reg);
+/**
+ * @brief Account a busy wait in the instrumentation. Page programs and erases are also recorded as profiling spans.
+ *
+ * @param op Operation.
+ * @param poll_nbr Status register 1 reads.
+ * @param busy_ms Time until ready.
+ * @param start_cycles Profiling cycle counter when the operation started.
+ */
+static void spi_flash_busy_stats_add(spi_flash_busy_op_t op, uint32_t poll_nbr, uint32_t busy_ms, uint32_t start_cycles);
+/**
+ * @brief Poll status register 1 until (reg & mask) == value. One read command is sent and CS is held low, the chip
+ * keeps sending the updated register. Timings of 'op' set the hold off, back off and timeout.
+ *
+ * @param op Operation waited.
+ * @param mask Bits to check.
+ * @param value Expected value of bits.
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ * 			- SPI_FLASH_E_TIMEOUT timeout reached.
+ */
+static int spi_flash_poll_status_reg_1(spi_flash_busy_op_t op, uint8_t mask, uint8_t value);
 /**
  * @brief Wait until chip if status register is in write enable state.
  *
@@ -113,12 +303,12 @@ static int spi_flash_wait_until_chip_write_enable(void);
 /**
  * @brief Wait until the chip finish a write/erase operation.
  *
- * @param ms Milliseconds for timeout.
+ * @param op Operation waited.
  * @return
  * 			- SPI_FLASH_OK if no error.
  * 			- SPI_FLASH_E_TIMEOUT timeout reached.
  */
-static int spi_flash_wait_until_chip_ready(uint32_t ms);
+static int spi_flash_wait_until_chip_ready(spi_flash_busy_op_t op);
 /**
  * @brief Polled operation to program a SPI flash page.
  *
@@ -131,7 +321,16 @@ static int spi_flash_wait_until_chip_ready(uint32_t ms);
  */
 static int spi_flash_program_page(uint8_t * buffer, uint32_t address, uint16_t size);
 /**
- * @brief Polled operation to read SPI flash address.
+ * @brief Set quad enable bit in status register 2, needed by quad output read.
+ *
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ * 			- SPI_FLASH_E_TIMEOUT timeout reached.
+ */
+static int spi_flash_enable_quad(void);
+/**
+ * @brief Polled operation to read SPI flash address. The whole range is read in one transaction with the
+ * configured read mode.
  *
  * @param buffer Buffer.
  * @param address Address to read.
@@ -178,19 +377,225 @@ static int spi_flash_erase_chip(void);
 
 static void spi_flash_rx_it_hdle(void * spi_hdle, uint8_t * data, uint16_t size)
 {
-	/* Do nothing. We did not use SPI IT functions */
-	return;
+	if(spi_flash_async.step != SPI_FLASH_ASYNC_READ)
+		return;
+
+	int rt = SPI_FLASH_E_IO;
+	if(data != NULL)
+	{
+		spi_flash_async.done += spi_flash_async.chunk;
+		if(spi_flash_async.done == spi_flash_async.size)
+			rt = SPI_FLASH_OK;
+		else
+		{
+			/* Chip is still selected and streaming, keep reading */
+			rt = spi_flash_async_read_chunk();
+			if(rt == SPI_FLASH_OK)
+				return;
+		}
+	}
+	spi_flash_arch_deselect_cs();
+	spi_flash_async.result = rt;
+	spi_flash_async.step = SPI_FLASH_ASYNC_DONE;
 }
 
-static int spi_flash_send_advanced_command_receive(uint8_t * command, uint16_t command_size, uint8_t * response, uint16_t response_size)
+static void spi_flash_tx_it_hdle(void * spi_hdle, uint8_t * data, uint16_t size)
 {
-	spi_flash_arch_select_cs();
-	int rt = spi_flash_arch_write_spi(command, sizeof(command), SPI_FLASH_DEFAULT_WRITE_TIMEOUT);
-	rt |= spi_flash_arch_read_spi(response, response_size, SPI_FLASH_DEFAULT_READ_TIMEOUT);
+	if(spi_flash_async.step != SPI_FLASH_ASYNC_PAGE_TX)
+		return;
+
+	/* Page program starts when CS goes high */
 	spi_flash_arch_deselect_cs();
+	if(data == NULL)
+	{
+		spi_flash_async.result = SPI_FLASH_E_IO;
+		spi_flash_async.step = SPI_FLASH_ASYNC_DONE;
+		return;
+	}
+	spi_flash_async.done += spi_flash_async.chunk;
+	spi_flash_async.step = SPI_FLASH_ASYNC_PAGE_PROGRAM;
+}
+
+static int spi_flash_read_command_start(spi_flash_read_mode_t mode, uint32_t address)
+{
+	const spi_flash_read_mode_info_t * mode_info = &spi_flash_read_mode_info[mode];
+
+	/* Dummy bytes are sent as zeros right after the address */
+	uint8_t command[SPI_FLASH_COMMAND_AND_ADDRESS_SIZE + SPI_FLASH_READ_DUMMY_MAX_SIZE] = {0};
+	uint32_t command_address = (mode_info->command | SPI_FLASH_HTONL(address));
+	memcpy((void *)command, (void *)&command_address, sizeof(command_address));
+
+	spi_flash_arch_select_cs();
+	return spi_flash_arch_write_spi(command, SPI_FLASH_COMMAND_AND_ADDRESS_SIZE + mode_info->dummy_size, SPI_FLASH_DEFAULT_WRITE_TIMEOUT);
+}
+
+static int spi_flash_async_read_chunk(void)
+{
+	uint32_t remaining = spi_flash_async.size - spi_flash_async.done;
+	spi_flash_async.chunk = (remaining > SPI_FLASH_READ_CHUNK_SIZE)? SPI_FLASH_READ_CHUNK_SIZE : remaining;
+	return spi_flash_arch_read_dma_spi(spi_flash_async.buffer + spi_flash_async.done, spi_flash_async.chunk);
+}
+
+static int spi_flash_async_write_page(void)
+{
+	int rt = spi_flash_wait_until_chip_write_enable();
+	if(rt != SPI_FLASH_OK)
+		return rt;
+
+	uint32_t address = spi_flash_async.address + spi_flash_async.done;
+	uint32_t remaining = spi_flash_async.size - spi_flash_async.done;
+	/* Never cross a page boundary, the chip would wrap inside the page */
+	uint16_t to_write = SPI_FLASH_PAGE_SIZE - (address % SPI_FLASH_PAGE_SIZE);
+	if(to_write > remaining)
+		to_write = remaining;
+
+	uint32_t command_address = (API_SPI_FLASH_CMD_WRITE_PAGE | SPI_FLASH_HTONL(address));
+	spi_flash_arch_select_cs();
+	rt = spi_flash_arch_write_spi((uint8_t *)&command_address, sizeof(command_address), SPI_FLASH_DEFAULT_WRITE_TIMEOUT);
+	if(rt != SPI_FLASH_OK)
+	{
+		spi_flash_arch_deselect_cs();
+		return rt;
+	}
+
+	/* Data goes straight from user buffer, no intermediate copy */
+	spi_flash_async.chunk = to_write;
+	spi_flash_async.busy_op = SPI_FLASH_BUSY_PAGE_PROGRAM;
+	spi_flash_async.busy_start_cycles = profile_begin();
+	spi_flash_async.step = SPI_FLASH_ASYNC_PAGE_TX;
+	rt = spi_flash_arch_write_dma_spi(spi_flash_async.buffer + spi_flash_async.done, to_write);
+	if(rt != SPI_FLASH_OK)
+	{
+		spi_flash_async.step = SPI_FLASH_ASYNC_IDLE;
+		spi_flash_arch_deselect_cs();
+	}
 	return rt;
 }
 
+static int spi_flash_async_erase_unit(void)
+{
+	int rt = spi_flash_wait_until_chip_write_enable();
+	if(rt != SPI_FLASH_OK)
+		return rt;
+
+	uint32_t address = spi_flash_async.address + spi_flash_async.done;
+	uint32_t remaining = spi_flash_async.size - spi_flash_async.done;
+	uint8_t command = API_SPI_FLASH_CMD_DEL_SECTOR;
+	spi_flash_async.chunk = SPI_FLASH_SECTOR_SIZE;
+	spi_flash_async.busy_op = SPI_FLASH_BUSY_SECTOR_ERASE;
+	if(address % SPI_FLASH_BLOCK64_SIZE == 0 && remaining >= SPI_FLASH_BLOCK64_SIZE)
+	{
+		command = API_SPI_FLASH_CMD_DEL_64KB_BLOCK;
+		spi_flash_async.chunk = SPI_FLASH_BLOCK64_SIZE;
+		spi_flash_async.busy_op = SPI_FLASH_BUSY_BLOCK64_ERASE;
+	}
+	else if(address % SPI_FLASH_BLOCK32_SIZE == 0 && remaining >= SPI_FLASH_BLOCK32_SIZE)
+	{
+		command = API_SPI_FLASH_CMD_DEL_32KB_BLOCK;
+		spi_flash_async.chunk = SPI_FLASH_BLOCK32_SIZE;
+		spi_flash_async.busy_op = SPI_FLASH_BUSY_BLOCK32_ERASE;
+	}
+
+	uint32_t command_address = (command | SPI_FLASH_HTONL(address));
+	spi_flash_async.busy_start_cycles = profile_begin();
+	rt = spi_flash_send_advanced_command((uint8_t *)&command_address, sizeof(command_address));
+	if(rt != SPI_FLASH_OK)
+		return rt;
+
+	spi_flash_async.done += spi_flash_async.chunk;
+	spi_flash_async.step = SPI_FLASH_ASYNC_ERASE;
+	return SPI_FLASH_OK;
+}
+
+static int spi_flash_suspend(bool * suspended)
+{
+	int rt = spi_flash_send_basic_command(API_SPI_FLASH_CMD_SUSPEND);
+	if(rt != SPI_FLASH_OK)
+		return rt;
+
+	/* BUSY drops once suspended, or because the operation ended before the suspend took effect.
+	 * From here on a failure leaves the suspend state unknown, so resume anyway: a suspended chip
+	 * reads as not busy and the operation would be taken as done. Resume is ignored if not suspended */
+	rt = spi_flash_poll_status_reg_1(SPI_FLASH_BUSY_SUSPEND, API_SPI_FLASH_BSY_BIT, 0);
+	if(rt != SPI_FLASH_OK)
+	{
+		spi_flash_resume();
+		return rt;
+	}
+
+	uint8_t reg = 0;
+	rt = spi_flash_send_basic_command_receive(API_SPI_FLASH_CMD_READ_STATUS_REG_2, &reg, sizeof(reg));
+	if(rt != SPI_FLASH_OK)
+	{
+		spi_flash_resume();
+		return SPI_FLASH_E_IO;
+	}
+	*suspended = API_SPI_FLASH_SUS_IS_SET(reg);
+	return SPI_FLASH_OK;
+}
+
+static int spi_flash_resume(void)
+{
+	/* Time spent suspended does not count, the timeout starts over on next poll */
+	spi_flash_async.busy_started = false;
+	spi_flash_async.resumed = true;
+	spi_flash_async.resume_tick = port_delay_get_tick();
+	return spi_flash_send_basic_command(API_SPI_FLASH_CMD_RESUME);
+}
+
+static void spi_flash_async_finish(int result)
+{
+	spi_flash_async.busy_started = false;
+
+	spi_flash_state_t state = spi_flash_async.last_state;
+	if(result != SPI_FLASH_OK && spi_flash_async.modify)
+		state = SPI_FLASH_STATE_ERROR;
+	SPI_FLASH_SET_CHIP_STATE(state);
+
+	spi_flash_async.step = SPI_FLASH_ASYNC_IDLE;
+	if(spi_flash_async.cplt_cb != NULL)
+		spi_flash_async.cplt_cb(result, spi_flash_async.cplt_arg);
+}
+
+static int spi_flash_job_check(spi_flash_job_type_t type, uint8_t * buffer, uint32_t address, uint32_t size)
+{
+	if(type >= SPI_FLASH_JOB_MAX) return SPI_FLASH_E_PARAM;
+	if(type != SPI_FLASH_JOB_ERASE && buffer == NULL) return SPI_FLASH_E_NULL;
+	if(size == 0) return SPI_FLASH_E_PARAM;
+	if(type == SPI_FLASH_JOB_ERASE && (address % SPI_FLASH_SECTOR_SIZE != 0 || size % SPI_FLASH_SECTOR_SIZE != 0)) return SPI_FLASH_E_ADDRESS;
+	if(address > spi_flash_chip.chip_size || (address + size) > spi_flash_chip.chip_size) return SPI_FLASH_E_BOUNDARIES;
+	return SPI_FLASH_OK;
+}
+
+static void spi_flash_queue_run(void)
+{
+	while(spi_flash_queue.count && spi_flash_async.step == SPI_FLASH_ASYNC_IDLE && SPI_FLASH_GET_CHIP_STATE != SPI_FLASH_STATE_BUSY)
+	{
+		/* Job leaves the queue before its callback can submit new ones */
+		spi_flash_job_t job = spi_flash_queue.job[spi_flash_queue.tail];
+		spi_flash_queue.tail = (spi_flash_queue.tail + 1) % SPI_FLASH_QUEUE_SIZE;
+		spi_flash_queue.count--;
+
+		int rt = SPI_FLASH_E_PARAM;
+		switch(job.type)
+		{
+			case SPI_FLASH_JOB_READ:
+				rt = spi_flash_read_async(job.buffer, job.address, job.size, job.cplt_cb, job.cplt_arg);
+				break;
+			case SPI_FLASH_JOB_WRITE:
+				rt = spi_flash_write_async(job.buffer, job.address, job.size, job.cplt_cb, job.cplt_arg);
+				break;
+			case SPI_FLASH_JOB_ERASE:
+				rt = spi_flash_erase_async(job.address, job.size, job.cplt_cb, job.cplt_arg);
+				break;
+			default:
+				break;
+		}
+		if(rt != SPI_FLASH_OK && job.cplt_cb != NULL)
+			job.cplt_cb(rt, job.cplt_arg);
+	}
+}
+
 static int spi_flash_send_advanced_command(uint8_t * command, uint16_t command_size)
 {
 	spi_flash_arch_select_cs();
@@ -219,76 +624,86 @@ static int spi_flash_send_basic_command(uint8_t command)
 
 static int spi_flash_get_status_reg_1(uint8_t * reg)
 {
-	int rt = spi_flash_send_basic_command_receive(API_SPI_FLASH_CMD_READ_STATUS_REG_1, reg, sizeof(*reg));
-	uint8_t reg2 = 0, reg3 = 0;
-	spi_flash_send_basic_command_receive(API_SPI_FLASH_CMD_READ_STATUS_REG_2, &reg2, sizeof(*reg));
-	spi_flash_send_basic_command_receive(API_SPI_FLASH_CMD_READ_STATUS_REG_3, &reg3, sizeof(*reg));
-
-	return rt;
+	return spi_flash_send_basic_command_receive(API_SPI_FLASH_CMD_READ_STATUS_REG_1, reg, sizeof(*reg));
 }
 
-static int spi_flash_wait_until_chip_write_enable(void)
+static void spi_flash_busy_stats_add(spi_flash_busy_op_t op, uint32_t poll_nbr, uint32_t busy_ms, uint32_t start_cycles)
 {
-	uint8_t reg = 0;
-	int rt = spi_flash_send_basic_command(API_SPI_FLASH_CMD_WRITE_EN);
-	if(rt != SPI_FLASH_OK)
-		return rt;
-
-	port_delay_hdle delay_hdle = port_delay_init(SPI_FLASH_WRITE_STATUS_MAX_TIMEOUT);
-	if(delay_hdle == NULL)
-		return SPI_FLASH_E_MEM;
+	spi_flash_busy_stats_t * stats = &spi_flash_busy_stats[op];
+	stats->op_nbr++;
+	stats->poll_nbr += poll_nbr;
+	stats->busy_ms += busy_ms;
+	if(busy_ms > stats->busy_max_ms)
+		stats->busy_max_ms = busy_ms;
+
+	if(op == SPI_FLASH_BUSY_PAGE_PROGRAM)
+		profile_end(PROFILE_SPAN_SPI_FLASH_PROGRAM, 0, start_cycles);
+	else if(op >= SPI_FLASH_BUSY_SECTOR_ERASE && op <= SPI_FLASH_BUSY_CHIP_ERASE)
+		profile_end(PROFILE_SPAN_SPI_FLASH_ERASE, op, start_cycles);
+}
 
-	bool timeout = false;
-	while((timeout = port_delay_read(delay_hdle)) == false)
+static int spi_flash_poll_status_reg_1(spi_flash_busy_op_t op, uint8_t mask, uint8_t value)
+{
+	const spi_flash_busy_time_t * time = &spi_flash_busy_time[op];
+	uint32_t start = port_delay_get_tick();
+	uint32_t start_cycles = profile_begin();
+	uint32_t poll_nbr = 0;
+	uint32_t interval = 0;
+	uint32_t interval_max = time->typical_ms / SPI_FLASH_POLL_INTERVAL_DIVIDER;
+
+	uint8_t command = API_SPI_FLASH_CMD_READ_STATUS_REG_1;
+	spi_flash_arch_select_cs();
+	int rt = spi_flash_arch_write_spi(&command, sizeof(command), SPI_FLASH_DEFAULT_WRITE_TIMEOUT);
+	if(rt == SPI_FLASH_OK && time->typical_ms >= SPI_FLASH_POLL_BACKOFF_MIN_TYP_TIME)
 	{
-		rt = spi_flash_get_status_reg_1(&reg);
+		spi_flash_arch_block_delay(time->typical_ms / 2);
+		interval = 1;
+	}
 
-		if(rt != SPI_FLASH_OK)
+	while(rt == SPI_FLASH_OK)
+	{
+		/* Deadline is sampled before the status, so a late poll still gets a fresh read before timing out */
+		bool expired = (port_delay_get_tick() - start) > time->max_ms;
+		uint8_t reg = 0;
+		poll_nbr++;
+		if(spi_flash_arch_read_spi(&reg, sizeof(reg), SPI_FLASH_DEFAULT_READ_TIMEOUT) != SPI_FLASH_OK)
 		{
 			rt = SPI_FLASH_E_IO;
 			break;
 		}
-
-		if(API_SPI_FLASH_WEL_IS_SET(reg))
+		if((reg & mask) == value)
 			break;
-	}
-	port_delay_deinit(&delay_hdle);
+		if(expired)
+		{
+			rt = SPI_FLASH_E_TIMEOUT;
+			break;
+		}
 
-	if(timeout)
-		rt = SPI_FLASH_E_TIMEOUT;
+		if(interval)
+		{
+			spi_flash_arch_block_delay(interval);
+			if(interval * 2 <= interval_max)
+				interval *= 2;
+		}
+	}
+	spi_flash_arch_deselect_cs();
 
+	spi_flash_busy_stats_add(op, poll_nbr, port_delay_get_tick() - start, start_cycles);
 	return rt;
 }
 
-static int spi_flash_wait_until_chip_ready(uint32_t ms)
+static int spi_flash_wait_until_chip_write_enable(void)
 {
-	uint8_t reg = 0;
-	int rt = SPI_FLASH_OK;
-
-	port_delay_hdle delay_hdle = port_delay_init(ms);
-	if(delay_hdle == NULL)
-		return SPI_FLASH_E_MEM;
-
-	bool timeout = false;
-	while((timeout = port_delay_read(delay_hdle)) == false)
-	{
-		rt = spi_flash_get_status_reg_1(&reg);
-
-		if(rt != SPI_FLASH_OK)
-		{
-			rt = SPI_FLASH_E_IO;
-			break;
-		}
-
-		if(!API_SPI_FLASH_WEL_IS_SET(reg) && !API_SPI_FLASH_BSY_IS_SET(reg))
-			break;
-	}
-	port_delay_deinit(&delay_hdle);
+	int rt = spi_flash_send_basic_command(API_SPI_FLASH_CMD_WRITE_EN);
+	if(rt != SPI_FLASH_OK)
+		return rt;
 
-	if(timeout)
-		rt = SPI_FLASH_E_TIMEOUT;
+	return spi_flash_poll_status_reg_1(SPI_FLASH_BUSY_WRITE_ENABLE, API_SPI_FLASH_WEL_BIT, API_SPI_FLASH_WEL_BIT);
+}
 
-	return rt;
+static int spi_flash_wait_until_chip_ready(spi_flash_busy_op_t op)
+{
+	return spi_flash_poll_status_reg_1(op, API_SPI_FLASH_WEL_BIT | API_SPI_FLASH_BSY_BIT, 0);
 }
 
 static int spi_flash_program_page(uint8_t * buffer, uint32_t address, uint16_t size)
@@ -305,13 +720,48 @@ static int spi_flash_program_page(uint8_t * buffer, uint32_t address, uint16_t s
 	if(rt != SPI_FLASH_OK)
 		return rt;
 
-	return spi_flash_wait_until_chip_ready(SPI_FLASH_PROGRAM_PAGE_MAX_TIMEOUT);
+	return spi_flash_wait_until_chip_ready(SPI_FLASH_BUSY_PAGE_PROGRAM);
+}
+
+static int spi_flash_enable_quad(void)
+{
+	uint8_t reg = 0;
+	int rt = spi_flash_send_basic_command_receive(API_SPI_FLASH_CMD_READ_STATUS_REG_2, &reg, sizeof(reg));
+	if(rt != SPI_FLASH_OK)
+		return rt;
+	if(API_SPI_FLASH_QE_IS_SET(reg))
+		return SPI_FLASH_OK;
+
+	rt = spi_flash_wait_until_chip_write_enable();
+	if(rt != SPI_FLASH_OK)
+		return rt;
+
+	uint8_t command[] = {API_SPI_FLASH_CMD_WRITE_STATUS_REG_2, reg | API_SPI_FLASH_QE_BIT};
+	rt = spi_flash_send_advanced_command(command, sizeof(command));
+	if(rt != SPI_FLASH_OK)
+		return rt;
+
+	return spi_flash_wait_until_chip_ready(SPI_FLASH_BUSY_WRITE_STATUS);
 }
 
 static int spi_flash_read_address(uint8_t * buffer, uint32_t address, uint32_t size)
 {
-	uint32_t command_address = (API_SPI_FLASH_CMD_READ_DATA | SPI_FLASH_HTONL(address));
-	return spi_flash_send_advanced_command_receive((uint8_t *)&command_address, sizeof(command_address), buffer, size);
+	const spi_flash_read_mode_info_t * mode = &spi_flash_read_mode_info[spi_flash_chip.read_mode];
+	int rt = spi_flash_read_command_start(spi_flash_chip.read_mode, address);
+
+	/* The chip keeps streaming sequential addresses while CS is low, so one command serves the whole range */
+	uint32_t read = 0;
+	while(rt == SPI_FLASH_OK && read < size)
+	{
+		uint16_t to_read = ((size - read) > SPI_FLASH_READ_CHUNK_SIZE)? SPI_FLASH_READ_CHUNK_SIZE : (size - read);
+		if(mode->lines == 1)
+			rt = spi_flash_arch_read_spi(buffer + read, to_read, SPI_FLASH_READ_CHUNK_TIMEOUT);
+		else
+			rt = spi_flash_arch_read_spi_lines(buffer + read, to_read, mode->lines, SPI_FLASH_READ_CHUNK_TIMEOUT);
+		read += to_read;
+	}
+	spi_flash_arch_deselect_cs();
+	return rt;
 }
 
 static int spi_flash_erase_sector(uint32_t address)
@@ -321,7 +771,7 @@ static int spi_flash_erase_sector(uint32_t address)
 	if(rt != SPI_FLASH_OK)
 		return rt;
 
-	return spi_flash_wait_until_chip_ready(SPI_FLASH_SECTOR_ERASE_MAX_TIMEOUT);
+	return spi_flash_wait_until_chip_ready(SPI_FLASH_BUSY_SECTOR_ERASE);
 }
 
 static int spi_flash_erase_block32(uint32_t address)
@@ -331,7 +781,7 @@ static int spi_flash_erase_block32(uint32_t address)
 	if(rt != SPI_FLASH_OK)
 		return rt;
 
-	return spi_flash_wait_until_chip_ready(SPI_FLASH_BLOCK32_ERASE_MAX_TIMEOUT);
+	return spi_flash_wait_until_chip_ready(SPI_FLASH_BUSY_BLOCK32_ERASE);
 }
 
 static int spi_flash_erase_block64(uint32_t address)
@@ -341,7 +791,7 @@ static int spi_flash_erase_block64(uint32_t address)
 	if(rt != SPI_FLASH_OK)
 		return rt;
 
-	return spi_flash_wait_until_chip_ready(SPI_FLASH_BLOCK64_ERASE_MAX_TIMEOUT);
+	return spi_flash_wait_until_chip_ready(SPI_FLASH_BUSY_BLOCK64_ERASE);
 }
 
 static int spi_flash_erase_chip(void)
@@ -350,7 +800,7 @@ static int spi_flash_erase_chip(void)
 	if(rt != SPI_FLASH_OK)
 		return rt;
 
-	return spi_flash_wait_until_chip_ready(SPI_FLASH_CHIP_ERASE_MAX_TIMEOUT);
+	return spi_flash_wait_until_chip_ready(SPI_FLASH_BUSY_CHIP_ERASE);
 }
 
 int spi_flash_init(spi_if_hdle spi_if_hdle, spi_flash_cs_t cs_gpio)
@@ -358,7 +808,7 @@ int spi_flash_init(spi_if_hdle spi_if_hdle, spi_flash_cs_t cs_gpio)
 	int rt  = SPI_FLASH_E_IO;
 	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_DISABLE)
 	{
-		rt = spi_flash_arch_init_spi(spi_if_hdle, spi_flash_rx_it_hdle);
+		rt = spi_flash_arch_init_spi(spi_if_hdle, spi_flash_rx_it_hdle, spi_flash_tx_it_hdle);
 		if(rt != SPI_FLASH_ARCH_OK) return SPI_FLASH_E_ARCH;
 		rt = spi_flash_arch_init_cs(cs_gpio.port, cs_gpio.pin);
 		if(rt != SPI_FLASH_ARCH_OK) return SPI_FLASH_E_ARCH;
@@ -408,6 +858,11 @@ int spi_flash_init(spi_if_hdle spi_if_hdle, spi_flash_cs_t cs_gpio)
 		spi_flash_chip.chip_type = jedec_id.memory_type;
 		spi_flash_chip.chip_size = (1 << jedec_id.memory_capacity);
 
+		/* Fast read works at any clock the chip supports. Dual/quad need explicit selection */
+		spi_flash_chip.read_mode = SPI_FLASH_READ_MODE_SINGLE;
+		if(spi_flash_arch_get_read_modes() & SPI_FLASH_READ_MODE_BIT(SPI_FLASH_READ_MODE_FAST))
+			spi_flash_chip.read_mode = SPI_FLASH_READ_MODE_FAST;
+
 		SPI_FLASH_SET_CHIP_STATE(SPI_FLASH_STATE_READY);
 	}
 
@@ -423,34 +878,44 @@ int spi_flash_read(uint8_t * buffer, uint32_t address, uint32_t size)
 		return SPI_FLASH_E_READY;
 	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_ERROR)
 		return SPI_FLASH_E_FAIL;
-	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_BUSY)
-		return SPI_FLASH_E_BUSY;
 
 	if(buffer == 0) return SPI_FLASH_E_NULL;
 	if(size == 0) return SPI_FLASH_OK;
 	if(address > spi_flash_chip.chip_size || (address + size) > spi_flash_chip.chip_size) return SPI_FLASH_E_BOUNDARIES;
 
+	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_BUSY)
+	{
+		/* Only the array operation can be suspended, not an ongoing DMA transfer */
+		spi_flash_async_step_t step = spi_flash_async.step;
+		if(step != SPI_FLASH_ASYNC_PAGE_PROGRAM && step != SPI_FLASH_ASYNC_ERASE)
+			return SPI_FLASH_E_BUSY;
+
+		/* Data under the suspended page or sector is undefined until the operation resumes and ends */
+		uint32_t busy_address = spi_flash_async.address + spi_flash_async.done - spi_flash_async.chunk;
+		if(address < busy_address + spi_flash_async.chunk && busy_address < address + size)
+			return SPI_FLASH_E_ADDRESS;
+
+		/* Chip ignores a suspend too close to the previous resume. Back to back reads could also keep
+		 * an erase suspended for good */
+		if(spi_flash_async.resumed && (port_delay_get_tick() - spi_flash_async.resume_tick) < SPI_FLASH_RESUME_HOLD_TIME)
+			return SPI_FLASH_E_BUSY;
+
+		bool suspended = false;
+		int rt = spi_flash_suspend(&suspended);
+		if(rt != SPI_FLASH_OK)
+			return rt;
+		rt = spi_flash_read_address(buffer, address, size);
+		if(suspended)
+			rt |= spi_flash_resume();
+		return rt;
+	}
+
 	/* Save our last 'allowed' state for this operation */
 	spi_flash_state_t last_state = SPI_FLASH_GET_CHIP_STATE;
 	SPI_FLASH_SET_CHIP_STATE(SPI_FLASH_STATE_BUSY);
-	size_t read = 0;
-	size_t remaining = size;
-	while(remaining)
-	{
-		/* We are going to read sector by sector if possible to be sure the chip will respond faster the read command.
-		 * If we try to read a lot, maybe the default time for read operation would not be enough*/
-		size_t to_read = (remaining > SPI_FLASH_SECTOR_SIZE)? SPI_FLASH_SECTOR_SIZE : remaining;
-		int err = spi_flash_read_address(buffer, address + read, to_read);
-		if(err != SPI_FLASH_OK)
-		{
-			SPI_FLASH_SET_CHIP_STATE(last_state);
-			return err;
-		}
-		read += to_read;
-		remaining -= to_read;
-	}
+	int err = spi_flash_read_address(buffer, address, size);
 	SPI_FLASH_SET_CHIP_STATE(last_state);
-	return SPI_FLASH_OK;
+	return err;
 }
 
 int spi_flash_write(uint8_t * buffer, uint32_t address, uint32_t size)
@@ -476,7 +941,7 @@ int spi_flash_write(uint8_t * buffer, uint32_t address, uint32_t size)
 	{
 		rt = spi_flash_wait_until_chip_write_enable();
 		if(rt != SPI_FLASH_OK)
-			return rt;
+			break;
 
 		size_t to_write = SPI_FLASH_PAGE_SIZE;
 		if((address + wrote)%SPI_FLASH_PAGE_SIZE != 0)
@@ -494,16 +959,14 @@ int spi_flash_write(uint8_t * buffer, uint32_t address, uint32_t size)
 		if(to_write > remaining)
 			to_write = remaining;
 
-		int rt = spi_flash_program_page(buffer + wrote, address + wrote, to_write);
+		rt = spi_flash_program_page(buffer + wrote, address + wrote, to_write);
 		if(rt != SPI_FLASH_OK)
-		{
-			SPI_FLASH_SET_CHIP_STATE(SPI_FLASH_STATE_ERROR);
-			return rt;
-		}
+			break;
 		wrote += to_write;
 		remaining -= to_write;
 	}
-	SPI_FLASH_SET_CHIP_STATE(SPI_FLASH_STATE_READY);
+	/* Any failure, write enable included, may leave the chip busy. Never leave it in BUSY state */
+	SPI_FLASH_SET_CHIP_STATE((rt == SPI_FLASH_OK)? SPI_FLASH_STATE_READY : SPI_FLASH_STATE_ERROR);
 	return rt;
 }
 
@@ -532,7 +995,7 @@ int spi_flash_erase_range(size_t address, uint32_t size)
 	{
 		rt = spi_flash_wait_until_chip_write_enable();
 		if(rt != SPI_FLASH_OK)
-			return rt;
+			break;
 
 		/* If the address is the beginning and the size is the total of the chip, delete everything.*/
 		if(address == 0 && size == spi_flash_chip.chip_size)
@@ -577,6 +1040,261 @@ int spi_flash_erase_range(size_t address, uint32_t size)
 				break;
 		}
 	}
-	SPI_FLASH_SET_CHIP_STATE(SPI_FLASH_STATE_READY);
+	/* A failed erase or write enable may leave the chip busy, like a failed write */
+	SPI_FLASH_SET_CHIP_STATE((rt == SPI_FLASH_OK)? SPI_FLASH_STATE_READY : SPI_FLASH_STATE_ERROR);
+	return rt;
+}
+
+int spi_flash_read_async(uint8_t * buffer, uint32_t address, uint32_t size, spi_flash_cplt_cb cplt_cb, void * arg)
+{
+	if(SPI_FLASH_GET_CHIP_STATE < SPI_FLASH_STATE_READY)
+		return SPI_FLASH_E_READY;
+	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_ERROR)
+		return SPI_FLASH_E_FAIL;
+	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_BUSY)
+		return SPI_FLASH_E_BUSY;
+
+	int rt = spi_flash_job_check(SPI_FLASH_JOB_READ, buffer, address, size);
+	if(rt != SPI_FLASH_OK)
+		return rt;
+
+	/* DMA data phase is single line. Dual/quad opcodes would put data on lines we do not read */
+	spi_flash_read_mode_t mode = spi_flash_chip.read_mode;
+	if(spi_flash_read_mode_info[mode].lines != 1)
+		mode = SPI_FLASH_READ_MODE_FAST;
+
+	spi_flash_async.buffer = buffer;
+	spi_flash_async.address = address;
+	spi_flash_async.size = size;
+	spi_flash_async.done = 0;
+	spi_flash_async.cplt_cb = cplt_cb;
+	spi_flash_async.cplt_arg = arg;
+	spi_flash_async.last_state = SPI_FLASH_GET_CHIP_STATE;
+	spi_flash_async.modify = false;
+	SPI_FLASH_SET_CHIP_STATE(SPI_FLASH_STATE_BUSY);
+
+	rt = spi_flash_read_command_start(mode, address);
+	if(rt == SPI_FLASH_OK)
+	{
+		spi_flash_async.step = SPI_FLASH_ASYNC_READ;
+		rt = spi_flash_async_read_chunk();
+	}
+
+	if(rt != SPI_FLASH_OK)
+	{
+		spi_flash_async.step = SPI_FLASH_ASYNC_IDLE;
+		spi_flash_arch_deselect_cs();
+		SPI_FLASH_SET_CHIP_STATE(spi_flash_async.last_state);
+	}
 	return rt;
 }
+
+int spi_flash_write_async(uint8_t * buffer, uint32_t address, uint32_t size, spi_flash_cplt_cb cplt_cb, void * arg)
+{
+	if(SPI_FLASH_GET_CHIP_STATE < SPI_FLASH_STATE_READY)
+		return SPI_FLASH_E_READY;
+	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_ERROR)
+		return SPI_FLASH_E_FAIL;
+	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_BUSY)
+		return SPI_FLASH_E_BUSY;
+
+	int rt = spi_flash_job_check(SPI_FLASH_JOB_WRITE, buffer, address, size);
+	if(rt != SPI_FLASH_OK)
+		return rt;
+
+	spi_flash_async.buffer = buffer;
+	spi_flash_async.address = address;
+	spi_flash_async.size = size;
+	spi_flash_async.done = 0;
+	spi_flash_async.cplt_cb = cplt_cb;
+	spi_flash_async.cplt_arg = arg;
+	spi_flash_async.last_state = SPI_FLASH_GET_CHIP_STATE;
+	spi_flash_async.modify = true;
+	SPI_FLASH_SET_CHIP_STATE(SPI_FLASH_STATE_BUSY);
+
+	rt = spi_flash_async_write_page();
+	if(rt != SPI_FLASH_OK)
+		SPI_FLASH_SET_CHIP_STATE(spi_flash_async.last_state);
+	return rt;
+}
+
+int spi_flash_erase_async(uint32_t address, uint32_t size, spi_flash_cplt_cb cplt_cb, void * arg)
+{
+	if(SPI_FLASH_GET_CHIP_STATE < SPI_FLASH_STATE_READY)
+		return SPI_FLASH_E_READY;
+	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_ERROR)
+		return SPI_FLASH_E_FAIL;
+	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_BUSY)
+		return SPI_FLASH_E_BUSY;
+
+	int rt = spi_flash_job_check(SPI_FLASH_JOB_ERASE, NULL, address, size);
+	if(rt != SPI_FLASH_OK)
+		return rt;
+
+	spi_flash_async.buffer = NULL;
+	spi_flash_async.address = address;
+	spi_flash_async.size = size;
+	spi_flash_async.done = 0;
+	spi_flash_async.cplt_cb = cplt_cb;
+	spi_flash_async.cplt_arg = arg;
+	spi_flash_async.last_state = SPI_FLASH_GET_CHIP_STATE;
+	spi_flash_async.modify = true;
+	SPI_FLASH_SET_CHIP_STATE(SPI_FLASH_STATE_BUSY);
+
+	rt = spi_flash_async_erase_unit();
+	if(rt != SPI_FLASH_OK)
+		SPI_FLASH_SET_CHIP_STATE(spi_flash_async.last_state);
+	return rt;
+}
+
+int spi_flash_submit(spi_flash_job_type_t type, uint8_t * buffer, uint32_t address, uint32_t size, spi_flash_cplt_cb cplt_cb, void * arg)
+{
+	if(SPI_FLASH_GET_CHIP_STATE < SPI_FLASH_STATE_READY)
+		return SPI_FLASH_E_READY;
+	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_ERROR)
+		return SPI_FLASH_E_FAIL;
+
+	int rt = spi_flash_job_check(type, buffer, address, size);
+	if(rt != SPI_FLASH_OK)
+		return rt;
+	if(spi_flash_queue.count == SPI_FLASH_QUEUE_SIZE)
+		return SPI_FLASH_E_BUSY;
+
+	spi_flash_job_t * job = &spi_flash_queue.job[spi_flash_queue.head];
+	job->type = type;
+	job->buffer = buffer;
+	job->address = address;
+	job->size = size;
+	job->cplt_cb = cplt_cb;
+	job->cplt_arg = arg;
+	spi_flash_queue.head = (spi_flash_queue.head + 1) % SPI_FLASH_QUEUE_SIZE;
+	spi_flash_queue.count++;
+
+	/* Chip is not kept idle waiting for next spi_flash_process */
+	spi_flash_queue_run();
+	return SPI_FLASH_OK;
+}
+
+int spi_flash_process(void)
+{
+	switch(spi_flash_async.step)
+	{
+		case SPI_FLASH_ASYNC_IDLE:
+		{
+			return SPI_FLASH_OK;
+		}
+		case SPI_FLASH_ASYNC_PAGE_PROGRAM:
+		case SPI_FLASH_ASYNC_ERASE:
+		{
+			const spi_flash_busy_time_t * time = &spi_flash_busy_time[spi_flash_async.busy_op];
+			uint32_t tick = port_delay_get_tick();
+			if(!spi_flash_async.busy_started)
+			{
+				/* Same hold off and back off as blocking waits, the superloop does not pay SPI transactions for nothing */
+				spi_flash_async.busy_started = true;
+				spi_flash_async.busy_start_tick = tick;
+				spi_flash_async.busy_poll_nbr = 0;
+				spi_flash_async.busy_poll_ms = 0;
+				spi_flash_async.busy_interval = 0;
+				if(time->typical_ms >= SPI_FLASH_POLL_BACKOFF_MIN_TYP_TIME)
+				{
+					spi_flash_async.busy_poll_ms = time->typical_ms / 2;
+					spi_flash_async.busy_interval = 1;
+				}
+			}
+
+			uint32_t elapsed = tick - spi_flash_async.busy_start_tick;
+			if(elapsed < spi_flash_async.busy_poll_ms)
+				break;
+
+			/* Deadline is sampled before the status, so a late poll still gets a fresh read before timing out */
+			bool expired = elapsed > time->max_ms;
+			uint8_t reg = 0;
+			spi_flash_async.busy_poll_nbr++;
+			if(spi_flash_get_status_reg_1(&reg) != SPI_FLASH_OK)
+			{
+				spi_flash_async_finish(SPI_FLASH_E_IO);
+				break;
+			}
+
+			if(API_SPI_FLASH_WEL_IS_SET(reg) || API_SPI_FLASH_BSY_IS_SET(reg))
+			{
+				if(expired)
+				{
+					/* Completion callback may have started the next job already */
+					spi_flash_async_finish(SPI_FLASH_E_TIMEOUT);
+					break;
+				}
+				spi_flash_async.busy_poll_ms = elapsed + spi_flash_async.busy_interval;
+				if(spi_flash_async.busy_interval && spi_flash_async.busy_interval * 2 <= time->typical_ms / SPI_FLASH_POLL_INTERVAL_DIVIDER)
+					spi_flash_async.busy_interval *= 2;
+				break;
+			}
+
+			spi_flash_async.busy_started = false;
+			spi_flash_busy_stats_add(spi_flash_async.busy_op, spi_flash_async.busy_poll_nbr, elapsed, spi_flash_async.busy_start_cycles);
+			if(spi_flash_async.done == spi_flash_async.size)
+			{
+				spi_flash_async_finish(SPI_FLASH_OK);
+				break;
+			}
+
+			int rt = (spi_flash_async.step == SPI_FLASH_ASYNC_ERASE)? spi_flash_async_erase_unit() : spi_flash_async_write_page();
+			if(rt != SPI_FLASH_OK)
+				spi_flash_async_finish(rt);
+			break;
+		}
+		case SPI_FLASH_ASYNC_DONE:
+		{
+			spi_flash_async_finish(spi_flash_async.result);
+			break;
+		}
+		default:
+		{
+			/* DMA transfer in flight */
+			break;
+		}
+	}
+	spi_flash_queue_run();
+	return (spi_flash_async.step == SPI_FLASH_ASYNC_IDLE && spi_flash_queue.count == 0)? SPI_FLASH_OK : SPI_FLASH_E_BUSY;
+}
+
+int spi_flash_get_busy_stats(spi_flash_busy_op_t op, spi_flash_busy_stats_t * stats)
+{
+	if(stats == NULL) return SPI_FLASH_E_NULL;
+	if(op >= SPI_FLASH_BUSY_MAX) return SPI_FLASH_E_PARAM;
+
+	*stats = spi_flash_busy_stats[op];
+	return SPI_FLASH_OK;
+}
+
+void spi_flash_reset_busy_stats(void)
+{
+	memset(spi_flash_busy_stats, 0, sizeof(spi_flash_busy_stats));
+}
+
+int spi_flash_set_read_mode(spi_flash_read_mode_t mode)
+{
+	if(SPI_FLASH_GET_CHIP_STATE < SPI_FLASH_STATE_READY)
+		return SPI_FLASH_E_READY;
+	if(SPI_FLASH_GET_CHIP_STATE == SPI_FLASH_STATE_BUSY)
+		return SPI_FLASH_E_BUSY;
+
+	if(mode >= SPI_FLASH_READ_MODE_MAX) return SPI_FLASH_E_PARAM;
+	if((spi_flash_arch_get_read_modes() & SPI_FLASH_READ_MODE_BIT(mode)) == 0) return SPI_FLASH_E_PARAM;
+
+	if(mode == SPI_FLASH_READ_MODE_QUAD_OUTPUT)
+	{
+		int rt = spi_flash_enable_quad();
+		if(rt != SPI_FLASH_OK)
+			return rt;
+	}
+
+	spi_flash_chip.read_mode = mode;
+	return SPI_FLASH_OK;
+}
+
+spi_flash_read_mode_t spi_flash_get_read_mode(void)
+{
+	return spi_flash_chip.read_mode;
+}
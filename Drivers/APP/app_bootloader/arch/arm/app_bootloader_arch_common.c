@@ -0,0 +1,217 @@
+/*
+ * app_bootloader_arch_common.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+#include <string.h>
+#include "stm32f4xx_hal.h"
+#include "main.h"
+
+#include "app_bootloader_arch_common.h"
+#include "app_bootloader_crc.h"
+
+#include "API_log.h"
+#define tag "app_bootloader_arch"
+#define print_serial_info(format, ...) LOG_LEVEL(LOG_INFO, tag, format, ##__VA_ARGS__)
+#define print_serial_warn(format, ...) LOG_LEVEL(LOG_WARN, tag, format, ##__VA_ARGS__)
+
+#define APP_BOOTLOADER_ARCH_FLASH_TIMEOUT (50) /* ms, word program is 16 us typical */
+#define APP_BOOTLOADER_ARCH_FLASH_SR_ERRORS (FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR)
+
+#if APP_BOOTLOADER_FLASH_WORD_SIZE == 8
+#define APP_BOOTLOADER_ARCH_FLASH_PSIZE FLASH_PSIZE_DOUBLE_WORD
+#else
+#define APP_BOOTLOADER_ARCH_FLASH_PSIZE FLASH_PSIZE_WORD
+#endif
+
+/* Set to 0 to give the application the reset clock tree, HSI at 16 MHz. PLL is left running otherwise */
+#define APP_BOOTLOADER_ARCH_HANDOFF_KEEP_CLOCKS (1)
+
+typedef void (*jump_function)(void);
+
+/**
+ * @brief Put peripherals used by the bootloader back in their reset state, clock gated: console and log
+ * USARTs, SPI flash, their DMA controllers and the CRC unit.
+ *
+ */
+static void app_bootloader_arch_teardown(void);
+
+static void app_bootloader_arch_teardown(void)
+{
+	__HAL_RCC_USART2_FORCE_RESET();
+	__HAL_RCC_USART3_FORCE_RESET();
+	__HAL_RCC_SPI1_FORCE_RESET();
+	__HAL_RCC_DMA1_FORCE_RESET();
+	__HAL_RCC_DMA2_FORCE_RESET();
+	__HAL_RCC_CRC_FORCE_RESET();
+
+	__HAL_RCC_USART2_RELEASE_RESET();
+	__HAL_RCC_USART3_RELEASE_RESET();
+	__HAL_RCC_SPI1_RELEASE_RESET();
+	__HAL_RCC_DMA1_RELEASE_RESET();
+	__HAL_RCC_DMA2_RELEASE_RESET();
+	__HAL_RCC_CRC_RELEASE_RESET();
+
+	__HAL_RCC_USART2_CLK_DISABLE();
+	__HAL_RCC_USART3_CLK_DISABLE();
+	__HAL_RCC_SPI1_CLK_DISABLE();
+	__HAL_RCC_DMA1_CLK_DISABLE();
+	__HAL_RCC_DMA2_CLK_DISABLE();
+	__HAL_RCC_CRC_CLK_DISABLE();
+}
+
+void app_bootloader_arch_boot(uint32_t boot_address)
+{
+	uint32_t stack_pointer = *(volatile uint32_t *)boot_address;
+	if((stack_pointer & (0x2FF00000)) != 0x20000000)
+	{
+		print_serial_warn("No application found in 0x%x", boot_address);
+		return;
+	}
+	jump_function jump_to_app = (jump_function)*((volatile uint32_t *)(boot_address + 4));
+	print_serial_info("Application found! Jumping in 0x%x", boot_address);
+
+	/* Last log is out, USART3 goes now */
+	app_bootloader_arch_teardown();
+
+	app_bootloader_handoff_t * handoff = app_bootloader_arch_handoff();
+#if APP_BOOTLOADER_ARCH_HANDOFF_KEEP_CLOCKS
+	handoff->flag |= APP_BOOTLOADER_HANDOFF_FLAG_CLOCKS;
+#else
+	/* Needs SysTick for its timeouts, done before it stops */
+	HAL_RCC_DeInit();
+#endif
+	handoff->sysclk_hz = HAL_RCC_GetSysClockFreq();
+
+	/* Nothing of ours may fire once the application owns the vector table */
+	__disable_irq();
+	SysTick->CTRL = 0;
+	SysTick->LOAD = 0;
+	SysTick->VAL = 0;
+	SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+	for(uint8_t i = 0; i < sizeof(NVIC->ICER) / sizeof(NVIC->ICER[0]); i++)
+	{
+		NVIC->ICER[i] = 0xFFFFFFFF;
+		NVIC->ICPR[i] = 0xFFFFFFFF;
+	}
+
+	SCB->VTOR = boot_address;
+	__DSB();
+	__ISB();
+
+	/* Application starts as from reset, interrupts enabled at core level */
+	__set_MSP(stack_pointer);
+	__enable_irq();
+	jump_to_app();
+}
+
+app_bootloader_handoff_t * app_bootloader_arch_handoff(void)
+{
+	return (app_bootloader_handoff_t *)APP_BOOTLOADER_HANDOFF_ADDR;
+}
+
+bool app_bootloader_arch_boot_strap(void)
+{
+	/* User button held at reset. Board pulls it down, pressed reads high */
+	return HAL_GPIO_ReadPin(USER_Btn_GPIO_Port, USER_Btn_Pin) == GPIO_PIN_SET;
+}
+
+uint8_t * app_bootloader_arch_ram_app_map(uint32_t address, uint32_t size)
+{
+	if(address < APP_BOOTLOADER_RAM_APP_BASE || size > APP_BOOTLOADER_RAM_APP_SIZE
+			|| address - APP_BOOTLOADER_RAM_APP_BASE > APP_BOOTLOADER_RAM_APP_SIZE - size)
+		return NULL;
+	/* Region is reserved in the linker script, nothing of the bootloader lives there */
+	return (uint8_t *)address;
+}
+
+void app_bootloader_arch_flash_unlock(void)
+{
+	HAL_FLASH_Unlock();
+}
+
+void app_bootloader_arch_flash_lock(void)
+{
+	HAL_FLASH_Lock();
+}
+
+int app_bootloader_arch_flash_program_byte(uint32_t address, uint8_t data)
+{
+	return (HAL_FLASH_Program(FLASH_TYPEPROGRAM_BYTE, address, data) == HAL_OK)? APP_BOOTLOADER_ARCH_OK : APP_BOOTLOADER_ARCH_E_FAIL;
+}
+
+int app_bootloader_arch_flash_program_words(uint32_t address, const uint8_t * data, uint32_t word_nbr)
+{
+	int rt = APP_BOOTLOADER_ARCH_OK;
+	if(FLASH_WaitForLastOperation(APP_BOOTLOADER_ARCH_FLASH_TIMEOUT) != HAL_OK)
+		return APP_BOOTLOADER_ARCH_E_FAIL;
+
+	/* PG bit is kept set for the whole run instead of once per word */
+	CLEAR_BIT(FLASH->CR, FLASH_CR_PSIZE);
+	FLASH->CR |= APP_BOOTLOADER_ARCH_FLASH_PSIZE;
+	FLASH->CR |= FLASH_CR_PG;
+
+	for(uint32_t i = 0; i < word_nbr; i++)
+	{
+		uint32_t word[APP_BOOTLOADER_FLASH_WORD_SIZE / sizeof(uint32_t)];
+		/* Source comes from a byte buffer */
+		memcpy(word, data, sizeof(word));
+
+		*(__IO uint32_t *)address = word[0];
+#if APP_BOOTLOADER_FLASH_WORD_SIZE == 8
+		/* Double word is written as two consecutive words */
+		__ISB();
+		*(__IO uint32_t *)(address + 4) = word[1];
+#endif
+		/* Bounded like the wait before the run. Leaving the loop clears PG on every path */
+		if(FLASH_WaitForLastOperation(APP_BOOTLOADER_ARCH_FLASH_TIMEOUT) != HAL_OK || __HAL_FLASH_GET_FLAG(APP_BOOTLOADER_ARCH_FLASH_SR_ERRORS))
+		{
+			__HAL_FLASH_CLEAR_FLAG(APP_BOOTLOADER_ARCH_FLASH_SR_ERRORS);
+			rt = APP_BOOTLOADER_ARCH_E_FAIL;
+			break;
+		}
+
+		address += APP_BOOTLOADER_FLASH_WORD_SIZE;
+		data += APP_BOOTLOADER_FLASH_WORD_SIZE;
+	}
+
+	CLEAR_BIT(FLASH->CR, FLASH_CR_PG);
+	return rt;
+}
+
+int app_bootloader_arch_flash_erase_sector(const app_bootloader_flash_sector_t * sector)
+{
+	uint32_t sector_error = 0;
+	FLASH_EraseInitTypeDef erase_init = {0};
+	erase_init.TypeErase = FLASH_TYPEERASE_SECTORS;
+	erase_init.Sector = sector->nbr;
+	erase_init.NbSectors = 1;
+	erase_init.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+
+	return (HAL_FLASHEx_Erase(&erase_init, &sector_error) == HAL_OK)? APP_BOOTLOADER_ARCH_OK : APP_BOOTLOADER_ARCH_E_FAIL;
+}
+
+void app_bootloader_arch_flash_read(uint32_t address, uint8_t * buffer, uint32_t size)
+{
+	/* Internal flash is memory mapped */
+	memcpy(buffer, (const void *)address, size);
+}
+
+int app_bootloader_arch_crc32_words(uint32_t * crc, const uint8_t * data, uint32_t word_nbr)
+{
+	if(!__HAL_RCC_CRC_IS_CLK_ENABLED())
+		__HAL_RCC_CRC_CLK_ENABLE();
+
+	/* Data register can not be loaded, we can only restart or go on from the last result */
+	if(*crc == APP_BOOTLOADER_CRC32_INIT)
+		CRC->CR = CRC_CR_RESET;
+	else if(CRC->DR != *crc)
+		return APP_BOOTLOADER_ARCH_E_FAIL;
+
+	for(uint32_t i = 0; i < word_nbr; i++, data += sizeof(uint32_t))
+		CRC->DR = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+
+	*crc = CRC->DR;
+	return APP_BOOTLOADER_ARCH_OK;
+}
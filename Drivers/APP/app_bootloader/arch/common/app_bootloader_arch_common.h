@@ -0,0 +1,113 @@
+/*
+ * app_bootloader_arch_common.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef APPLICATION_APP_BOOTLOADER_ARCH_COMMON_APP_BOOTLOADER_ARCH_COMMON_H_
+#define APPLICATION_APP_BOOTLOADER_ARCH_COMMON_APP_BOOTLOADER_ARCH_COMMON_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "app_bootloader_flash.h"
+#include "app_bootloader_handoff.h"
+
+/* SRAM region images booted from RAM are linked at and loaded into. Must match RAMAPP in STM32F429ZITX_FLASH.ld.
+ * It is SRAM3, code runs from it through the system bus. CCMRAM can not hold code, it is data bus only */
+#define APP_BOOTLOADER_RAM_APP_BASE (0x20020000)
+#define APP_BOOTLOADER_RAM_APP_SIZE (64*1024)
+
+typedef enum
+{
+	APP_BOOTLOADER_ARCH_E_FAIL = -1,
+	APP_BOOTLOADER_ARCH_OK = 0,
+}app_bootloader_arch_err_t;
+
+/**
+ * @brief Jump to an application. Peripherals used by the bootloader are reset, interrupts disabled and cleared,
+ * and the vector table moved to the application. Clock fields of the handoff area are set here, the rest must
+ * be filled before. Only returns if no application is found.
+ *
+ * @param boot_address Application vector table address. Internal flash or SRAM application region.
+ */
+void app_bootloader_arch_boot(uint32_t boot_address);
+/**
+ * @brief Get the handoff area shared with the application.
+ *
+ * @return Pointer to the handoff area. Content is whatever the last boot or the application left.
+ */
+app_bootloader_handoff_t * app_bootloader_arch_handoff(void);
+/**
+ * @brief Read the boot strap.
+ *
+ * @return
+ * 			- true if the bootloader must wait for a host instead of booting on its own.
+ */
+bool app_bootloader_arch_boot_strap(void);
+/**
+ * @brief Get where the bytes of the SRAM application region are written.
+ *
+ * @param address Address inside the SRAM application region.
+ * @param size Size to write.
+ * @return Pointer to write into. NULL if the range is not inside the region.
+ */
+uint8_t * app_bootloader_arch_ram_app_map(uint32_t address, uint32_t size);
+/**
+ * @brief Unlock internal flash control.
+ *
+ */
+void app_bootloader_arch_flash_unlock(void);
+/**
+ * @brief Lock internal flash control.
+ *
+ */
+void app_bootloader_arch_flash_lock(void);
+/**
+ * @brief Program one byte of internal flash.
+ *
+ * @param address Internal flash address.
+ * @param data Byte to program.
+ * @return
+ * 			- APP_BOOTLOADER_ARCH_OK if no error.
+ */
+int app_bootloader_arch_flash_program_byte(uint32_t address, uint8_t data);
+/**
+ * @brief Program a run of APP_BOOTLOADER_FLASH_WORD_SIZE words.
+ *
+ * @param address Internal flash address. Must be word aligned.
+ * @param data Data to program. No alignment required.
+ * @param word_nbr Words to program.
+ * @return
+ * 			- APP_BOOTLOADER_ARCH_OK if no error.
+ */
+int app_bootloader_arch_flash_program_words(uint32_t address, const uint8_t * data, uint32_t word_nbr);
+/**
+ * @brief Erase one internal flash sector.
+ *
+ * @param sector Sector description.
+ * @return
+ * 			- APP_BOOTLOADER_ARCH_OK if no error.
+ */
+int app_bootloader_arch_flash_erase_sector(const app_bootloader_flash_sector_t * sector);
+/**
+ * @brief Read internal flash.
+ *
+ * @param address Internal flash address.
+ * @param buffer Buffer.
+ * @param size Size to read.
+ */
+void app_bootloader_arch_flash_read(uint32_t address, uint8_t * buffer, uint32_t size);
+/**
+ * @brief Feed big endian words into the CRC-32 unit.
+ *
+ * @param crc CRC to continue from, updated on success. APP_BOOTLOADER_CRC32_INIT starts a new computation.
+ * @param data Data. No alignment required.
+ * @param word_nbr Words to feed.
+ * @return
+ * 			- APP_BOOTLOADER_ARCH_OK if no error.
+ * 			- APP_BOOTLOADER_ARCH_E_FAIL if there is no CRC unit or it can not continue from 'crc'. Caller computes by software.
+ */
+int app_bootloader_arch_crc32_words(uint32_t * crc, const uint8_t * data, uint32_t word_nbr);
+
+#endif /* APPLICATION_APP_BOOTLOADER_ARCH_COMMON_APP_BOOTLOADER_ARCH_COMMON_H_ */
@@ -9,6 +9,7 @@
 #define APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_H_
 
 #include <stdio.h>
+#include <stdint.h>
 
 typedef enum
 {
@@ -28,6 +29,21 @@ typedef enum
 	APP_BOOTLOADER_STATE_BOOT,
 }app_bootloader_state_t;
 
+/**
+ * @brief Per stage timing counters of the last download. Reset on each download parameter response.
+ *
+ */
+typedef struct
+{
+	uint32_t block_nbr; /*< Blocks received */
+	uint32_t data_size; /*< Block data bytes committed, as received. Smaller than the image when compressed */
+	uint32_t wait_ms; /*< Time waiting for block data since the request/acknowledge was sent */
+	uint32_t erase_ms; /*< Time erasing the partition ahead of blocks */
+	uint32_t program_ms; /*< Time programming blocks into SPI flash */
+	uint32_t send_ms; /*< Time sending frames through console */
+	uint32_t program_stall_nbr; /*< Blocks that arrived with every program buffer busy */
+}app_bootloader_dl_stats_t;
+
 /**
  * @brief Initialize bootloader application.
  *
@@ -43,6 +59,15 @@ int app_bootloader_init(void);
  * 			- APP_BOOTLOADER_E_WAIT waiting for host command.
  */
 int app_bootloader_start(void);
+/**
+ * @brief Get timing counters of the last download.
+ *
+ * @param stats Pointer where counters will be copied.
+ * @return
+ * 			- APP_BOOTLOADER_OK if no error.
+ * 			- APP_BOOTLOADER_E_INVALID if 'stats' is NULL.
+ */
+int app_bootloader_get_dl_stats(app_bootloader_dl_stats_t * stats);
 
 
 #endif /* APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_H_ */
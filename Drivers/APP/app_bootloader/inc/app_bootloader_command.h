@@ -8,9 +8,19 @@
 #ifndef APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_COMMAND_H_
 #define APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_COMMAND_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define APP_BOOTLOADER_CMD_MAGIC_BYTE (0xAA)
+/* Static TX pool used when the caller gives no buffer. Holds frame header and fixed command fields,
+ * variable payloads (block data, error message) are referenced and never copied */
+#define APP_BOOTLOADER_CMD_TX_POOL_SIZE (32)
+/* Size of the CRC-32 trailer when APP_BOOTLOADER_CMD_FEATURE_CRC32 is negotiated */
+#define APP_BOOTLOADER_CMD_CRC_SIZE (4)
+
+/* Optional protocol features. Host offers them in its hello, client answers with the accepted subset */
+#define APP_BOOTLOADER_CMD_FEATURE_CRC32 (1 << 0) /*< Every frame except hellos ends with the CRC-32 of header and data */
+#define APP_BOOTLOADER_CMD_FEATURES (APP_BOOTLOADER_CMD_FEATURE_CRC32) /*< Features supported by this build */
 
 typedef enum
 {
@@ -38,27 +48,52 @@ typedef enum
 	APP_BOOTLOADER_CMD_ERROR,
 	APP_BOOTLOADER_CMD_RETRANSMIT,
 
+	/*< Commands related to windowed download process */
+	APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_ACK, /*< Client cumulative/selective acknowledge of a block window */
+
+	/*< Commands related to console baud rate */
+	APP_BOOTLOADER_CMD_BAUD_REQ, /*< Host proposes a console baud rate */
+	APP_BOOTLOADER_CMD_BAUD_RES, /*< Client answers the rate it switches to, still at the current rate */
+	APP_BOOTLOADER_CMD_BAUD_PROBE, /*< Host probe at the new rate, echoed by client. Without it client falls back */
+
+	/*< Commands related to profiling */
+	APP_BOOTLOADER_CMD_PROFILE_REQ, /*< Host asks recorded profiling spans */
+	APP_BOOTLOADER_CMD_PROFILE_RES, /*< Client answers a run of spans, oldest first */
+
 	APP_BOOTLOADER_CMD_MAX, /*< Boundary of available commands */
 }app_bootloader_command;
 
 /* Command's content*/
 
+typedef struct __attribute__((packed))
+{
+	uint8_t		features; /*< APP_BOOTLOADER_CMD_FEATURE_* bitmap. Hellos without content mean no feature */
+}app_bootloader_cmd_hello;
+
 typedef struct __attribute__((packed))
 {
 	uint8_t 	part_nbr;
 	uint32_t 	binary_size;
+	uint32_t 	image_crc32; /*< CRC-32 of the image. Lets an interrupted download of the same image resume */
 }app_bootloader_cmd_dl_req;
+/* Download request of hosts without resume support ends before the image CRC-32 */
+#define APP_BOOTLOADER_CMD_DL_REQ_BASIC_SIZE (offsetof(app_bootloader_cmd_dl_req, image_crc32))
 
 typedef struct __attribute__((packed))
 {
 	uint8_t 	type;
 	uint32_t 	block_size;
+	uint8_t 	window_size; /*< Max blocks the client can receive ahead of an acknowledge. 0 or 1 for stop-and-wait */
+	uint32_t 	resume_block_nbr; /*< Leading blocks of this image already in the partition. Kept if the host answers the same parameters */
 }app_bootloader_cmd_dl_param_req;
+/* Download parameter request of clients without resume support ends before the resume block number */
+#define APP_BOOTLOADER_CMD_DL_PARAM_REQ_BASIC_SIZE (offsetof(app_bootloader_cmd_dl_param_req, resume_block_nbr))
 
 typedef enum __attribute__((packed))
 {
 	APP_BOOTLOADER_DL_RAW = 0,
 	APP_BOOTLOADER_DL_COMPRESS,
+	APP_BOOTLOADER_DL_DELTA, /*< Blocks are patches against an image in another partition */
 }app_bootloder_dl_type;
 
 typedef struct __attribute__((packed))
@@ -66,7 +101,12 @@ typedef struct __attribute__((packed))
 	uint8_t 	type;
 	uint32_t 	total_block_nbr;
 	uint32_t 	block_size;
+	uint8_t 	window_size; /*< Window accepted by host. Never greater than requested. 0 or 1 for stop-and-wait */
+	uint8_t 	base_partition_nbr; /*< Partition holding the base image. Only with APP_BOOTLOADER_DL_DELTA */
+	uint32_t 	base_crc32; /*< CRC-32 of the base image the patches were made against. Only with APP_BOOTLOADER_DL_DELTA */
 }app_bootloader_cmd_dl_param_res;
+/* Parameter response of hosts without delta support ends before the base fields */
+#define APP_BOOTLOADER_CMD_DL_PARAM_RES_BASIC_SIZE (offsetof(app_bootloader_cmd_dl_param_res, base_partition_nbr))
 
 typedef struct __attribute__((packed))
 {
@@ -80,16 +120,62 @@ typedef struct __attribute__((packed))
 	uint8_t  data[];
 }app_bootloader_cmd_dl_block_res;
 
+typedef struct __attribute__((packed))
+{
+	uint32_t block_nbr; /*< Cumulative acknowledge. Every block below this number is committed */
+	uint32_t ack_bitmap; /*< Selective acknowledge. Bit i set means block 'block_nbr + 1 + i' is committed */
+	uint8_t  window_size; /*< Blocks the host may send starting from 'block_nbr' */
+}app_bootloader_cmd_dl_block_ack;
+
 typedef struct __attribute__((packed))
 {
 	uint8_t error;
 	char  error_msg[];
 }app_bootloader_cmd_err;
 
+typedef enum __attribute__((packed))
+{
+	APP_BOOTLOADER_BOOT_INSTALL = 0, /*< Copy image into the internal flash application region and run it there */
+	APP_BOOTLOADER_BOOT_RAM, /*< Load image into the SRAM application region and run it there. Internal flash is untouched */
+}app_bootloader_boot_mode_t;
+
 typedef struct __attribute__((packed))
 {
 	uint8_t partition_nbr;
+	app_bootloader_boot_mode_t mode;
 }app_bootloader_cmd_boot_app;
+/* Boot request of hosts without RAM boot ends before the mode */
+#define APP_BOOTLOADER_CMD_BOOT_APP_BASIC_SIZE (offsetof(app_bootloader_cmd_boot_app, mode))
+
+typedef struct __attribute__((packed))
+{
+	uint32_t	baudrate; /*< In a response, the current rate means the proposed one was refused */
+}app_bootloader_cmd_baud;
+
+/* Spans sent in one profile response at most */
+#define APP_BOOTLOADER_CMD_PROFILE_SPAN_MAX (32)
+
+typedef struct __attribute__((packed))
+{
+	uint32_t	first_span; /*< First span wanted, counted since the bootloader started */
+}app_bootloader_cmd_profile_req;
+
+typedef struct __attribute__((packed))
+{
+	uint8_t		id; /*< Span id, profile_span_id_t */
+	uint8_t		arg; /*< Span specific argument */
+	uint32_t	start; /*< Cycle counter at start */
+	uint32_t	cycles; /*< Duration */
+}app_bootloader_cmd_profile_span;
+
+typedef struct __attribute__((packed))
+{
+	uint32_t	cycle_hz; /*< Cycle counter rate */
+	uint32_t	span_total; /*< Spans recorded so far, the oldest ones may be overwritten */
+	uint32_t	first_span; /*< Number of the first span sent. Greater than requested if those were overwritten */
+	uint8_t		span_nbr; /*< Spans sent. 0 once 'first_span' reaches 'span_total' */
+	app_bootloader_cmd_profile_span spans[];
+}app_bootloader_cmd_profile_res;
 
 typedef enum __attribute__((packed))
 {
@@ -101,6 +187,7 @@ typedef enum __attribute__((packed))
 	APP_BOOTLOADER_CMD_E_SIZE,
 	APP_BOOTLOADER_CMD_E_INVALID,
 	APP_BOOTLOADER_CMD_E_FAIL,
+	APP_BOOTLOADER_CMD_E_CRC,
 }app_bootloader_command_err_t;
 
 typedef struct __attribute__((packed))
@@ -113,46 +200,77 @@ typedef struct __attribute__((packed))
 
 typedef struct
 {
-	uint8_t * frame;
-	uint16_t frame_size;
+	uint8_t * tx_buffer; /*< Optional caller buffer to serialize the frame. NULL to use the static TX pool */
+	uint16_t tx_buffer_size; /*< Caller buffer size */
+	uint8_t * frame; /*< Serialized frame header and fixed command fields. Valid until next build if static TX pool is used */
+	uint16_t frame_size; /*< Size of 'frame' */
+	const uint8_t * payload; /*< Referenced payload to send right after 'frame'. Can be NULL */
+	uint16_t payload_size; /*< Size of 'payload' */
+	uint8_t trailer[APP_BOOTLOADER_CMD_CRC_SIZE]; /*< CRC-32 to send right after 'payload' */
+	uint8_t trailer_size; /*< Size of 'trailer'. 0 if CRC-32 is not negotiated */
 }app_bootloader_build_res_t;
 
+/**
+ * @brief Set the negotiated features. Frames built and checked afterwards follow them.
+ *
+ * @param features APP_BOOTLOADER_CMD_FEATURE_* bitmap.
+ */
+void app_bootloader_command_set_features(uint8_t features);
+/**
+ * @brief Get the negotiated features.
+ *
+ * @return APP_BOOTLOADER_CMD_FEATURE_* bitmap.
+ */
+uint8_t app_bootloader_command_get_features(void);
+/**
+ * @brief Get the size of a whole frame on the wire, trailer included.
+ *
+ * @param frame Frame header.
+ * @return Frame size.
+ */
+uint32_t app_bootloader_command_frame_size(const app_bootloader_frame_t * frame);
+
 /**
  * @brief Build hello command.
  *
  * @param build_digest Build result.
+ * @param features Accepted features.
  * @return
  * 			- APP_BOOTLOADER_CMD_OK if no error.
  */
-int app_bootloader_build_hello(app_bootloader_build_res_t * build_digest);
+int app_bootloader_build_hello(app_bootloader_build_res_t * build_digest, uint8_t features);
 /**
  * @brief Build host hello command.
  *
  * @param build_digest Build result.
+ * @param features Offered features.
  * @return
  * 			- APP_BOOTLOADER_CMD_OK if no error.
  */
-int app_bootloader_build_host_hello(app_bootloader_build_res_t * build_digest);
+int app_bootloader_build_host_hello(app_bootloader_build_res_t * build_digest, uint8_t features);
 /**
  * @brief Build download request command.
  *
  * @param build_digest Build result.
  * @param partition_nbr Partition number to download.
  * @param binary_size Application size.
+ * @param image_crc32 CRC-32 of the application.
  * @return
  * 			- APP_BOOTLOADER_CMD_OK if no error.
  */
-int app_bootloader_build_dl_req(app_bootloader_build_res_t * build_digest, uint8_t partition_nbr, uint32_t binary_size);
+int app_bootloader_build_dl_req(app_bootloader_build_res_t * build_digest, uint8_t partition_nbr, uint32_t binary_size, uint32_t image_crc32);
 /**
  * @brief Build download parameter request command.
  *
  * @param build_digest Build result.
- * @param type Type of download.
+ * @param type Highest type of download supported. Lower ones are supported too.
  * @param block_size Requested block size for download.
+ * @param window_size Max blocks the client can receive ahead of an acknowledge.
+ * @param resume_block_nbr Leading blocks already in the partition. 0 to start over.
  * @return
  * 			- APP_BOOTLOADER_CMD_OK if no error.
  */
-int app_bootloader_build_dl_param_req(app_bootloader_build_res_t * build_digest, uint8_t type, uint16_t block_size);
+int app_bootloader_build_dl_param_req(app_bootloader_build_res_t * build_digest, uint8_t type, uint16_t block_size, uint8_t window_size, uint32_t resume_block_nbr);
 /**
  * @brief Build download parameter response command.
  *
@@ -160,10 +278,13 @@ int app_bootloader_build_dl_param_req(app_bootloader_build_res_t * build_digest,
  * @param type Type of download.
  * @param total_block_nbr Total number of blocks.
  * @param block_size Block size.
+ * @param window_size Accepted window size.
+ * @param base_partition_nbr Partition holding the base image. Ignored if type is not APP_BOOTLOADER_DL_DELTA.
+ * @param base_crc32 CRC-32 of the base image. Ignored if type is not APP_BOOTLOADER_DL_DELTA.
  * @return
  * 			- APP_BOOTLOADER_CMD_OK if no error.
  */
-int app_bootloader_build_dl_param_res(app_bootloader_build_res_t * build_digest, uint8_t type, uint32_t total_block_nbr, uint16_t block_size);
+int app_bootloader_build_dl_param_res(app_bootloader_build_res_t * build_digest, uint8_t type, uint32_t total_block_nbr, uint16_t block_size, uint8_t window_size, uint8_t base_partition_nbr, uint32_t base_crc32);
 /**
  * @brief Build download block request command.
  *
@@ -179,11 +300,22 @@ int app_bootloader_build_dl_block_req(app_bootloader_build_res_t * build_digest,
  * @param build_digest Build result.
  * @param block_nbr Block number.
  * @param data_size Data size
- * @param data Block's data.
+ * @param data Block's data. Referenced by build result, must be valid until the frame is sent.
  * @return
  * 			- APP_BOOTLOADER_CMD_OK if no error.
  */
 int app_bootloader_build_dl_block_res(app_bootloader_build_res_t * build_digest, uint32_t block_nbr, uint32_t data_size, uint8_t * data);
+/**
+ * @brief Build download block acknowledge command.
+ *
+ * @param build_digest Build result.
+ * @param block_nbr First block not committed yet.
+ * @param ack_bitmap Committed blocks after 'block_nbr'.
+ * @param window_size Blocks the host may send starting from 'block_nbr'.
+ * @return
+ * 			- APP_BOOTLOADER_CMD_OK if no error.
+ */
+int app_bootloader_build_dl_block_ack(app_bootloader_build_res_t * build_digest, uint32_t block_nbr, uint32_t ack_bitmap, uint8_t window_size);
 /**
  * @brief Build end command.
  *
@@ -197,17 +329,17 @@ int app_bootloader_build_end(app_bootloader_build_res_t * build_digest);
  *
  * @param build_digest Build result.
  * @param partition_nbr Partition number to boot.
- * @return
+ * @param mode Where the image runs.
  * @return
  * 			- APP_BOOTLOADER_CMD_OK if no error.
  */
-int app_bootloader_build_boot_app(app_bootloader_build_res_t * build_digest, uint8_t partition_nbr);
+int app_bootloader_build_boot_app(app_bootloader_build_res_t * build_digest, uint8_t partition_nbr, app_bootloader_boot_mode_t mode);
 /**
  * @brief Build error command.
  *
  * @param build_digest Build result.
  * @param error Error enum.
- * @param message Message.
+ * @param message Message. Referenced by build result, must be valid until the frame is sent.
  * @return
  * @return
  * 			- APP_BOOTLOADER_CMD_OK if no error.
@@ -222,7 +354,56 @@ int app_bootloader_build_error(app_bootloader_build_res_t * build_digest, uint8_
  */
 int app_bootloader_build_retransmit(app_bootloader_build_res_t * build_digest);
 /**
- * @brief Check command format.
+ * @brief Build baud rate request command.
+ *
+ * @param build_digest Build result.
+ * @param baudrate Proposed baud rate.
+ * @return
+ * 			- APP_BOOTLOADER_CMD_OK if no error.
+ */
+int app_bootloader_build_baud_req(app_bootloader_build_res_t * build_digest, uint32_t baudrate);
+/**
+ * @brief Build baud rate response command.
+ *
+ * @param build_digest Build result.
+ * @param baudrate Baud rate used once the response is sent.
+ * @return
+ * 			- APP_BOOTLOADER_CMD_OK if no error.
+ */
+int app_bootloader_build_baud_res(app_bootloader_build_res_t * build_digest, uint32_t baudrate);
+/**
+ * @brief Build baud rate probe command.
+ *
+ * @param build_digest Build result.
+ * @param baudrate Baud rate the probe is sent at.
+ * @return
+ * 			- APP_BOOTLOADER_CMD_OK if no error.
+ */
+int app_bootloader_build_baud_probe(app_bootloader_build_res_t * build_digest, uint32_t baudrate);
+/**
+ * @brief Build profile request command.
+ *
+ * @param build_digest Build result.
+ * @param first_span First span wanted.
+ * @return
+ * 			- APP_BOOTLOADER_CMD_OK if no error.
+ */
+int app_bootloader_build_profile_req(app_bootloader_build_res_t * build_digest, uint32_t first_span);
+/**
+ * @brief Build profile response command.
+ *
+ * @param build_digest Build result.
+ * @param cycle_hz Cycle counter rate.
+ * @param span_total Spans recorded so far.
+ * @param first_span Number of the first span sent.
+ * @param span_nbr Spans sent. Up to APP_BOOTLOADER_CMD_PROFILE_SPAN_MAX.
+ * @param spans Spans. Referenced by build result, must be valid until the frame is sent. Can be NULL if 'span_nbr' is 0.
+ * @return
+ * 			- APP_BOOTLOADER_CMD_OK if no error.
+ */
+int app_bootloader_build_profile_res(app_bootloader_build_res_t * build_digest, uint32_t cycle_hz, uint32_t span_total, uint32_t first_span, uint8_t span_nbr, const app_bootloader_cmd_profile_span * spans);
+/**
+ * @brief Check command format. CRC-32 trailer is verified when negotiated.
  *
  * @param buffer Received command.
  * @param buffer_size Size of received command.
@@ -230,6 +411,7 @@ int app_bootloader_build_retransmit(app_bootloader_build_res_t * build_digest);
  * @return
  * @return
  * 			- APP_BOOTLOADER_CMD_OK if no error.
+ * 			- APP_BOOTLOADER_CMD_E_CRC if CRC-32 trailer does not match.
  */
 int app_bootloader_command_check(uint8_t * buffer, uint16_t buffer_size, app_bootloader_frame_t ** command_digest);
 
@@ -0,0 +1,59 @@
+/*
+ * app_bootloader_crc.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_CRC_H_
+#define APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_CRC_H_
+
+#include <stdint.h>
+
+/* CRC-32/MPEG-2: polynomial 0x04C11DB7, no reflection, no final xor. It is what the STM32 CRC unit
+ * computes when bytes are fed as big endian words, so target and host get the same value */
+#define APP_BOOTLOADER_CRC32_POLY (0x04C11DB7)
+#define APP_BOOTLOADER_CRC32_INIT (0xFFFFFFFF)
+
+/**
+ * @brief Streaming CRC-32 context.
+ *
+ */
+typedef struct
+{
+	uint32_t crc; /* CRC of every complete word fed so far */
+	uint8_t tail[4]; /* Bytes waiting to complete a word */
+	uint8_t tail_size;
+}app_bootloader_crc32_t;
+
+/**
+ * @brief Start a CRC-32 computation.
+ *
+ * @param ctx CRC context.
+ */
+void app_bootloader_crc32_init(app_bootloader_crc32_t * ctx);
+/**
+ * @brief Feed data into a CRC-32 computation.
+ *
+ * @param ctx CRC context.
+ * @param data Data. No alignment required.
+ * @param size Data size.
+ */
+void app_bootloader_crc32_update(app_bootloader_crc32_t * ctx, const uint8_t * data, uint32_t size);
+/**
+ * @brief Finish a CRC-32 computation.
+ *
+ * @param ctx CRC context.
+ * @return CRC-32.
+ */
+uint32_t app_bootloader_crc32_final(app_bootloader_crc32_t * ctx);
+/**
+ * @brief Compute the CRC-32 of a buffer.
+ *
+ * @param data Data.
+ * @param size Data size.
+ * @return CRC-32.
+ */
+uint32_t app_bootloader_crc32(const uint8_t * data, uint32_t size);
+
+#endif /* APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_CRC_H_ */
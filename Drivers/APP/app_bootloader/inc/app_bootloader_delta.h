@@ -0,0 +1,83 @@
+/*
+ * app_bootloader_delta.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_DELTA_H_
+#define APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_DELTA_H_
+
+#include <stdint.h>
+
+/* A patch block is one flag byte followed by an op stream, LZ4 compressed with APP_BOOTLOADER_DELTA_FLAG_LZ4.
+ * It rebuilds exactly one download block of the new image, so blocks are applied in any order */
+#define APP_BOOTLOADER_DELTA_FLAG_LZ4 (1 << 0)
+#define APP_BOOTLOADER_DELTA_FLAGS (APP_BOOTLOADER_DELTA_FLAG_LZ4)
+/* Decompressed op stream of a block is at most block size plus this */
+#define APP_BOOTLOADER_DELTA_OPS_MARGIN (64)
+
+/* Every op starts with its type and a little endian 16 bit length */
+typedef enum
+{
+	APP_BOOTLOADER_DELTA_OP_COPY = 0, /*< 32 bit base offset. Copy 'length' base bytes */
+	APP_BOOTLOADER_DELTA_OP_ADD, /*< 32 bit base offset, 'length' bytes added to base bytes (bsdiff style) */
+	APP_BOOTLOADER_DELTA_OP_INSERT, /*< 'length' new bytes */
+	APP_BOOTLOADER_DELTA_OP_MAX,
+}app_bootloader_delta_op_t;
+
+#define APP_BOOTLOADER_DELTA_OP_HEADER_SIZE (3)
+#define APP_BOOTLOADER_DELTA_OP_OFFSET_SIZE (4)
+
+typedef enum
+{
+	APP_BOOTLOADER_DELTA_OK = 0,
+	APP_BOOTLOADER_DELTA_E_PARAM,
+	APP_BOOTLOADER_DELTA_E_CORRUPT,
+	APP_BOOTLOADER_DELTA_E_READ,
+}app_bootloader_delta_err_t;
+
+/**
+ * @brief Read base image bytes.
+ *
+ * @param offset Offset inside the base image.
+ * @param buffer Where bytes are read.
+ * @param size Size to read.
+ * @param arg User argument.
+ * @return 0 if no error.
+ */
+typedef int (*app_bootloader_delta_read_cb)(uint32_t offset, uint8_t * buffer, uint32_t size, void * arg);
+
+/**
+ * @brief Image a patch is applied against.
+ *
+ */
+typedef struct
+{
+	uint32_t size; /*< Base image size */
+	app_bootloader_delta_read_cb read_cb;
+	void * arg; /*< Argument for 'read_cb' */
+	uint8_t * window; /*< Buffer where the base range a block needs is read at once. NULL to read each op on its own */
+	uint32_t window_size; /*< Window buffer size */
+}app_bootloader_delta_base_t;
+
+/**
+ * @brief Rebuild one block from a patch block. Base bytes are read straight into the output, added diffs
+ * are applied in place. With a base window, base bytes of every op are read in one go when they fit in it,
+ * otherwise a window is read at each op it does not cover.
+ *
+ * @param patch Patch block.
+ * @param patch_size Patch block size.
+ * @param dst Output buffer.
+ * @param dst_size Block size. The patch must rebuild exactly this size.
+ * @param base Base image.
+ * @param scratch Buffer for the decompressed op stream. Only used with APP_BOOTLOADER_DELTA_FLAG_LZ4.
+ * @param scratch_size Scratch buffer size.
+ * @return
+ * 			- APP_BOOTLOADER_DELTA_OK if no error.
+ * 			- APP_BOOTLOADER_DELTA_E_CORRUPT if patch is not valid for this block and base.
+ * 			- APP_BOOTLOADER_DELTA_E_READ if base could not be read.
+ */
+int app_bootloader_delta_apply(const uint8_t * patch, uint32_t patch_size, uint8_t * dst, uint32_t dst_size, const app_bootloader_delta_base_t * base, uint8_t * scratch, uint32_t scratch_size);
+
+#endif /* APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_DELTA_H_ */
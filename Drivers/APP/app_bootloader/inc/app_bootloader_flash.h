@@ -0,0 +1,88 @@
+/*
+ * app_bootloader_flash.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_FLASH_H_
+#define APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_FLASH_H_
+
+#include <stdint.h>
+
+/* Set to 1 only when an external 8-9V VPP is applied. Double word programming is not allowed otherwise */
+#define APP_BOOTLOADER_FLASH_VPP_ENABLE (0)
+
+#define APP_BOOTLOADER_FLASH_BASE (0x08000000)
+#define APP_BOOTLOADER_FLASH_END (0x081FFFFF) /* 2 MiB, two banks */
+
+#if APP_BOOTLOADER_FLASH_VPP_ENABLE
+#define APP_BOOTLOADER_FLASH_WORD_SIZE (8) /* x64 parallelism */
+#else
+#define APP_BOOTLOADER_FLASH_WORD_SIZE (4) /* x32 parallelism, voltage range 2.7V - 3.6V */
+#endif
+
+typedef enum
+{
+	APP_BOOTLOADER_FLASH_OK = 0,
+	APP_BOOTLOADER_FLASH_E_PARAM = -1,
+	APP_BOOTLOADER_FLASH_E_FAIL = -2,
+}app_bootloader_flash_err_t;
+
+/**
+ * @brief Internal flash sector description.
+ *
+ */
+typedef struct
+{
+	uint32_t nbr; /*< Sector number as expected by HAL (FLASH_SECTOR_x) */
+	uint32_t address; /*< Sector start address */
+	uint32_t size; /*< Sector size */
+}app_bootloader_flash_sector_t;
+
+/**
+ * @brief Program internal flash. Aligned runs are programmed a word at a time,
+ * unaligned head and tail bytes one byte at a time. Flash must be erased before.
+ *
+ * @param address Internal flash address.
+ * @param data Data to program. No alignment required.
+ * @param size Data size.
+ * @return
+ * 			- APP_BOOTLOADER_FLASH_OK if no error.
+ * 			- APP_BOOTLOADER_FLASH_E_PARAM if 'data' is NULL.
+ * 			- APP_BOOTLOADER_FLASH_E_FAIL if flash reports an error.
+ */
+int app_bootloader_flash_program(uint32_t address, const uint8_t * data, uint32_t size);
+/**
+ * @brief Get the sector holding an address from F429 sector map. Each bank has 4 x 16 KiB, 1 x 64 KiB and 7 x 128 KiB sectors.
+ *
+ * @param address Internal flash address.
+ * @param sector Pointer where sector description will be copied.
+ * @return
+ * 			- APP_BOOTLOADER_FLASH_OK if no error.
+ * 			- APP_BOOTLOADER_FLASH_E_PARAM if 'address' is out of internal flash or 'sector' is NULL.
+ */
+int app_bootloader_flash_get_sector(uint32_t address, app_bootloader_flash_sector_t * sector);
+/**
+ * @brief Erase one sector.
+ *
+ * @param sector Sector description from app_bootloader_flash_get_sector.
+ * @return
+ * 			- APP_BOOTLOADER_FLASH_OK if no error.
+ * 			- APP_BOOTLOADER_FLASH_E_PARAM if 'sector' is NULL.
+ * 			- APP_BOOTLOADER_FLASH_E_FAIL if flash reports an error.
+ */
+int app_bootloader_flash_erase_sector(const app_bootloader_flash_sector_t * sector);
+/**
+ * @brief Read internal flash.
+ *
+ * @param address Internal flash address.
+ * @param buffer Buffer.
+ * @param size Size to read.
+ * @return
+ * 			- APP_BOOTLOADER_FLASH_OK if no error.
+ * 			- APP_BOOTLOADER_FLASH_E_PARAM if 'buffer' is NULL or range is out of internal flash.
+ */
+int app_bootloader_flash_read(uint32_t address, uint8_t * buffer, uint32_t size);
+
+#endif /* APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_FLASH_H_ */
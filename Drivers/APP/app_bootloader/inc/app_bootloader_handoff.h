@@ -0,0 +1,50 @@
+/*
+ * app_bootloader_handoff.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_HANDOFF_H_
+#define APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_HANDOFF_H_
+
+#include <stdint.h>
+
+/* Handoff area, last 256 bytes of CCMRAM. Kept out of the bootloader by HANDOFF in STM32F429ZITX_FLASH.ld,
+ * applications must keep it out of theirs too. Applications include this header to read it */
+#define APP_BOOTLOADER_HANDOFF_ADDR (0x1000FF00)
+#define APP_BOOTLOADER_HANDOFF_SIZE (256)
+
+#define APP_BOOTLOADER_HANDOFF_MAGIC (0xB007AB1E)
+#define APP_BOOTLOADER_HANDOFF_VERSION (1)
+/* Written by the application into 'confirm' once it works. Bootloader confirms the slot at next reset */
+#define APP_BOOTLOADER_HANDOFF_CONFIRM (0x600DB007)
+
+#define APP_BOOTLOADER_HANDOFF_FLAG_CLOCKS (1<<0) /*< PLL is left running, SYSCLK is 'sysclk_hz'. Clock setup can be skipped */
+#define APP_BOOTLOADER_HANDOFF_FLAG_RAM (1<<1) /*< Application was loaded into SRAM, not installed */
+
+typedef enum __attribute__((packed))
+{
+	APP_BOOTLOADER_HANDOFF_REASON_HOST = 0, /*< Host asked to boot */
+	APP_BOOTLOADER_HANDOFF_REASON_AUTO, /*< No host in the listen window, active slot booted */
+	APP_BOOTLOADER_HANDOFF_REASON_FALLBACK, /*< No host in the listen window, active slot ran out of tries and previous one booted */
+}app_bootloader_handoff_reason_t;
+
+/**
+ * @brief What the bootloader tells the application it jumps to.
+ *
+ */
+typedef struct __attribute__((packed))
+{
+	uint32_t magic; /*< APP_BOOTLOADER_HANDOFF_MAGIC. Anything else means there is no handoff */
+	uint8_t version;
+	app_bootloader_handoff_reason_t reason;
+	uint8_t slot; /*< Partition booted */
+	uint8_t try_nbr; /*< Boots of the slot while not confirmed, this one included */
+	uint32_t flag; /*< APP_BOOTLOADER_HANDOFF_FLAG_* */
+	uint32_t sysclk_hz; /*< SYSCLK at jump */
+	uint32_t boot_ms; /*< Time from reset to jump */
+	volatile uint32_t confirm; /*< Written by the application */
+}app_bootloader_handoff_t;
+
+#endif /* APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_HANDOFF_H_ */
@@ -0,0 +1,35 @@
+/*
+ * app_bootloader_lz4.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_LZ4_H_
+#define APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_LZ4_H_
+
+#include <stdint.h>
+
+typedef enum
+{
+	APP_BOOTLOADER_LZ4_OK = 0,
+	APP_BOOTLOADER_LZ4_E_PARAM,
+	APP_BOOTLOADER_LZ4_E_CORRUPT,
+}app_bootloader_lz4_err_t;
+
+/**
+ * @brief Decompress one LZ4 block (block format, no frame). Matches only reference output already decompressed,
+ * so no RAM is needed besides the output buffer.
+ *
+ * @param src Compressed data.
+ * @param src_size Compressed data size.
+ * @param dst Output buffer.
+ * @param dst_capacity Output buffer size.
+ * @param dst_size Where the decompressed size is saved.
+ * @return
+ * 			- APP_BOOTLOADER_LZ4_OK if no error.
+ * 			- APP_BOOTLOADER_LZ4_E_CORRUPT if data is not a valid block or does not fit in output buffer.
+ */
+int app_bootloader_lz4_decompress(const uint8_t * src, uint32_t src_size, uint8_t * dst, uint32_t dst_capacity, uint32_t * dst_size);
+
+#endif /* APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_LZ4_H_ */
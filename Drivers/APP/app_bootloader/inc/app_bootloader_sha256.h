@@ -0,0 +1,50 @@
+/*
+ * app_bootloader_sha256.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_SHA256_H_
+#define APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_SHA256_H_
+
+#include <stdint.h>
+
+#define APP_BOOTLOADER_SHA256_SIZE (32)
+#define APP_BOOTLOADER_SHA256_BLOCK_SIZE (64)
+
+/**
+ * @brief Streaming SHA-256 context.
+ *
+ */
+typedef struct
+{
+	uint32_t state[8];
+	uint64_t length; /* Bytes fed so far */
+	uint8_t block[APP_BOOTLOADER_SHA256_BLOCK_SIZE]; /* Bytes waiting to complete a block */
+	uint8_t block_size;
+}app_bootloader_sha256_t;
+
+/**
+ * @brief Start a SHA-256 computation.
+ *
+ * @param ctx SHA-256 context.
+ */
+void app_bootloader_sha256_init(app_bootloader_sha256_t * ctx);
+/**
+ * @brief Feed data into a SHA-256 computation.
+ *
+ * @param ctx SHA-256 context.
+ * @param data Data.
+ * @param size Data size.
+ */
+void app_bootloader_sha256_update(app_bootloader_sha256_t * ctx, const uint8_t * data, uint32_t size);
+/**
+ * @brief Finish a SHA-256 computation.
+ *
+ * @param ctx SHA-256 context.
+ * @param digest Buffer of APP_BOOTLOADER_SHA256_SIZE where the digest is saved.
+ */
+void app_bootloader_sha256_final(app_bootloader_sha256_t * ctx, uint8_t * digest);
+
+#endif /* APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_SHA256_H_ */
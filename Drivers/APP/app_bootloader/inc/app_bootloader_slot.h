@@ -0,0 +1,107 @@
+/*
+ * app_bootloader_slot.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_SLOT_H_
+#define APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_SLOT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "API_spi_flash.h"
+
+/* Boot control record is kept twice, one SPI flash sector each, right after the last partition. Updates go
+ * to the older copy, so a reset in the middle of an update leaves the other one valid */
+#define APP_BOOTLOADER_SLOT_RECORD_OFFSET (0xF0000)
+#define APP_BOOTLOADER_SLOT_RECORD_COPY_NBR (2)
+#define APP_BOOTLOADER_SLOT_RECORD_COPY_SIZE (SPI_FLASH_SECTOR_SIZE)
+
+#define APP_BOOTLOADER_SLOT_NONE (0xFF) /* No slot */
+#define APP_BOOTLOADER_SLOT_MAX_TRY (3) /* Boots of a slot not confirmed before falling back to the previous one */
+
+typedef enum
+{
+	APP_BOOTLOADER_SLOT_OK = 0,
+	APP_BOOTLOADER_SLOT_E_PARAM = -1,
+	APP_BOOTLOADER_SLOT_E_FLASH = -2,
+	APP_BOOTLOADER_SLOT_E_EMPTY = -3,
+}app_bootloader_slot_err_t;
+
+/**
+ * @brief Boot control state.
+ *
+ */
+typedef struct __attribute__((packed))
+{
+	uint8_t active_slot; /*< Slot to boot. APP_BOOTLOADER_SLOT_NONE until one is set */
+	uint8_t previous_slot; /*< Confirmed slot to fall back to while the active one is not confirmed */
+	uint8_t try_nbr; /*< Boots of the active slot since it was set, while not confirmed */
+	bool confirmed; /*< Active slot is known to work */
+	uint8_t installed_slot; /*< Slot whose image is in the internal flash application region. APP_BOOTLOADER_SLOT_NONE if unknown */
+	uint32_t installed_crc32; /*< CRC-32 of the installed image */
+}app_bootloader_slot_ctrl_t;
+
+/**
+ * @brief Load the boot control record. The valid copy with the newest sequence is taken. Without any,
+ * nothing is active nor installed.
+ *
+ * @return
+ * 			- APP_BOOTLOADER_SLOT_OK always. Copies that can not be read are taken as not valid.
+ */
+int app_bootloader_slot_init(void);
+/**
+ * @brief Get the boot control state.
+ *
+ * @param ctrl Pointer where state will be copied.
+ * @return
+ * 			- APP_BOOTLOADER_SLOT_OK if no error.
+ * 			- APP_BOOTLOADER_SLOT_E_PARAM if 'ctrl' is NULL.
+ */
+int app_bootloader_slot_get(app_bootloader_slot_ctrl_t * ctrl);
+/**
+ * @brief Make a slot the active one, on trial until confirmed. A confirmed active slot becomes the one to fall back to.
+ *
+ * @param slot Slot number.
+ * @return
+ * 			- APP_BOOTLOADER_SLOT_OK if no error.
+ * 			- APP_BOOTLOADER_SLOT_E_PARAM if 'slot' is APP_BOOTLOADER_SLOT_NONE.
+ * 			- APP_BOOTLOADER_SLOT_E_FLASH if record can not be written.
+ */
+int app_bootloader_slot_set_active(uint8_t slot);
+/**
+ * @brief Mark the active slot as working. It is not tried anymore.
+ *
+ * @return
+ * 			- APP_BOOTLOADER_SLOT_OK if no error.
+ * 			- APP_BOOTLOADER_SLOT_E_EMPTY if no slot is active.
+ * 			- APP_BOOTLOADER_SLOT_E_FLASH if record can not be written.
+ */
+int app_bootloader_slot_confirm(void);
+/**
+ * @brief Select the slot to boot without host. A slot not confirmed after APP_BOOTLOADER_SLOT_MAX_TRY boots is
+ * dropped for the previous one, otherwise the boot is counted as one more try.
+ *
+ * @param slot Pointer where selected slot will be copied.
+ * @return
+ * 			- APP_BOOTLOADER_SLOT_OK if no error.
+ * 			- APP_BOOTLOADER_SLOT_E_PARAM if 'slot' is NULL.
+ * 			- APP_BOOTLOADER_SLOT_E_EMPTY if no slot is active.
+ * 			- APP_BOOTLOADER_SLOT_E_FLASH if record can not be written.
+ */
+int app_bootloader_slot_select(uint8_t * slot);
+/**
+ * @brief Record which slot is in the internal flash application region. Must be set to APP_BOOTLOADER_SLOT_NONE
+ * before the region is modified, so an interrupted install is never taken as complete.
+ *
+ * @param slot Slot number or APP_BOOTLOADER_SLOT_NONE.
+ * @param crc32 CRC-32 of the installed image.
+ * @return
+ * 			- APP_BOOTLOADER_SLOT_OK if no error.
+ * 			- APP_BOOTLOADER_SLOT_E_FLASH if record can not be written.
+ */
+int app_bootloader_slot_set_installed(uint8_t slot, uint32_t crc32);
+
+#endif /* APPLICATION_APP_BOOTLOADER_INC_APP_BOOTLOADER_SLOT_H_ */
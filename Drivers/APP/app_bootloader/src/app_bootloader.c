@@ -3,11 +3,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "stm32f4xx_hal.h"
-
 #include "app_bootloader.h"
 #include "app_bootloader_command.h"
+#include "app_bootloader_crc.h"
+#include "app_bootloader_delta.h"
+#include "app_bootloader_flash.h"
+#include "app_bootloader_lz4.h"
+#include "app_bootloader_sha256.h"
+#include "app_bootloader_slot.h"
+#include "app_bootloader_arch_common.h"
 #include "API_console.h"
+#include "API_profile.h"
 #include "API_spi_flash.h"
 #include "api_delay.h"
 
@@ -18,20 +24,33 @@
 #define print_serial_error(format, ...) LOG_LEVEL(LOG_ERROR, tag, format, ##__VA_ARGS__)
 #define print_serial_hex(data, data_size) LOG_HEXDUMP(tag, data, data_size, LOG_WARN)
 
-#define APP_BOOTLOADER_BUFFER_SIZE (5120)
 #define APP_BOOTLOADER_DEFAULT_BLOCK_SIZE (4096)
-#define APP_BOOTLOADER_DEFAULT_DL_TYPE (APP_BOOTLOADER_DL_RAW)
+#define APP_BOOTLOADER_BLOCK_FRAME_SIZE (sizeof(app_bootloader_frame_t) + sizeof(app_bootloader_cmd_dl_block_res) + APP_BOOTLOADER_DEFAULT_BLOCK_SIZE + APP_BOOTLOADER_CMD_CRC_SIZE)
+/* Room for a whole console burst plus a frame that could be left incomplete from the previous one */
+#define APP_BOOTLOADER_BUFFER_SIZE (CONSOLE_MAX_RECV_SIZE + APP_BOOTLOADER_BLOCK_FRAME_SIZE)
+/* Blocks the host may stream before waiting an acknowledge. A full window must fit in one console burst */
+#define APP_BOOTLOADER_MAX_WINDOW_SIZE (CONSOLE_MAX_RECV_SIZE / APP_BOOTLOADER_BLOCK_FRAME_SIZE)
+/* Blocks waiting to be programmed while the next ones are received. 2 for double buffering */
+#define APP_BOOTLOADER_PROGRAM_BUFFER_NBR (2)
+/* Highest type offered to the host, which may answer any lower one. Compressed and delta blocks rebuild a whole block */
+#define APP_BOOTLOADER_DEFAULT_DL_TYPE (APP_BOOTLOADER_DL_DELTA)
 #define APP_BOOTLOADER_DEFAULT_PARTITION_SIZE (0x50000) /* 327 kB */
 
 #define APP_BOOTLOADER_PARTITION_MAGIC_BYTE		(0x2609)
 #define APP_BOOTLOADER_PARTITION_FLAG_COMPLETE 	(1<<0)
+#define APP_BOOTLOADER_PARTITION_FLAG_DIGEST 	(1<<1) /* Header holds the image digest */
 #define APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE (256)
+#define APP_BOOTLOADER_PARTITION_PROGRESS_MAGIC_BYTE (0x0926)
+#define APP_BOOTLOADER_PARTITION_PROGRESS_OFFSET (64) /* Download progress record, in the header page after partition info */
+#define APP_BOOTLOADER_PARTITION_PROGRESS_BITMAP_SIZE (128)
+#define APP_BOOTLOADER_PARTITION_PROGRESS_BLOCK_MAX (APP_BOOTLOADER_PARTITION_PROGRESS_BITMAP_SIZE * 8)
+#define APP_BOOTLOADER_ALIGN_UP(value, align) ((((value) + (align) - 1) / (align)) * (align))
+/* A 64 KiB block erase takes about as long as 4 sector erases (150 ms against 45 ms typical) */
+#define APP_BOOTLOADER_ERASE_BLOCK64_MIN_SIZE (4 * SPI_FLASH_SECTOR_SIZE)
 
 #define BOOTLOADER_ADDR (0x8000000)
 #define APP_ADDR		(0x8080000)
 
-typedef void (*jump_function)(void);
-
 /**
  * @brief Bootloader download state structure.
  *
@@ -45,8 +64,35 @@ typedef struct
 	uint32_t block_size;
 	app_bootloder_dl_type dl_type;
 	uint8_t partition_nbr;
+	uint8_t window_size; /* Accepted window. 0 or 1 means stop-and-wait */
+	uint32_t window_base; /* First block not committed yet */
+	uint32_t window_bitmap; /* Bit i set means block 'window_base + i' is committed */
+	bool ack_pending; /* Acknowledge must be sent once the received burst is processed */
+	uint8_t base_partition_nbr; /* Partition patches are applied against. Only for APP_BOOTLOADER_DL_DELTA */
+	uint32_t base_size; /* Image size in base partition */
+	bool image_crc32_valid; /* Host gave the image CRC-32 in download request */
+	uint32_t image_crc32;
+	bool resumable; /* Progress is saved in the partition header page */
+	uint32_t resume_block_nbr; /* Leading blocks of the same image found programmed at download request */
+	uint32_t saved_block_nbr; /* Leading blocks recorded as programmed in the progress record */
+	uint32_t erased_size; /* Partition bytes erased from its start. Erase runs just ahead of programming */
 }app_bootloader_dl_t;
 
+/**
+ * @brief Received block waiting to be programmed into SPI flash.
+ *
+ */
+typedef struct
+{
+	uint8_t data[APP_BOOTLOADER_DEFAULT_BLOCK_SIZE];
+	uint32_t address; /* SPI flash address */
+	uint32_t size; /* Data size */
+	bool pending; /* Block is waiting to be programmed */
+	volatile bool in_flight; /* Block is being programmed by DMA */
+	uint32_t start_tick; /* Tick when programming started */
+	uint32_t progress_block_nbr; /* Leading download blocks in flash once this one is programmed */
+}app_bootloader_program_buffer_t;
+
 /**
  * @brief Bootloader application machine.
  *
@@ -76,12 +122,62 @@ typedef struct __attribute__((packed))
 	uint16_t magic_byte; /* Magic byte to detect data */
 	uint32_t size; /* Saved partition size */
 	uint32_t flag; /* Flags of partition */
+	uint32_t crc32; /* CRC-32 of the image. Valid with APP_BOOTLOADER_PARTITION_FLAG_DIGEST */
+	uint8_t sha256[APP_BOOTLOADER_SHA256_SIZE]; /* SHA-256 of the image. Valid with APP_BOOTLOADER_PARTITION_FLAG_DIGEST */
 }app_bootloader_partition_info_t;
 
+/**
+ * @brief Progress of the download in a partition, saved in its header page so an interrupted download of the
+ * same image resumes. Flash bits only go from 1 to 0 without erase, so progress clears bits of an erased bitmap.
+ *
+ */
+typedef struct __attribute__((packed))
+{
+	uint16_t magic_byte;
+	uint32_t image_crc32; /* CRC-32 given by host in download request */
+	uint32_t size;
+	uint32_t block_size;
+	uint8_t dl_type;
+	uint8_t base_partition_nbr;
+	uint32_t base_crc32;
+	uint8_t committed[APP_BOOTLOADER_PARTITION_PROGRESS_BITMAP_SIZE]; /* Bit i cleared once blocks 0 to i are programmed */
+}app_bootloader_partition_progress_t;
+
+/**
+ * @brief Image digest computed while data streams in or out of a partition.
+ *
+ */
+typedef struct
+{
+	app_bootloader_crc32_t crc32;
+	app_bootloader_sha256_t sha256;
+}app_bootloader_digest_t;
+
 static volatile app_bootloader_t app_bootloader = {.state = APP_BOOTLOADER_STATE_DISABLE};
 static uint8_t app_bootloader_buffer[APP_BOOTLOADER_BUFFER_SIZE] = {0};
 static uint16_t app_bootloader_recv = 0;
 
+static app_bootloader_program_buffer_t program_buffer[APP_BOOTLOADER_PROGRAM_BUFFER_NBR] = {0};
+static uint8_t program_buffer_head = 0; /* Next buffer to fill */
+static uint8_t program_buffer_tail = 0; /* Next buffer to program */
+static int program_error = SPI_FLASH_OK; /* Result of last failed asynchronous program or erase */
+static uint8_t erase_pending_nbr = 0; /* Erases queued and not completed yet */
+static uint32_t erase_tick = 0; /* Tick since which queued erases are counted */
+static uint32_t program_progress_block_nbr = 0; /* Leading download blocks programmed so far */
+static uint32_t boot_address = APP_ADDR; /* Vector table of the application to boot */
+static uint8_t boot_partition_nbr = 0; /* Partition of the application to boot */
+static volatile bool install_read_done = true; /* Install chunk read has completed */
+static volatile int install_read_result = SPI_FLASH_OK; /* Install chunk read result */
+
+static app_bootloader_dl_stats_t dl_stats = {0};
+static uint32_t dl_wait_tick = 0; /* Tick when last request/acknowledge was sent. 0 if not waiting */
+static app_bootloader_digest_t dl_digest; /* Digest of the image being downloaded */
+static uint32_t dl_digest_block_nbr = 0; /* Next block to feed into 'dl_digest'. Blocks are hashed in order */
+static app_bootloader_partition_progress_t dl_progress; /* Progress record of the partition being downloaded */
+static app_bootloader_cmd_profile_span profile_payload[APP_BOOTLOADER_CMD_PROFILE_SPAN_MAX]; /* Spans of last profile response, referenced until sent */
+static uint8_t dl_patch_buffer[APP_BOOTLOADER_DEFAULT_BLOCK_SIZE + APP_BOOTLOADER_DELTA_OPS_MARGIN]; /* Decompressed op stream of a patch block */
+static uint8_t dl_base_window[APP_BOOTLOADER_DEFAULT_BLOCK_SIZE]; /* Base range read by a patch block, so the SPI flash is read once per block */
+
 /* The application will have the available partitions, we save the offset, maximum size and partition number or ID*/
 static const app_bootloader_partition_t partition_array[] =
 {
@@ -93,14 +189,21 @@ static const app_bootloader_partition_t partition_array[] =
 static delay_t frame_timeout;
 #define APP_BOOTLOADER_FRAME_TIMEOUT (1000) /* milliseconds */
 
+static bool listen_pending = false; /* No host seen yet, active slot is booted once 'listen_timeout' expires */
+static delay_t listen_timeout;
+/* Time a host has to show up on console after reset. 0 always waits for a host */
+#define APP_BOOTLOADER_LISTEN_WINDOW (50) /* milliseconds */
+
+static uint32_t console_baudrate = CONSOLE_UART_BAUDRATE; /* Current console rate */
+static uint32_t baud_next = 0; /* Rate accepted in last response, applied once the response is out. 0 if none */
+static uint32_t baud_fallback = 0; /* Rate to go back to if the host probe does not arrive. 0 if not waiting a probe */
+static delay_t baud_timeout; /* Probe timeout while 'baud_fallback' is set, idle timeout otherwise */
+#define APP_BOOTLOADER_BAUD_PROBE_TIMEOUT (500) /* milliseconds */
+/* Without frames for this long at a negotiated rate, we go back to CONSOLE_UART_BAUDRATE where a new host starts */
+#define APP_BOOTLOADER_BAUD_IDLE_TIMEOUT (10000) /* milliseconds */
+
 #define partition_array_size (sizeof(partition_array)/sizeof(partition_array[0]))
 
-/**
- * @brief Verify and boot from a MCU flash address.
- *
- * @param boot_address Application address.
- */
-static void bootloader_boot(uint32_t boot_address);
 /**
  * @brief Get a partition size.
  *
@@ -132,6 +235,14 @@ static inline volatile app_bootloader_state_t app_bootloader_get_state(void);
  *
  */
 static inline void app_bootlaoder_clean_buffer(void);
+/**
+ * @brief Switch console baud rate. Whatever was received at the previous rate is dropped.
+ *
+ * @param baudrate Baud rate.
+ * @return
+ * 			- APP_BOOTLOADER_OK if no error.
+ */
+static int app_bootloader_set_baudrate(uint32_t baudrate);
 /**
  * @brief Send bootloader frame through console.
  *
@@ -140,24 +251,291 @@ static inline void app_bootlaoder_clean_buffer(void);
  * 			- APP_BOOTLOADER_CMD_OK if no error.
  */
 static int app_bootloader_send_frame(app_bootloader_build_res_t * build_digest);
-
-static void bootloader_boot(uint32_t boot_address)
-{
-	uint32_t jump_address;
-	jump_function jump_to_app = NULL;
-	if(((*(uint32_t *) boot_address) & (0x2FF00000)) == 0x20000000)
-	{
-		print_serial_info("Application found! Jumping in 0x%x", boot_address);
-		jump_address = *((volatile uint32_t *)(boot_address + 4));
-		jump_to_app = (jump_function) jump_address;
-		__set_MSP(*(uint32_t *) boot_address);
-		jump_to_app();
-	}
-	else
-	{
-		print_serial_warn("No application found in 0x%x", boot_address);
-	}
-}
+/**
+ * @brief Get the size of the complete frame at the beginning of bootloader buffer.
+ *
+ * @return Frame size. 0 if there is no complete frame yet.
+ */
+static uint16_t app_bootloader_get_frame_size(void);
+/**
+ * @brief Ask the host to send again what it sent last. In a windowed download the acknowledge already
+ * tells the host which blocks to resend.
+ *
+ */
+static void app_bootloader_request_retransmit(void);
+/**
+ * @brief Remove a processed frame from the beginning of bootloader buffer.
+ *
+ * @param frame_size Processed frame size.
+ */
+static void app_bootloader_consume_frame(uint16_t frame_size);
+/**
+ * @brief Check if a windowed download is in progress.
+ *
+ * @return true: windowed download in progress. false: otherwise.
+ */
+static inline bool app_bootloader_dl_window_active(void);
+/**
+ * @brief Write partition header and build end command once the download is complete.
+ *
+ * @param build_digest Build result.
+ * @return
+ * 			- APP_BOOTLOADER_CMD_OK if no error.
+ */
+static int app_bootloader_dl_end(app_bootloader_build_res_t * build_digest);
+/**
+ * @brief Commit a block received in windowed download. Blocks out of window or already committed are dropped.
+ *
+ * @param dl_block_res Received block.
+ * @param build_digest Build result. Only set when an error happens or download ends.
+ * @return
+ * 			- APP_BOOTLOADER_CMD_OK if no error.
+ */
+static int app_bootloader_dl_window_block(app_bootloader_cmd_dl_block_res * dl_block_res, app_bootloader_build_res_t * build_digest);
+/**
+ * @brief Start an image digest.
+ *
+ * @param digest Image digest.
+ */
+static void app_bootloader_digest_init(app_bootloader_digest_t * digest);
+/**
+ * @brief Feed image data into a digest.
+ *
+ * @param digest Image digest.
+ * @param data Data.
+ * @param size Data size.
+ */
+static void app_bootloader_digest_update(app_bootloader_digest_t * digest, const uint8_t * data, uint32_t size);
+/**
+ * @brief Finish an image digest.
+ *
+ * @param digest Image digest.
+ * @param crc32 Where the CRC-32 is saved.
+ * @param sha256 Buffer of APP_BOOTLOADER_SHA256_SIZE where the SHA-256 is saved.
+ */
+static void app_bootloader_digest_final(app_bootloader_digest_t * digest, uint32_t * crc32, uint8_t * sha256);
+/**
+ * @brief Feed a received block into the download digest if it is the next one in order.
+ *
+ * @param block_nbr Block number.
+ * @param data Block data.
+ * @param size Block size.
+ */
+static void app_bootloader_dl_digest_block(uint32_t block_nbr, const uint8_t * data, uint32_t size);
+/**
+ * @brief Feed into the download digest the blocks committed out of order, once the window slid over them.
+ * They are read back from SPI flash. It only happens after a lost block.
+ *
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ */
+static int app_bootloader_dl_digest_catch_up(void);
+/**
+ * @brief Asynchronous program complete callback. Releases the oldest program buffer.
+ *
+ * @param result SPI_FLASH_OK if no error.
+ * @param arg Program buffer.
+ */
+static void app_bootloader_program_cplt(int result, void * arg);
+/**
+ * @brief Asynchronous erase complete callback.
+ *
+ * @param result SPI_FLASH_OK if no error.
+ * @param arg Not used.
+ */
+static void app_bootloader_erase_cplt(int result, void * arg);
+/**
+ * @brief Progress record write complete callback. A record that could not be written disables resume.
+ *
+ * @param result SPI_FLASH_OK if no error.
+ * @param arg Not used.
+ */
+static void app_bootloader_dl_progress_cplt(int result, void * arg);
+/**
+ * @brief Advance SPI flash asynchronous operations and queue the oldest pending block once the previous one is programmed.
+ *
+ * @return
+ * 			- SPI_FLASH_OK if no error or nothing to program.
+ */
+static int app_bootloader_program_run(void);
+/**
+ * @brief Program every pending block into SPI flash and wait until the SPI flash queue is empty.
+ *
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ */
+static int app_bootloader_program_flush(void);
+/**
+ * @brief Get the next free program buffer. If every buffer is busy, the oldest one is programmed first.
+ *
+ * @param block Where the free program buffer is saved.
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ */
+static int app_bootloader_program_acquire(app_bootloader_program_buffer_t ** block);
+/**
+ * @brief Queue for programming the buffer got from app_bootloader_program_acquire.
+ *
+ * @param address SPI flash address.
+ * @param size Data size.
+ */
+static void app_bootloader_program_commit(uint32_t address, uint32_t size);
+/**
+ * @brief Fill a program buffer with a received block and queue it. Compressed blocks are decompressed straight
+ * into the program buffer.
+ *
+ * @param dl_block_res Received block.
+ * @return
+ * 			- APP_BOOTLOADER_OK if no error.
+ * 			- APP_BOOTLOADER_E_INVALID if block is not valid. Nothing is queued, it must be received again.
+ * 			- APP_BOOTLOADER_E_UNKNOWN if SPI flash failed.
+ */
+static int app_bootloader_dl_block_enqueue(app_bootloader_cmd_dl_block_res * dl_block_res);
+/**
+ * @brief Check the base partition of a delta download against the parameter response and save it.
+ *
+ * @param command_digest Download parameter response.
+ * @param build_digest Build result. Only set when an error happens.
+ * @return
+ * 			- 0 if no error. Otherwise error frame is built in 'build_digest'.
+ */
+static int app_bootloader_dl_set_base(app_bootloader_frame_t * command_digest, app_bootloader_build_res_t * build_digest);
+/**
+ * @brief Look for the progress record of an interrupted download of the same image.
+ *
+ * @param partition_nbr Partition number.
+ * @param size Image size.
+ * @param image_crc32 Image CRC-32.
+ * @return Leading blocks already programmed. 0 if there is nothing to resume.
+ */
+static uint32_t app_bootloader_dl_find_progress(uint8_t partition_nbr, uint32_t size, uint32_t image_crc32);
+/**
+ * @brief Queue a new progress record write into the header page of the partition being downloaded. It runs once
+ * the page erase queued before completes.
+ *
+ * @param command_digest Download parameter response.
+ */
+static void app_bootloader_dl_start_progress(app_bootloader_frame_t * command_digest);
+/**
+ * @brief Record the blocks programmed in order since last time. Only called while SPI flash is idle.
+ *
+ */
+static void app_bootloader_dl_save_progress(void);
+/**
+ * @brief Queue the erase of the partition being downloaded up to 'end', if not done yet. Blocks programmed there are
+ * queued after it. Aligned 64 KiB blocks are used when the image fills enough of them to be faster than sectors, so
+ * little past the image end is erased.
+ *
+ * @param end Partition offset the erase must reach.
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ */
+static int app_bootloader_dl_erase_until(uint32_t end);
+/**
+ * @brief Read base image bytes for a patch block. The read suspends the erase or program going on.
+ *
+ * @param offset Offset inside the base image.
+ * @param buffer Where bytes are read.
+ * @param size Size to read.
+ * @param arg Not used.
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ */
+static int app_bootloader_dl_base_read(uint32_t offset, uint8_t * buffer, uint32_t size, void * arg);
+/**
+ * @brief Print SPI flash busy wait instrumentation of page programs and erases.
+ *
+ */
+static void app_bootloader_print_busy_stats(void);
+/**
+ * @brief Wait until SPI flash queue is empty and drop every pending block.
+ *
+ */
+static void app_bootloader_program_reset(void);
+/**
+ * @brief Install read complete callback.
+ *
+ * @param result SPI_FLASH_OK if no error.
+ * @param arg Not used.
+ */
+static void app_bootloader_install_read_cplt(int result, void * arg);
+/**
+ * @brief Compare a SPI flash range against internal flash.
+ *
+ * @param offset SPI flash offset.
+ * @param address Internal flash address.
+ * @param size Size to compare.
+ * @param buffer Two work buffers of one block each.
+ * @param identical Set if internal flash already holds the same content.
+ * @param blank Set if internal flash range is erased.
+ * @param verify Image digest. Only fed if the range is identical, otherwise it is fed when programmed. Can be NULL.
+ * @return
+ * 			- SPI_FLASH_OK if no error.
+ */
+static int app_bootloader_install_compare(uint32_t offset, uint32_t address, uint32_t size, uint8_t * buffer[2], bool * identical, bool * blank, app_bootloader_digest_t * verify);
+/**
+ * @brief Copy a SPI flash range into internal flash. Internal flash range must be erased before.
+ *
+ * @param offset SPI flash offset.
+ * @param address Internal flash address.
+ * @param size Size to copy.
+ * @param buffer Two work buffers of one block each.
+ * @param verify Image digest fed with every chunk read. Can be NULL.
+ * @param build_digest Build result. Only set when an error happens.
+ * @return
+ * 			- 0 if no error. Otherwise error frame is built in 'build_digest'.
+ */
+static int app_bootloader_install_program(uint32_t offset, uint32_t address, uint32_t size, uint8_t * buffer[2], app_bootloader_digest_t * verify, app_bootloader_build_res_t * build_digest);
+/**
+ * @brief Install an application from SPI flash into internal flash. Only sectors covered by the image are touched,
+ * sectors already holding the same content are skipped and blank ones are not erased.
+ *
+ * @param offset SPI flash offset of the application.
+ * @param size Application size.
+ * @param buffer Two work buffers of one block each.
+ * @param verify Image digest fed with the whole image as it is read, so checking it costs no extra SPI flash pass. Can be NULL.
+ * @param build_digest Build result. Only set when an error happens.
+ * @return
+ * 			- 0 if no error. Otherwise error frame is built in 'build_digest'.
+ */
+static int app_bootloader_install(uint32_t offset, uint32_t size, uint8_t * buffer[2], app_bootloader_digest_t * verify, app_bootloader_build_res_t * build_digest);
+/**
+ * @brief Load an application linked to run from the SRAM application region straight from SPI flash into it.
+ * Internal flash is not touched.
+ *
+ * @param offset SPI flash offset of the application.
+ * @param size Application size.
+ * @param verify Image digest fed with the loaded image. Can be NULL.
+ * @param build_digest Build result. Only set when an error happens.
+ * @return
+ * 			- 0 if no error. Otherwise error frame is built in 'build_digest'.
+ */
+static int app_bootloader_load_ram(uint32_t offset, uint32_t size, app_bootloader_digest_t * verify, app_bootloader_build_res_t * build_digest);
+/**
+ * @brief Check a partition and get its image ready to run: loaded into RAM, or installed into internal flash
+ * unless boot control says it already is. Installed partitions become the active slot.
+ *
+ * @param partition_nbr Partition number.
+ * @param ram_boot Load into the SRAM application region instead of installing.
+ * @param build_digest Build result. Only set when an error happens.
+ * @return
+ * 			- 0 if image is ready at APP_ADDR, or APP_BOOTLOADER_RAM_APP_BASE with 'ram_boot'. Otherwise error frame is built in 'build_digest'.
+ */
+static int app_bootloader_boot_prepare(uint8_t partition_nbr, bool ram_boot, app_bootloader_build_res_t * build_digest);
+/**
+ * @brief Boot the slot chosen by boot control when no host showed up in the listen window.
+ * Only returns if there is nothing to boot or it can not be booted.
+ *
+ */
+static void app_bootloader_autoboot(void);
+/**
+ * @brief Fill the handoff area and jump to an application. Only returns if no application is found.
+ *
+ * @param address Application vector table address.
+ * @param partition_nbr Partition the application comes from.
+ * @param reason Why it is booted.
+ */
+static void app_bootloader_boot(uint32_t address, uint8_t partition_nbr, app_bootloader_handoff_reason_t reason);
 
 static uint32_t app_bootloader_get_partition_size(uint8_t partition_number)
 {
@@ -203,239 +581,1169 @@ static inline void app_bootlaoder_clean_buffer(void)
 	app_bootloader_recv = 0;
 }
 
+static int app_bootloader_set_baudrate(uint32_t baudrate)
+{
+	int rt = console_set_baudrate(baudrate);
+	if(rt != 0)
+	{
+		print_serial_error("Error setting baud rate %u", baudrate);
+		return rt;
+	}
+	console_baudrate = baudrate;
+	app_bootlaoder_clean_buffer();
+	return APP_BOOTLOADER_OK;
+}
+
 static int app_bootloader_send_frame(app_bootloader_build_res_t * build_digest)
 {
 	int err = APP_BOOTLOADER_CMD_E_NULL;
 	if(build_digest == NULL) return err;
 	if(build_digest->frame)
 	{
+		uint32_t tick = delay_get_tick();
 		err = console_send_data(build_digest->frame, build_digest->frame_size);
+		/* Payload is referenced by the build result, send it right after the header */
+		if(err == 0 && build_digest->payload != NULL)
+			err = console_send_data((uint8_t *)build_digest->payload, build_digest->payload_size);
+		if(err == 0 && build_digest->trailer_size != 0)
+			err = console_send_data(build_digest->trailer, build_digest->trailer_size);
 		if(err != 0)
 			print_serial_error("Error sending through console");
-	}
 
-	if(build_digest->frame)
-		free((void *)build_digest->frame);
+		dl_stats.send_ms += delay_get_tick() - tick;
+		app_bootloader_frame_t * frame = (app_bootloader_frame_t *) build_digest->frame;
+		if(frame->command == APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_REQ || frame->command == APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_ACK)
+			dl_wait_tick = delay_get_tick();
+	}
 	return err;
 }
 
-static int app_bootloader_process_command(app_bootloader_frame_t * command_digest, app_bootloader_build_res_t * build_digest)
+static void app_bootloader_install_read_cplt(int result, void * arg)
 {
-	int rt =  APP_BOOTLOADER_OK;
-	uint8_t * buffer = NULL;
-	switch((app_bootloader_command)command_digest->command)
+	install_read_result = result;
+	install_read_done = true;
+}
+
+static int app_bootloader_install_compare(uint32_t offset, uint32_t address, uint32_t size, uint8_t * buffer[2], bool * identical, bool * blank, app_bootloader_digest_t * verify)
+{
+	*identical = true;
+	*blank = true;
+	/* Comparison may stop early, digest only moves on if the whole range is identical and will not be read again */
+	app_bootloader_digest_t candidate;
+	if(verify != NULL)
+		candidate = *verify;
+
+	for(uint32_t done = 0; done < size && (*identical || *blank); )
 	{
-		case APP_BOOTLOADER_CMD_HOST_HELLO:
+		uint32_t chunk_size = size - done;
+		if(chunk_size > APP_BOOTLOADER_DEFAULT_BLOCK_SIZE)
+			chunk_size = APP_BOOTLOADER_DEFAULT_BLOCK_SIZE;
+
+		int rt = spi_flash_read(buffer[0], offset + done, chunk_size);
+		if(rt != SPI_FLASH_OK)
+			return rt;
+
+		uint8_t * flash = buffer[1];
+		if(app_bootloader_flash_read(address + done, flash, chunk_size) != APP_BOOTLOADER_FLASH_OK)
+			return SPI_FLASH_E_PARAM;
+		if(*identical && memcmp(flash, buffer[0], chunk_size) != 0)
+			*identical = false;
+		if(*identical && verify != NULL)
+			app_bootloader_digest_update(&candidate, buffer[0], chunk_size);
+		for(uint32_t i = 0; *blank && i < chunk_size; i++)
 		{
-			print_serial_info("Received host hello");
-			rt = app_bootloader_build_hello(build_digest);
-			app_bootloader_set_state(APP_BOOTLOADER_STATE_READY);
-			break;
+			if(flash[i] != 0xFF)
+				*blank = false;
 		}
-		case APP_BOOTLOADER_CMD_DOWNLOAD_REQ:
+		done += chunk_size;
+	}
+
+	if(*identical && verify != NULL)
+		*verify = candidate;
+	return SPI_FLASH_OK;
+}
+
+static int app_bootloader_install(uint32_t offset, uint32_t size, uint8_t * buffer[2], app_bootloader_digest_t * verify, app_bootloader_build_res_t * build_digest)
+{
+	uint32_t done = 0;
+	while(done < size)
+	{
+		app_bootloader_flash_sector_t sector = {0};
+		if(app_bootloader_flash_get_sector(APP_ADDR + done, &sector) != APP_BOOTLOADER_FLASH_OK)
 		{
-			print_serial_info("Download request received");
-			/* Our download only allows raw type for now */
-			app_bootloader_cmd_dl_req * dl_req = (app_bootloader_cmd_dl_req *)command_digest->data;
+			app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Image does not fit in MCU flash");
+			return -1;
+		}
 
-			uint32_t size = app_bootloader_get_partition_size(dl_req->part_nbr);
-			if(size == 0)
-			{
-				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_UNKNOWN, "Not declared partition");
-				break;
-			}
-			if(size < dl_req->binary_size)
-			{
-				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_SIZE, "File does not fit in partition");
-				break;
-			}
+		uint32_t chunk_size = sector.address + sector.size - (APP_ADDR + done);
+		if(chunk_size > size - done)
+			chunk_size = size - done;
 
-			app_bootloader.dl_status.total_size = dl_req->binary_size;
-			app_bootloader.dl_status.partition_nbr = dl_req->part_nbr;
+		bool identical = false;
+		bool blank = false;
+		if(app_bootloader_install_compare(offset + done, APP_ADDR + done, chunk_size, buffer, &identical, &blank, verify) != SPI_FLASH_OK)
+		{
+			app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Error reading SPI flash");
+			return -1;
+		}
 
-			rt = app_bootloader_build_dl_param_req(build_digest, APP_BOOTLOADER_DEFAULT_DL_TYPE, APP_BOOTLOADER_DEFAULT_BLOCK_SIZE);
-			break;
+		if(identical)
+		{
+			print_serial_info("Sector %u already up to date", sector.nbr);
+			done += chunk_size;
+			continue;
 		}
-		case APP_BOOTLOADER_CMD_DOWNLOAD_PARAM_RES:
+
+		if(!blank)
 		{
-			print_serial_info("Download parameter response received");
-			app_bootloader_cmd_dl_param_res * dl_param_res =  (app_bootloader_cmd_dl_param_res *)command_digest->data;
+			if(app_bootloader_flash_erase_sector(&sector) != APP_BOOTLOADER_FLASH_OK)
+			{
+				print_serial_warn("Error erasing sector %u", sector.nbr);
+				app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Can not erase MCU application partition");
+				return -1;
+			}
+		}
 
-			uint32_t partition_size = app_bootloader_get_partition_size(app_bootloader.dl_status.partition_nbr);
-			uint32_t partition_offset = app_bootloader_get_partition_offset(app_bootloader.dl_status.partition_nbr);
+		print_serial_info("Programming sector %u", sector.nbr);
+		if(app_bootloader_install_program(offset + done, APP_ADDR + done, chunk_size, buffer, verify, build_digest) != 0)
+			return -1;
 
-			app_bootloader.dl_status.dl_type = dl_param_res->type;
-			app_bootloader.dl_status.block_size = dl_param_res->block_size;
-			app_bootloader.dl_status.total_block_nbr = dl_param_res->total_block_nbr;
-			app_bootloader.dl_status.actual_block_nbr = 0;
-			app_bootloader.dl_status.actual_size = 0;
+		done += chunk_size;
+	}
+	return 0;
+}
 
-			rt = spi_flash_erase_range(partition_offset, partition_size);
-			if(rt != SPI_FLASH_OK)
-			{
-				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error erasing partition");
-				break;
-			}
+static int app_bootloader_load_ram(uint32_t offset, uint32_t size, app_bootloader_digest_t * verify, app_bootloader_build_res_t * build_digest)
+{
+	if(size > APP_BOOTLOADER_RAM_APP_SIZE)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Image does not fit in RAM");
+		return -1;
+	}
 
-			rt = app_bootloader_build_dl_block_req(build_digest, app_bootloader.dl_status.actual_block_nbr);
-			break;
-		}
-		case APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_RES:
-		{
-			print_serial_info("Download block response received");
+	/* Image must be linked at the region, its reset handler is checked before anything is overwritten */
+	uint32_t vector[2] = {0};
+	if(spi_flash_read((uint8_t *)vector, offset, sizeof(vector)) != SPI_FLASH_OK)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Error reading SPI flash");
+		return -1;
+	}
 
-			app_bootloader_cmd_dl_block_res * dl_block_res =  (app_bootloader_cmd_dl_block_res *)command_digest->data;
-			int address = app_bootloader_get_partition_offset(app_bootloader.dl_status.partition_nbr);
-			/* We reserve the first page of a partition for partition info like flags, size, etc. This will become
-			 * useful when selecting and booting a saved in flash application */
-			uint32_t offset = address + APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE;
+	uint8_t * ram = app_bootloader_arch_ram_app_map(APP_BOOTLOADER_RAM_APP_BASE, size);
+	uint32_t reset_handler = vector[1] & ~1UL;
+	if(ram == NULL || reset_handler < APP_BOOTLOADER_RAM_APP_BASE || reset_handler >= APP_BOOTLOADER_RAM_APP_BASE + size)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Image is not linked to run from RAM");
+		return -1;
+	}
+
+	if(spi_flash_read(ram, offset, size) != SPI_FLASH_OK)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Error reading SPI flash");
+		return -1;
+	}
+	if(verify != NULL)
+		app_bootloader_digest_update(verify, ram, size);
+	return 0;
+}
+
+static int app_bootloader_install_program(uint32_t offset, uint32_t address, uint32_t size, uint8_t * buffer[2], app_bootloader_digest_t * verify, app_bootloader_build_res_t * build_digest)
+{
+	uint8_t ** chunk = buffer;
+	uint8_t actual = 0;
+	uint32_t done = 0;
 
-			/*Todo: Check data size arrived */
+	uint32_t chunk_size = (size < APP_BOOTLOADER_DEFAULT_BLOCK_SIZE)? size : APP_BOOTLOADER_DEFAULT_BLOCK_SIZE;
+	if(spi_flash_read(chunk[actual], offset, chunk_size) != SPI_FLASH_OK)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Error reading SPI flash");
+		return -1;
+	}
 
-			rt = spi_flash_write(dl_block_res->data, offset + app_bootloader.dl_status.actual_size, dl_block_res->data_size);
-			if(rt != SPI_FLASH_OK)
+	while(done < size)
+	{
+		uint32_t next = done + chunk_size;
+		uint32_t next_size = size - next;
+		if(next_size > APP_BOOTLOADER_DEFAULT_BLOCK_SIZE)
+			next_size = APP_BOOTLOADER_DEFAULT_BLOCK_SIZE;
+
+		install_read_done = true;
+		if(next_size)
+		{
+			install_read_done = false;
+			if(spi_flash_read_async(chunk[actual ^ 1], offset + next, next_size, app_bootloader_install_read_cplt, NULL) != SPI_FLASH_OK)
 			{
-				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error writing into flash");
-				break;
+				app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Error reading SPI flash");
+				return -1;
 			}
-			else
-			{
-				app_bootloader.dl_status.actual_block_nbr++;
-				app_bootloader.dl_status.actual_size += dl_block_res->data_size;
-				print_serial_info("Download status [%u/%u][%d/%d]", app_bootloader.dl_status.total_size, app_bootloader.dl_status.actual_size, app_bootloader.dl_status.total_block_nbr, app_bootloader.dl_status.actual_block_nbr);
+		}
 
-				if(app_bootloader.dl_status.actual_block_nbr == app_bootloader.dl_status.total_block_nbr)
-				{
-					app_bootloader_partition_info_t partition_info = {
-							.magic_byte = APP_BOOTLOADER_PARTITION_MAGIC_BYTE,
-							.size = app_bootloader.dl_status.total_size,
-							.flag = APP_BOOTLOADER_PARTITION_FLAG_COMPLETE,
-					};
-
-					uint32_t partition_offset = app_bootloader_get_partition_offset(app_bootloader.dl_status.partition_nbr);
-					rt = spi_flash_write((uint8_t *)&partition_info, partition_offset, sizeof(partition_info));
-					if(rt != SPI_FLASH_OK)
-					{
-						rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error updating partition header");
-						break;
-					}
-
-					rt = app_bootloader_build_end(build_digest);
-				}
-				else
-				{
-					rt = app_bootloader_build_dl_block_req(build_digest, app_bootloader.dl_status.actual_block_nbr);
-				}
-			}
+		int err = app_bootloader_flash_program(address + done, chunk[actual], chunk_size);
+		/* Hashing also overlaps the read of the next chunk */
+		if(verify != NULL)
+			app_bootloader_digest_update(verify, chunk[actual], chunk_size);
+
+		/* DMA writes into the other chunk, it must end before leaving */
+		while(!install_read_done)
+			spi_flash_process();
+
+		if(err != APP_BOOTLOADER_FLASH_OK)
+		{
+			print_serial_error("Program return error %d", err);
+			app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Problem writing new program");
+			return -1;
+		}
+		if(install_read_result != SPI_FLASH_OK)
+		{
+			app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Error reading SPI flash");
+			return -1;
+		}
+
+		done = next;
+		chunk_size = next_size;
+		actual ^= 1;
+	}
+	return 0;
+}
+
+static void app_bootloader_digest_init(app_bootloader_digest_t * digest)
+{
+	app_bootloader_crc32_init(&digest->crc32);
+	app_bootloader_sha256_init(&digest->sha256);
+}
+
+static void app_bootloader_digest_update(app_bootloader_digest_t * digest, const uint8_t * data, uint32_t size)
+{
+	app_bootloader_crc32_update(&digest->crc32, data, size);
+	app_bootloader_sha256_update(&digest->sha256, data, size);
+}
+
+static void app_bootloader_digest_final(app_bootloader_digest_t * digest, uint32_t * crc32, uint8_t * sha256)
+{
+	*crc32 = app_bootloader_crc32_final(&digest->crc32);
+	app_bootloader_sha256_final(&digest->sha256, sha256);
+}
+
+static void app_bootloader_dl_digest_block(uint32_t block_nbr, const uint8_t * data, uint32_t size)
+{
+	if(block_nbr != dl_digest_block_nbr)
+		return;
+	app_bootloader_digest_update(&dl_digest, data, size);
+	dl_digest_block_nbr++;
+}
+
+static int app_bootloader_dl_digest_catch_up(void)
+{
+	volatile app_bootloader_dl_t * dl_status = &app_bootloader.dl_status;
+	if(dl_digest_block_nbr >= dl_status->window_base)
+		return SPI_FLASH_OK;
+
+	/* Blocks must be in SPI flash before reading them back. Program buffers are free afterwards */
+	int rt = app_bootloader_program_flush();
+	if(rt != SPI_FLASH_OK)
+		return rt;
+
+	uint8_t * buffer = program_buffer[program_buffer_head].data;
+	uint32_t offset = app_bootloader_get_partition_offset(dl_status->partition_nbr) + APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE;
+	while(dl_digest_block_nbr < dl_status->window_base)
+	{
+		uint32_t block_offset = dl_digest_block_nbr * dl_status->block_size;
+		uint32_t size = dl_status->total_size - block_offset;
+		if(size > dl_status->block_size)
+			size = dl_status->block_size;
+
+		rt = spi_flash_read(buffer, offset + block_offset, size);
+		if(rt != SPI_FLASH_OK)
+			return rt;
+		app_bootloader_digest_update(&dl_digest, buffer, size);
+		dl_digest_block_nbr++;
+	}
+	return SPI_FLASH_OK;
+}
+
+static void app_bootloader_program_cplt(int result, void * arg)
+{
+	app_bootloader_program_buffer_t * block = (app_bootloader_program_buffer_t *) arg;
+	dl_stats.program_ms += delay_get_tick() - block->start_tick;
+
+	block->in_flight = false;
+	block->pending = false;
+	program_buffer_tail = (program_buffer_tail + 1) % APP_BOOTLOADER_PROGRAM_BUFFER_NBR;
+	if(result != SPI_FLASH_OK)
+		program_error = result;
+	else
+		program_progress_block_nbr = block->progress_block_nbr;
+}
+
+static void app_bootloader_erase_cplt(int result, void * arg)
+{
+	/* Erases queued together run back to back, each one is counted from the end of the previous */
+	uint32_t tick = delay_get_tick();
+	dl_stats.erase_ms += tick - erase_tick;
+	erase_tick = tick;
+	erase_pending_nbr--;
+	if(result != SPI_FLASH_OK)
+		program_error = result;
+}
+
+static void app_bootloader_dl_progress_cplt(int result, void * arg)
+{
+	if(result == SPI_FLASH_OK)
+		return;
+	print_serial_warn("Error saving download progress, download will not resume");
+	app_bootloader.dl_status.resumable = false;
+}
+
+static int app_bootloader_program_run(void)
+{
+	int flash_rt = spi_flash_process();
+	if(program_error != SPI_FLASH_OK)
+	{
+		int rt = program_error;
+		program_error = SPI_FLASH_OK;
+		return rt;
+	}
+
+	app_bootloader_program_buffer_t * block = &program_buffer[program_buffer_tail];
+	if(block->in_flight)
+		return SPI_FLASH_OK;
+
+	/* Flash is idle between two blocks, record what is already programmed */
+	if(flash_rt == SPI_FLASH_OK)
+		app_bootloader_dl_save_progress();
+	if(!block->pending)
+		return SPI_FLASH_OK;
+
+	/* Pages are sent by DMA straight from the program buffer, UART frames keep being parsed meanwhile.
+	 * The block waits in the SPI flash queue behind the erase of its region */
+	block->start_tick = delay_get_tick();
+	block->in_flight = true;
+	int rt = spi_flash_submit(SPI_FLASH_JOB_WRITE, block->data, block->address, block->size, app_bootloader_program_cplt, block);
+	if(rt == SPI_FLASH_E_BUSY)
+	{
+		/* Queue is full, try again next time */
+		block->in_flight = false;
+		return SPI_FLASH_OK;
+	}
+	if(rt != SPI_FLASH_OK)
+	{
+		block->in_flight = false;
+		block->pending = false;
+		program_buffer_tail = (program_buffer_tail + 1) % APP_BOOTLOADER_PROGRAM_BUFFER_NBR;
+	}
+	return rt;
+}
+
+static int app_bootloader_program_flush(void)
+{
+	int rt = SPI_FLASH_OK;
+	while(rt == SPI_FLASH_OK && (program_buffer[program_buffer_tail].pending || spi_flash_process() == SPI_FLASH_E_BUSY))
+		rt = app_bootloader_program_run();
+	return rt;
+}
+
+static int app_bootloader_program_acquire(app_bootloader_program_buffer_t ** block)
+{
+	*block = &program_buffer[program_buffer_head];
+	if((*block)->pending)
+	{
+		/* Host is faster than SPI flash. Wait until the oldest block is programmed */
+		dl_stats.program_stall_nbr++;
+		while((*block)->pending)
+		{
+			int rt = app_bootloader_program_run();
+			if(rt != SPI_FLASH_OK)
+				return rt;
+		}
+	}
+	return SPI_FLASH_OK;
+}
+
+static void app_bootloader_program_commit(uint32_t address, uint32_t size)
+{
+	app_bootloader_program_buffer_t * block = &program_buffer[program_buffer_head];
+	block->address = address;
+	block->size = size;
+	block->pending = true;
+	program_buffer_head = (program_buffer_head + 1) % APP_BOOTLOADER_PROGRAM_BUFFER_NBR;
+}
+
+static int app_bootloader_dl_block_enqueue(app_bootloader_cmd_dl_block_res * dl_block_res)
+{
+	volatile app_bootloader_dl_t * dl_status = &app_bootloader.dl_status;
+	uint32_t block_nbr = dl_block_res->block_nbr;
+	if(block_nbr >= dl_status->total_block_nbr)
+		return APP_BOOTLOADER_E_INVALID;
+
+	/* Every block holds 'block_size' bytes of image once decompressed, only the last one is shorter */
+	uint32_t image_offset = block_nbr * dl_status->block_size;
+	uint32_t size = dl_status->total_size - image_offset;
+	if(size > dl_status->block_size)
+		size = dl_status->block_size;
+
+	/* Host sends as is the blocks that do not get smaller */
+	bool encoded = (dl_status->dl_type != APP_BOOTLOADER_DL_RAW && dl_block_res->data_size < size);
+	if(!encoded && dl_block_res->data_size != size)
+		return APP_BOOTLOADER_E_INVALID;
+
+	app_bootloader_program_buffer_t * block = NULL;
+	if(app_bootloader_program_acquire(&block) != SPI_FLASH_OK)
+		return APP_BOOTLOADER_E_UNKNOWN;
+
+	if(encoded && dl_status->dl_type == APP_BOOTLOADER_DL_COMPRESS)
+	{
+		uint32_t decompressed_size = 0;
+		int rt = app_bootloader_lz4_decompress(dl_block_res->data, dl_block_res->data_size, block->data, size, &decompressed_size);
+		if(rt != APP_BOOTLOADER_LZ4_OK || decompressed_size != size)
+		{
+			print_serial_error("Block %u does not decompress", block_nbr);
+			return APP_BOOTLOADER_E_INVALID;
+		}
+	}
+	else if(encoded)
+	{
+		/* Base range of the block is read once into the window, then patched into the program buffer */
+		app_bootloader_delta_base_t base = {.size = dl_status->base_size, .read_cb = app_bootloader_dl_base_read, .arg = NULL,
+					.window = dl_base_window, .window_size = sizeof(dl_base_window)};
+		int rt = app_bootloader_delta_apply(dl_block_res->data, dl_block_res->data_size, block->data, size, &base, dl_patch_buffer, sizeof(dl_patch_buffer));
+		if(rt == APP_BOOTLOADER_DELTA_E_READ)
+			return APP_BOOTLOADER_E_UNKNOWN;
+		if(rt != APP_BOOTLOADER_DELTA_OK)
+		{
+			print_serial_error("Block %u patch does not apply", block_nbr);
+			return APP_BOOTLOADER_E_INVALID;
+		}
+	}
+	else
+		memcpy(block->data, dl_block_res->data, size);
+
+	/* Buffers are programmed in order, so once this one is every block before the first hole is too */
+	block->progress_block_nbr = block_nbr + 1;
+	if(dl_status->window_size > 1)
+	{
+		uint32_t window_bitmap = dl_status->window_bitmap | (1UL << (block_nbr - dl_status->window_base));
+		for(block->progress_block_nbr = dl_status->window_base; window_bitmap & 1; window_bitmap >>= 1)
+			block->progress_block_nbr++;
+	}
+
+	/* Partition is erased as blocks land in it, so erase overlaps with reception */
+	if(app_bootloader_dl_erase_until(APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE + image_offset + size) != SPI_FLASH_OK)
+		return APP_BOOTLOADER_E_UNKNOWN;
+
+	/* Blocks may arrive in any order inside a window, so the address comes from the block number */
+	uint32_t offset = app_bootloader_get_partition_offset(dl_status->partition_nbr) + APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE;
+	app_bootloader_program_commit(offset + image_offset, size);
+	dl_stats.data_size += dl_block_res->data_size;
+	dl_status->actual_block_nbr++;
+	dl_status->actual_size += size;
+	app_bootloader_dl_digest_block(block_nbr, block->data, size);
+	return APP_BOOTLOADER_OK;
+}
+
+static void app_bootloader_program_reset(void)
+{
+	/* DMA reads from the program buffer, it cannot be released while queued */
+	while(spi_flash_process() == SPI_FLASH_E_BUSY);
+	program_error = SPI_FLASH_OK;
+
+	for(uint8_t i = 0; i < APP_BOOTLOADER_PROGRAM_BUFFER_NBR; i++)
+		program_buffer[i].pending = false;
+	program_buffer_head = 0;
+	program_buffer_tail = 0;
+	program_progress_block_nbr = 0;
+}
+
+static int app_bootloader_dl_set_base(app_bootloader_frame_t * command_digest, app_bootloader_build_res_t * build_digest)
+{
+	app_bootloader_cmd_dl_param_res * dl_param_res = (app_bootloader_cmd_dl_param_res *)command_digest->data;
+	if(command_digest->total_length != sizeof(*dl_param_res))
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_PARAM, "Delta download without base");
+		return -1;
+	}
+
+	/* Target partition is erased before the first block, it can not be its own base */
+	int base_offset = app_bootloader_get_partition_offset(dl_param_res->base_partition_nbr);
+	if(base_offset < 0 || dl_param_res->base_partition_nbr == app_bootloader.dl_status.partition_nbr)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Delta base must be another partition");
+		return -1;
+	}
+
+	app_bootloader_partition_info_t base_info = {0};
+	if(spi_flash_read((uint8_t *)&base_info, (uint32_t)base_offset, sizeof(base_info)) != SPI_FLASH_OK)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Error reading SPI flash");
+		return -1;
+	}
+
+	/* Patches only rebuild the image when applied to the exact image they were made from */
+	uint32_t flags = APP_BOOTLOADER_PARTITION_FLAG_COMPLETE | APP_BOOTLOADER_PARTITION_FLAG_DIGEST;
+	if(base_info.magic_byte != APP_BOOTLOADER_PARTITION_MAGIC_BYTE || (base_info.flag & flags) != flags || base_info.crc32 != dl_param_res->base_crc32)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Delta base does not match partition");
+		return -1;
+	}
+
+	app_bootloader.dl_status.base_partition_nbr = dl_param_res->base_partition_nbr;
+	app_bootloader.dl_status.base_size = base_info.size;
+	return 0;
+}
+
+static int app_bootloader_dl_base_read(uint32_t offset, uint8_t * buffer, uint32_t size, void * arg)
+{
+	/* Base is another partition, the read suspends the block being programmed. Only a page DMA transfer makes it wait */
+	uint32_t base_offset = app_bootloader_get_partition_offset(app_bootloader.dl_status.base_partition_nbr) + APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE;
+	int rt = SPI_FLASH_OK;
+	while((rt = spi_flash_read(buffer, base_offset + offset, size)) == SPI_FLASH_E_BUSY)
+		spi_flash_process();
+	return rt;
+}
+
+static int app_bootloader_dl_erase_until(uint32_t end)
+{
+	volatile app_bootloader_dl_t * dl_status = &app_bootloader.dl_status;
+	if(end <= dl_status->erased_size)
+		return SPI_FLASH_OK;
+
+	uint32_t offset = app_bootloader_get_partition_offset(dl_status->partition_nbr);
+	uint32_t partition_size = app_bootloader_get_partition_size(dl_status->partition_nbr);
+	uint32_t image_end = APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE + dl_status->total_size;
+	if(erase_pending_nbr == 0)
+		erase_tick = delay_get_tick();
+	while(dl_status->erased_size < end)
+	{
+		uint32_t size = SPI_FLASH_SECTOR_SIZE;
+		if((offset + dl_status->erased_size) % SPI_FLASH_BLOCK64_SIZE == 0 && dl_status->erased_size + SPI_FLASH_BLOCK64_SIZE <= partition_size
+				&& image_end - dl_status->erased_size >= APP_BOOTLOADER_ERASE_BLOCK64_MIN_SIZE)
+			size = SPI_FLASH_BLOCK64_SIZE;
+
+		int rt = SPI_FLASH_OK;
+		while((rt = spi_flash_submit(SPI_FLASH_JOB_ERASE, NULL, offset + dl_status->erased_size, size, app_bootloader_erase_cplt, NULL)) == SPI_FLASH_E_BUSY)
+			spi_flash_process();
+		if(rt != SPI_FLASH_OK)
+			return rt;
+		erase_pending_nbr++;
+		dl_status->erased_size += size;
+	}
+	return SPI_FLASH_OK;
+}
+
+static uint32_t app_bootloader_dl_find_progress(uint8_t partition_nbr, uint32_t size, uint32_t image_crc32)
+{
+	uint8_t header[APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE] = {0};
+	if(spi_flash_read(header, app_bootloader_get_partition_offset(partition_nbr), sizeof(header)) != SPI_FLASH_OK)
+		return 0;
+
+	/* A complete partition is downloaded again from scratch */
+	app_bootloader_partition_info_t * partition_info = (app_bootloader_partition_info_t *) header;
+	if(partition_info->magic_byte == APP_BOOTLOADER_PARTITION_MAGIC_BYTE)
+		return 0;
+
+	memcpy(&dl_progress, header + APP_BOOTLOADER_PARTITION_PROGRESS_OFFSET, sizeof(dl_progress));
+	if(dl_progress.magic_byte != APP_BOOTLOADER_PARTITION_PROGRESS_MAGIC_BYTE || dl_progress.image_crc32 != image_crc32
+			|| dl_progress.size != size || dl_progress.block_size == 0)
+		return 0;
+
+	uint32_t block_nbr = 0;
+	uint32_t total_block_nbr = (size + dl_progress.block_size - 1) / dl_progress.block_size;
+	while(block_nbr < total_block_nbr && block_nbr < APP_BOOTLOADER_PARTITION_PROGRESS_BLOCK_MAX
+			&& (dl_progress.committed[block_nbr / 8] & (1 << (block_nbr % 8))) == 0)
+		block_nbr++;
+
+	/* Last block is written with the partition info, a download with every block is not interrupted */
+	return (block_nbr < total_block_nbr)? block_nbr : 0;
+}
+
+static void app_bootloader_dl_start_progress(app_bootloader_frame_t * command_digest)
+{
+	volatile app_bootloader_dl_t * dl_status = &app_bootloader.dl_status;
+	app_bootloader_cmd_dl_param_res * dl_param_res = (app_bootloader_cmd_dl_param_res *)command_digest->data;
+
+	memset(&dl_progress, 0xFF, sizeof(dl_progress));
+	dl_progress.magic_byte = APP_BOOTLOADER_PARTITION_PROGRESS_MAGIC_BYTE;
+	dl_progress.image_crc32 = dl_status->image_crc32;
+	dl_progress.size = dl_status->total_size;
+	dl_progress.block_size = dl_status->block_size;
+	dl_progress.dl_type = dl_status->dl_type;
+	if(dl_status->dl_type == APP_BOOTLOADER_DL_DELTA)
+	{
+		dl_progress.base_partition_nbr = dl_param_res->base_partition_nbr;
+		dl_progress.base_crc32 = dl_param_res->base_crc32;
+	}
+
+	/* Bitmap stays erased, bits are cleared as blocks get programmed */
+	uint32_t offset = app_bootloader_get_partition_offset(dl_status->partition_nbr) + APP_BOOTLOADER_PARTITION_PROGRESS_OFFSET;
+	dl_status->saved_block_nbr = 0;
+	dl_status->resumable = true;
+	if(spi_flash_submit(SPI_FLASH_JOB_WRITE, (uint8_t *)&dl_progress, offset, offsetof(app_bootloader_partition_progress_t, committed), app_bootloader_dl_progress_cplt, NULL) != SPI_FLASH_OK)
+		app_bootloader_dl_progress_cplt(SPI_FLASH_E_FAIL, NULL);
+}
+
+static void app_bootloader_dl_save_progress(void)
+{
+	volatile app_bootloader_dl_t * dl_status = &app_bootloader.dl_status;
+	if(!dl_status->resumable)
+		return;
+
+	uint32_t block_nbr = program_progress_block_nbr;
+	if(block_nbr > APP_BOOTLOADER_PARTITION_PROGRESS_BLOCK_MAX)
+		block_nbr = APP_BOOTLOADER_PARTITION_PROGRESS_BLOCK_MAX;
+	if(block_nbr <= dl_status->saved_block_nbr)
+		return;
+
+	for(uint32_t i = dl_status->saved_block_nbr; i < block_nbr; i++)
+		dl_progress.committed[i / 8] &= ~(1 << (i % 8));
+
+	/* Only the bitmap bytes that changed are programmed again */
+	uint32_t first = dl_status->saved_block_nbr / 8;
+	uint32_t last = (block_nbr - 1) / 8;
+	uint32_t offset = app_bootloader_get_partition_offset(dl_status->partition_nbr) + APP_BOOTLOADER_PARTITION_PROGRESS_OFFSET;
+	offset += offsetof(app_bootloader_partition_progress_t, committed) + first;
+	if(spi_flash_write(&dl_progress.committed[first], offset, last - first + 1) != SPI_FLASH_OK)
+	{
+		print_serial_warn("Error saving download progress, download will not resume");
+		dl_status->resumable = false;
+		return;
+	}
+	dl_status->saved_block_nbr = block_nbr;
+}
+
+static uint16_t app_bootloader_get_frame_size(void)
+{
+	if(app_bootloader_recv < sizeof(app_bootloader_frame_t))
+		return 0;
+
+	app_bootloader_frame_t * recv_frame = (app_bootloader_frame_t *) app_bootloader_buffer;
+	uint32_t frame_size = app_bootloader_command_frame_size(recv_frame);
+	if(app_bootloader_recv < frame_size)
+		return 0;
+
+	return (uint16_t)frame_size;
+}
+
+static void app_bootloader_request_retransmit(void)
+{
+	if(app_bootloader_dl_window_active())
+	{
+		app_bootloader.dl_status.ack_pending = true;
+		return;
+	}
+
+	app_bootloader_build_res_t build_digest = {0};
+	if(app_bootloader_build_retransmit(&build_digest) != APP_BOOTLOADER_CMD_OK || app_bootloader_send_frame(&build_digest) != 0)
+		print_serial_error("Error sending retransmit frame");
+}
+
+static void app_bootloader_consume_frame(uint16_t frame_size)
+{
+	app_bootloader_recv -= frame_size;
+	memmove(app_bootloader_buffer, app_bootloader_buffer + frame_size, app_bootloader_recv);
+}
+
+static inline bool app_bootloader_dl_window_active(void)
+{
+	return (app_bootloader.dl_status.window_size > 1 && app_bootloader.dl_status.actual_block_nbr < app_bootloader.dl_status.total_block_nbr);
+}
+
+static void app_bootloader_print_busy_stats(void)
+{
+	static const char * const busy_op_name[SPI_FLASH_BUSY_MAX] =
+	{
+		[SPI_FLASH_BUSY_PAGE_PROGRAM] = "page program",
+		[SPI_FLASH_BUSY_SECTOR_ERASE] = "sector erase",
+		[SPI_FLASH_BUSY_BLOCK32_ERASE] = "32 KiB erase",
+		[SPI_FLASH_BUSY_BLOCK64_ERASE] = "64 KiB erase",
+	};
+
+	for(spi_flash_busy_op_t op = 0; op < SPI_FLASH_BUSY_MAX; op++)
+	{
+		spi_flash_busy_stats_t stats = {0};
+		if(busy_op_name[op] == NULL || spi_flash_get_busy_stats(op, &stats) != SPI_FLASH_OK || stats.op_nbr == 0)
+			continue;
+		print_serial_info("SPI flash %s: %u ops, %u polls, busy %u ms, max %u ms", busy_op_name[op], stats.op_nbr, stats.poll_nbr, stats.busy_ms, stats.busy_max_ms);
+	}
+}
+
+static int app_bootloader_dl_end(app_bootloader_build_res_t * build_digest)
+{
+	/* Header marks the partition as complete, so every block must be in flash before */
+	int rt = app_bootloader_program_flush();
+	if(rt != SPI_FLASH_OK)
+		return app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error writing into flash");
+
+	print_serial_info("Download stats: blocks %u, data %u bytes for %u image bytes, wait %u ms, erase %u ms, program %u ms, send %u ms, stalls %u",
+			dl_stats.block_nbr, dl_stats.data_size, app_bootloader.dl_status.total_size, dl_stats.wait_ms, dl_stats.erase_ms, dl_stats.program_ms, dl_stats.send_ms, dl_stats.program_stall_nbr);
+	app_bootloader_print_busy_stats();
+
+	if(dl_digest_block_nbr != app_bootloader.dl_status.total_block_nbr)
+		return app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Image digest incomplete");
+
+	app_bootloader_partition_info_t partition_info = {
+			.magic_byte = APP_BOOTLOADER_PARTITION_MAGIC_BYTE,
+			.size = app_bootloader.dl_status.total_size,
+			.flag = APP_BOOTLOADER_PARTITION_FLAG_COMPLETE | APP_BOOTLOADER_PARTITION_FLAG_DIGEST,
+	};
+	uint32_t crc32 = 0;
+	app_bootloader_digest_final(&dl_digest, &crc32, partition_info.sha256);
+	partition_info.crc32 = crc32;
+	print_serial_info("Image CRC-32 0x%08x", crc32);
+	app_bootloader.dl_status.resumable = false;
+	if(app_bootloader.dl_status.image_crc32_valid && crc32 != app_bootloader.dl_status.image_crc32)
+		return app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Image CRC-32 does not match host");
+
+	uint32_t partition_offset = app_bootloader_get_partition_offset(app_bootloader.dl_status.partition_nbr);
+	rt = spi_flash_write((uint8_t *)&partition_info, partition_offset, sizeof(partition_info));
+	if(rt != SPI_FLASH_OK)
+		return app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error updating partition header");
+
+	return app_bootloader_build_end(build_digest);
+}
+
+static int app_bootloader_dl_window_block(app_bootloader_cmd_dl_block_res * dl_block_res, app_bootloader_build_res_t * build_digest)
+{
+	volatile app_bootloader_dl_t * dl_status = &app_bootloader.dl_status;
+	uint32_t block_nbr = dl_block_res->block_nbr;
+
+	/* Whatever we drop here, next acknowledge tells the host what we really have */
+	dl_status->ack_pending = true;
+
+	if(block_nbr < dl_status->window_base || block_nbr >= dl_status->window_base + dl_status->window_size)
+		return APP_BOOTLOADER_OK;
+
+	uint32_t window_bit = (1UL << (block_nbr - dl_status->window_base));
+	if(dl_status->window_bitmap & window_bit)
+		return APP_BOOTLOADER_OK;
+
+	int rt = app_bootloader_dl_block_enqueue(dl_block_res);
+	if(rt == APP_BOOTLOADER_E_INVALID)
+		return APP_BOOTLOADER_OK;
+	if(rt != APP_BOOTLOADER_OK)
+	{
+		dl_status->ack_pending = false;
+		return app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error writing into flash");
+	}
+
+	dl_status->window_bitmap |= window_bit;
+
+	/* Slide the window over every consecutive committed block */
+	while(dl_status->window_bitmap & 1)
+	{
+		dl_status->window_bitmap >>= 1;
+		dl_status->window_base++;
+	}
+
+	if(app_bootloader_dl_digest_catch_up() != SPI_FLASH_OK)
+	{
+		dl_status->ack_pending = false;
+		return app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error reading back flash");
+	}
+	print_serial_info("Download status [%u/%u][%d/%d]", dl_status->total_size, dl_status->actual_size, dl_status->total_block_nbr, dl_status->actual_block_nbr);
+
+	if(dl_status->actual_block_nbr == dl_status->total_block_nbr)
+	{
+		dl_status->ack_pending = false;
+		return app_bootloader_dl_end(build_digest);
+	}
+	return APP_BOOTLOADER_OK;
+}
+
+static int app_bootloader_boot_prepare(uint8_t partition_nbr, bool ram_boot, app_bootloader_build_res_t * build_digest)
+{
+	int partition_offset = app_bootloader_get_partition_offset(partition_nbr);
+	if(partition_offset < 0)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Partition does not exist");
+		return -1;
+	}
+
+	print_serial_warn("Trying to boot partition %d at offset %x", partition_nbr, (uint32_t)partition_offset);
+	uint32_t offset = partition_offset + APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE;
+
+	uint8_t header[APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE] = {0};
+	if(spi_flash_read(header, (uint32_t)partition_offset, APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE) != SPI_FLASH_OK)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Error reading SPI flash");
+		return -1;
+	}
+
+	app_bootloader_partition_info_t * partition_info = (app_bootloader_partition_info_t *) header;
+
+	if(partition_info->magic_byte != APP_BOOTLOADER_PARTITION_MAGIC_BYTE)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Invalid partition requested");
+		return -1;
+	}
+	if((partition_info->flag & (APP_BOOTLOADER_PARTITION_FLAG_COMPLETE)) != APP_BOOTLOADER_PARTITION_FLAG_COMPLETE)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Incomplete partition requested");
+		return -1;
+	}
+
+	/* Partitions written before digests existed are installed unverified */
+	bool has_digest = (partition_info->flag & APP_BOOTLOADER_PARTITION_FLAG_DIGEST) != 0;
+
+	/* Image was verified when installed, boot control tells the application region still holds it. Region
+	 * erased behind our back (mass erase by debugger) is installed again */
+	app_bootloader_slot_ctrl_t slot_ctrl = {0};
+	app_bootloader_slot_get(&slot_ctrl);
+	uint32_t stack_pointer = UINT32_MAX;
+	app_bootloader_flash_read(APP_ADDR, (uint8_t *)&stack_pointer, sizeof(stack_pointer));
+	bool installed = (!ram_boot && has_digest && slot_ctrl.installed_slot == partition_nbr && slot_ctrl.installed_crc32 == partition_info->crc32
+			&& stack_pointer != UINT32_MAX);
+
+	/* Two chunks: next one is read from SPI flash while the current one is programmed. Program buffers
+	 * are idle outside a download, blocks of an ongoing one are programmed first */
+	uint8_t * buffer[2] = {program_buffer[0].data, program_buffer[1].data};
+	if(!ram_boot && !installed && app_bootloader_program_flush() != SPI_FLASH_OK)
+	{
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error writing into flash");
+		return -1;
+	}
+
+	app_bootloader_digest_t verify;
+	if(has_digest)
+		app_bootloader_digest_init(&verify);
+	else
+		print_serial_warn("Partition has no digest, image is not verified");
+
+	int err = 0;
+	uint32_t install_start = profile_begin();
+	if(ram_boot)
+	{
+		print_serial_warn("Loading application into RAM at 0x%x", APP_BOOTLOADER_RAM_APP_BASE);
+		err = app_bootloader_load_ram(offset, partition_info->size, has_digest? &verify : NULL, build_digest);
+	}
+	else if(installed)
+	{
+		print_serial_info("Partition %d already installed, nothing to copy", partition_nbr);
+	}
+	else if(app_bootloader_slot_set_installed(APP_BOOTLOADER_SLOT_NONE, 0) != APP_BOOTLOADER_SLOT_OK)
+	{
+		/* An install cut halfway must not be taken as the previous one */
+		app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Can not update boot control");
+		err = -1;
+	}
+	else
+	{
+		print_serial_warn("Starting application programming into flash");
+		err = app_bootloader_install(offset, partition_info->size, buffer, has_digest? &verify : NULL, build_digest);
+	}
+	if(!installed)
+		profile_end(PROFILE_SPAN_INSTALL, ram_boot? APP_BOOTLOADER_BOOT_RAM : APP_BOOTLOADER_BOOT_INSTALL, install_start);
+
+	if(err == 0 && has_digest && !installed)
+	{
+		uint32_t crc32 = 0;
+		uint8_t sha256[APP_BOOTLOADER_SHA256_SIZE] = {0};
+		app_bootloader_digest_final(&verify, &crc32, sha256);
+		if(crc32 != partition_info->crc32 || memcmp(sha256, partition_info->sha256, sizeof(sha256)) != 0)
+		{
+			/* Internal flash or RAM holds what the partition had, do not jump into it */
+			print_serial_error("Image digest mismatch, CRC-32 0x%08x expected 0x%08x", crc32, partition_info->crc32);
+			app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Image digest mismatch");
+			return -1;
+		}
+		if(!ram_boot && app_bootloader_slot_set_installed(partition_nbr, crc32) != APP_BOOTLOADER_SLOT_OK)
+			print_serial_error("Installed partition not recorded, next boot copies it again");
+	}
+	if(err != 0)
+		return -1;
+
+	/* RAM boots are one shot, what boots next stays as it was */
+	if(!ram_boot && app_bootloader_slot_set_active(partition_nbr) != APP_BOOTLOADER_SLOT_OK)
+		print_serial_error("Active partition not recorded");
+	return 0;
+}
+
+static void app_bootloader_autoboot(void)
+{
+	app_bootloader_slot_ctrl_t slot_ctrl = {0};
+	app_bootloader_slot_get(&slot_ctrl);
+	uint8_t slot = 0;
+	int rt = app_bootloader_slot_select(&slot);
+	if(rt != APP_BOOTLOADER_SLOT_OK)
+	{
+		print_serial_warn("No partition to boot on our own (%d), waiting host", rt);
+		return;
+	}
+
+	print_serial_warn("No host, booting partition %d", slot);
+	/* Error frame is only built, nobody is there to receive it */
+	app_bootloader_build_res_t build_digest = {0};
+	if(app_bootloader_boot_prepare(slot, false, &build_digest) != 0)
+	{
+		print_serial_error("Partition %d can not be booted, waiting host", slot);
+		return;
+	}
+	app_bootloader_boot(APP_ADDR, slot, (slot == slot_ctrl.active_slot)? APP_BOOTLOADER_HANDOFF_REASON_AUTO : APP_BOOTLOADER_HANDOFF_REASON_FALLBACK);
+	print_serial_error("Partition %d did not start, waiting host", slot);
+}
+
+static void app_bootloader_boot(uint32_t address, uint8_t partition_nbr, app_bootloader_handoff_reason_t reason)
+{
+	app_bootloader_slot_ctrl_t slot_ctrl = {0};
+	app_bootloader_slot_get(&slot_ctrl);
+
+	app_bootloader_handoff_t * handoff = app_bootloader_arch_handoff();
+	memset(handoff, 0, sizeof(*handoff));
+	handoff->magic = APP_BOOTLOADER_HANDOFF_MAGIC;
+	handoff->version = APP_BOOTLOADER_HANDOFF_VERSION;
+	handoff->reason = reason;
+	handoff->slot = partition_nbr;
+	handoff->try_nbr = (slot_ctrl.active_slot == partition_nbr && !slot_ctrl.confirmed)? slot_ctrl.try_nbr : 0;
+	if(address == APP_BOOTLOADER_RAM_APP_BASE)
+		handoff->flag |= APP_BOOTLOADER_HANDOFF_FLAG_RAM;
+	handoff->boot_ms = delay_get_tick();
+	app_bootloader_arch_boot(address);
+}
+
+static int app_bootloader_process_command(app_bootloader_frame_t * command_digest, app_bootloader_build_res_t * build_digest)
+{
+	int rt =  APP_BOOTLOADER_OK;
+	switch((app_bootloader_command)command_digest->command)
+	{
+		case APP_BOOTLOADER_CMD_HOST_HELLO:
+		{
+			print_serial_info("Received host hello");
+			/* Accept what the host offers and we support. Our hello goes without trailer, then both sides switch */
+			uint8_t features = 0;
+			if(command_digest->total_length == sizeof(app_bootloader_cmd_hello))
+				features = ((app_bootloader_cmd_hello *)command_digest->data)->features & APP_BOOTLOADER_CMD_FEATURES;
+			rt = app_bootloader_build_hello(build_digest, features);
+			app_bootloader_command_set_features(features);
+			print_serial_info("Features 0x%x", features);
+			app_bootloader_set_state(APP_BOOTLOADER_STATE_READY);
 			break;
 		}
-		case APP_BOOTLOADER_CMD_BOOT_APP:
+		case APP_BOOTLOADER_CMD_BAUD_REQ:
 		{
-			app_bootloader_cmd_boot_app * cmd_boot_ap = (app_bootloader_cmd_boot_app *)command_digest->data;
-			int partition_offset = app_bootloader_get_partition_offset(cmd_boot_ap->partition_nbr);
-			if(partition_offset < 0)
+			uint32_t baudrate = ((app_bootloader_cmd_baud *)command_digest->data)->baudrate;
+			print_serial_info("Baud rate %u requested", baudrate);
+			/* A refused rate is answered with the current one and nothing changes */
+			baud_next = 0;
+			if(baudrate != console_baudrate && console_check_baudrate(baudrate) == 0)
+				baud_next = baudrate;
+			rt = app_bootloader_build_baud_res(build_digest, (baud_next != 0)? baud_next : console_baudrate);
+			break;
+		}
+		case APP_BOOTLOADER_CMD_BAUD_PROBE:
+		{
+			/* Host reached us at the new rate, the switch is confirmed */
+			if(baud_fallback != 0)
+				print_serial_info("Baud rate %u confirmed", console_baudrate);
+			baud_fallback = 0;
+			rt = app_bootloader_build_baud_probe(build_digest, console_baudrate);
+			break;
+		}
+		case APP_BOOTLOADER_CMD_DOWNLOAD_REQ:
+		{
+			print_serial_info("Download request received");
+			/* Binary size is the image size, also when blocks come compressed */
+			app_bootloader_cmd_dl_req * dl_req = (app_bootloader_cmd_dl_req *)command_digest->data;
+
+			uint32_t size = app_bootloader_get_partition_size(dl_req->part_nbr);
+			if(size == 0)
+			{
+				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_UNKNOWN, "Not declared partition");
+				break;
+			}
+			if(size < APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE + dl_req->binary_size)
 			{
-				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Partition does not exist");
+				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_SIZE, "File does not fit in partition");
 				break;
 			}
 
-			print_serial_warn("Trying to boot partition %d at offset %x", cmd_boot_ap->partition_nbr, (uint32_t)partition_offset);
-			uint32_t offset = partition_offset + APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE;
+			app_bootloader.dl_status.total_size = dl_req->binary_size;
+			app_bootloader.dl_status.partition_nbr = dl_req->part_nbr;
+			app_bootloader.dl_status.window_size = 0;
+			app_bootloader.dl_status.resumable = false;
+			app_bootloader.dl_status.image_crc32_valid = (command_digest->total_length == sizeof(*dl_req));
+			app_bootloader.dl_status.image_crc32 = app_bootloader.dl_status.image_crc32_valid? dl_req->image_crc32 : 0;
+			app_bootloader.dl_status.resume_block_nbr = 0;
+			if(app_bootloader.dl_status.image_crc32_valid)
+				app_bootloader.dl_status.resume_block_nbr = app_bootloader_dl_find_progress(dl_req->part_nbr, dl_req->binary_size, dl_req->image_crc32);
+
+			/* To resume, the host must split the image the same way as before */
+			uint32_t block_size = APP_BOOTLOADER_DEFAULT_BLOCK_SIZE;
+			if(app_bootloader.dl_status.resume_block_nbr != 0)
+			{
+				block_size = dl_progress.block_size;
+				print_serial_info("Download can resume from block %u", app_bootloader.dl_status.resume_block_nbr);
+			}
+			rt = app_bootloader_build_dl_param_req(build_digest, APP_BOOTLOADER_DEFAULT_DL_TYPE, block_size, APP_BOOTLOADER_MAX_WINDOW_SIZE, app_bootloader.dl_status.resume_block_nbr);
+			break;
+		}
+		case APP_BOOTLOADER_CMD_DOWNLOAD_PARAM_RES:
+		{
+			print_serial_info("Download parameter response received");
+			app_bootloader_cmd_dl_param_res * dl_param_res =  (app_bootloader_cmd_dl_param_res *)command_digest->data;
 
-			uint8_t header[APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE] = {0};
-			rt = spi_flash_read(header, (uint32_t)partition_offset, APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE);
-			if(rt != SPI_FLASH_OK)
+			/* A bigger block would not fit in our buffer */
+			if(dl_param_res->block_size == 0 || dl_param_res->block_size > APP_BOOTLOADER_DEFAULT_BLOCK_SIZE)
+			{
+				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_SIZE, "Block size not supported");
+				break;
+			}
+			if(dl_param_res->type > APP_BOOTLOADER_DEFAULT_DL_TYPE)
+			{
+				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_PARAM, "Download type not supported");
+				break;
+			}
+			/* Block addresses come from block numbers, both sides must split the image the same way */
+			if(dl_param_res->total_block_nbr != (app_bootloader.dl_status.total_size + dl_param_res->block_size - 1) / dl_param_res->block_size)
 			{
-				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Error reading SPI flash");
+				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_SIZE, "Block number does not match image size");
 				break;
 			}
 
-			app_bootloader_partition_info_t * partition_info = (app_bootloader_partition_info_t *) header;
+			app_bootloader.dl_status.dl_type = dl_param_res->type;
+			app_bootloader.dl_status.block_size = dl_param_res->block_size;
+			app_bootloader.dl_status.total_block_nbr = dl_param_res->total_block_nbr;
+			app_bootloader.dl_status.actual_block_nbr = 0;
+			app_bootloader.dl_status.actual_size = 0;
+			app_bootloader.dl_status.window_size = dl_param_res->window_size;
+			if(app_bootloader.dl_status.window_size > APP_BOOTLOADER_MAX_WINDOW_SIZE)
+				app_bootloader.dl_status.window_size = APP_BOOTLOADER_MAX_WINDOW_SIZE;
+			app_bootloader.dl_status.window_base = 0;
+			app_bootloader.dl_status.window_bitmap = 0;
+			app_bootloader.dl_status.ack_pending = false;
+			app_bootloader_program_reset();
+			if(dl_param_res->type == APP_BOOTLOADER_DL_DELTA && app_bootloader_dl_set_base(command_digest, build_digest) != 0)
+			{
+				rt = APP_BOOTLOADER_OK;
+				app_bootloader.dl_status.window_size = 0;
+				break;
+			}
+			memset(&dl_stats, 0, sizeof(dl_stats));
+			spi_flash_reset_busy_stats();
+			app_bootloader_digest_init(&dl_digest);
+			dl_digest_block_nbr = 0;
+
+			/* Same image split the same way: blocks already programmed are kept and the partition is not erased */
+			bool resume = (app_bootloader.dl_status.resume_block_nbr != 0 && dl_progress.block_size == dl_param_res->block_size && dl_progress.dl_type == dl_param_res->type
+					&& (dl_param_res->type != APP_BOOTLOADER_DL_DELTA || (dl_progress.base_partition_nbr == dl_param_res->base_partition_nbr && dl_progress.base_crc32 == dl_param_res->base_crc32)));
+			if(resume)
+			{
+				uint32_t block_nbr = app_bootloader.dl_status.resume_block_nbr;
+				print_serial_info("Resuming download from block %u", block_nbr);
+				app_bootloader.dl_status.window_base = block_nbr;
+				app_bootloader.dl_status.actual_block_nbr = block_nbr;
+				app_bootloader.dl_status.actual_size = block_nbr * dl_param_res->block_size;
+				app_bootloader.dl_status.saved_block_nbr = block_nbr;
+				program_progress_block_nbr = block_nbr;
+				app_bootloader.dl_status.resumable = true;
+				/* Erase had reached the end of the last kept block. What follows may hold anything and is erased again */
+				app_bootloader.dl_status.erased_size = APP_BOOTLOADER_ALIGN_UP(APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE + block_nbr * dl_param_res->block_size, SPI_FLASH_SECTOR_SIZE);
+				/* Digest goes over the whole image, blocks kept are read back */
+				if(app_bootloader_dl_digest_catch_up() != SPI_FLASH_OK)
+				{
+					rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error reading back flash");
+					app_bootloader.dl_status.window_size = 0;
+					break;
+				}
+			}
+			else
+			{
+				/* Only the header page is erased now, the rest as blocks come */
+				app_bootloader.dl_status.erased_size = 0;
+				rt = app_bootloader_dl_erase_until(APP_BOOTLOADER_PARTITION_HEADER_MAX_SIZE);
+				if(rt != SPI_FLASH_OK)
+				{
+					rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error erasing partition");
+					break;
+				}
+				if(app_bootloader.dl_status.image_crc32_valid)
+					app_bootloader_dl_start_progress(command_digest);
+			}
+
+			if(app_bootloader.dl_status.window_size > 1)
+				rt = app_bootloader_build_dl_block_ack(build_digest, app_bootloader.dl_status.window_base, 0, app_bootloader.dl_status.window_size);
+			else
+				rt = app_bootloader_build_dl_block_req(build_digest, app_bootloader.dl_status.actual_block_nbr);
+			break;
+		}
+		case APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_RES:
+		{
+			print_serial_info("Download block response received");
+
+			app_bootloader_cmd_dl_block_res * dl_block_res =  (app_bootloader_cmd_dl_block_res *)command_digest->data;
+			dl_stats.block_nbr++;
+			if(dl_wait_tick != 0)
+			{
+				dl_stats.wait_ms += delay_get_tick() - dl_wait_tick;
+				dl_wait_tick = 0;
+			}
 
-			if(partition_info->magic_byte != APP_BOOTLOADER_PARTITION_MAGIC_BYTE)
+			if(app_bootloader.dl_status.window_size > 1)
 			{
-				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Invalid partition requested");
+				rt = app_bootloader_dl_window_block(dl_block_res, build_digest);
 				break;
 			}
-			if((partition_info->flag & (APP_BOOTLOADER_PARTITION_FLAG_COMPLETE)) != APP_BOOTLOADER_PARTITION_FLAG_COMPLETE)
+			/* A late copy of a previous block or a block not valid is asked again */
+			if(dl_block_res->block_nbr != app_bootloader.dl_status.actual_block_nbr)
 			{
-				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Incomplete partition requested");
+				rt = app_bootloader_build_dl_block_req(build_digest, app_bootloader.dl_status.actual_block_nbr);
 				break;
 			}
 
-			/*To erase APP partition:
-			* -> Sector 8: 0x08080000 - 0x080A0000
-			* -> Sector 11: 0x80E0000 - 0x080FFFFF
-			* We must erase 4 sectors */
-			HAL_FLASH_Unlock();
-			uint32_t SectorError = 0;
-			FLASH_EraseInitTypeDef pEraseInit = {0};
-			pEraseInit.TypeErase = FLASH_TYPEERASE_SECTORS;
-			pEraseInit.Sector = FLASH_SECTOR_8;
-			pEraseInit.NbSectors = 4; /*We want to erase from Sector 8 to Sector 11*/
-			pEraseInit.VoltageRange = FLASH_VOLTAGE_RANGE_3;
-
-			buffer = calloc(APP_BOOTLOADER_DEFAULT_BLOCK_SIZE, sizeof(*buffer));
-			if(buffer == NULL)
+			/* Block is programmed later, once the request for the next one is already sent. We reserve the first
+			 * page of a partition for partition info like flags, size, etc. */
+			rt = app_bootloader_dl_block_enqueue(dl_block_res);
+			if(rt == APP_BOOTLOADER_E_INVALID)
 			{
-				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Not enough heap");
+				rt = app_bootloader_build_dl_block_req(build_digest, app_bootloader.dl_status.actual_block_nbr);
 				break;
 			}
-
-			int err = HAL_FLASHEx_Erase(&pEraseInit, &SectorError);
-			if(err != HAL_OK)
+			else if(rt != APP_BOOTLOADER_OK)
 			{
-			  print_serial_warn("Error erasing sectors. Problem sector is %x", SectorError);
-			  rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Can not erase MCU application partition");
-			  break;
+				rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error writing into flash");
+				break;
 			}
 			else
 			{
-				print_serial_info("Success erasing APP sector!");
-				print_serial_warn("Starting application programming into flash");
-
-				uint32_t remaining = partition_info->size;
-				uint32_t read = 0;
+				print_serial_info("Download status [%u/%u][%d/%d]", app_bootloader.dl_status.total_size, app_bootloader.dl_status.actual_size, app_bootloader.dl_status.total_block_nbr, app_bootloader.dl_status.actual_block_nbr);
 
-				while(remaining)
+				if(app_bootloader.dl_status.actual_block_nbr == app_bootloader.dl_status.total_block_nbr)
+				{
+					rt = app_bootloader_dl_end(build_digest);
+				}
+				else
 				{
-					uint32_t to_read = APP_BOOTLOADER_DEFAULT_BLOCK_SIZE;
-					if(remaining < to_read)
-						to_read = remaining;
-
-					err = spi_flash_read(buffer, offset + read , to_read);
-					if(err != SPI_FLASH_OK)
-					{
-						rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_INVALID, "Error reading SPI flash");
-						break;
-					}
-
-					for(uint32_t i = 0; i < to_read; i++)
-					{
-						err = HAL_FLASH_Program(FLASH_TYPEPROGRAM_BYTE, APP_ADDR + read + i, buffer[i]);
-						if(err != HAL_OK)
-						{
-							print_serial_error("Program return error %d", err);
-							rt = app_bootloader_build_error(build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Problem writing new program");
-							remaining = 0;
-							HAL_FLASH_Lock();
-							break;
-						}
-					}
-
-					read += to_read;
-					remaining -= to_read;
+					rt = app_bootloader_build_dl_block_req(build_digest, app_bootloader.dl_status.actual_block_nbr);
 				}
 			}
-			HAL_FLASH_Lock();
-			if(err == 0)
+			break;
+		}
+		case APP_BOOTLOADER_CMD_PROFILE_REQ:
+		{
+			/* Spans are sent as they are, host converts them with the cycle rate */
+			uint32_t first_span = ((app_bootloader_cmd_profile_req *)command_digest->data)->first_span;
+			profile_span_t spans[APP_BOOTLOADER_CMD_PROFILE_SPAN_MAX];
+			uint8_t span_nbr = APP_BOOTLOADER_CMD_PROFILE_SPAN_MAX;
+			profile_read(&first_span, spans, &span_nbr);
+			for(uint8_t i = 0; i < span_nbr; i++)
+			{
+				profile_payload[i].id = spans[i].id;
+				profile_payload[i].arg = spans[i].arg;
+				profile_payload[i].start = spans[i].start;
+				profile_payload[i].cycles = spans[i].cycles;
+			}
+			rt = app_bootloader_build_profile_res(build_digest, profile_get_cycle_hz(), profile_get_span_total(), first_span, span_nbr, profile_payload);
+			break;
+		}
+		case APP_BOOTLOADER_CMD_BOOT_APP:
+		{
+			app_bootloader_cmd_boot_app * cmd_boot_ap = (app_bootloader_cmd_boot_app *)command_digest->data;
+			/* Hosts without RAM boot send no mode */
+			bool ram_boot = (command_digest->total_length == sizeof(*cmd_boot_ap) && cmd_boot_ap->mode == APP_BOOTLOADER_BOOT_RAM);
+			if(app_bootloader_boot_prepare(cmd_boot_ap->partition_nbr, ram_boot, build_digest) == 0)
 			{
-				rt = APP_BOOTLOADER_OK;
-				/*Todo: Update control */
 				rt = app_bootloader_build_end(build_digest);
+				boot_address = ram_boot? APP_BOOTLOADER_RAM_APP_BASE : APP_ADDR;
+				boot_partition_nbr = cmd_boot_ap->partition_nbr;
 				app_bootloader_set_state(APP_BOOTLOADER_STATE_BOOT);
 			}
-
 			break;
 		}
 		default:
@@ -444,28 +1752,84 @@ static int app_bootloader_process_command(app_bootloader_frame_t * command_diges
 			break;
 		}
 	}
-	free(buffer);
 	return rt;
 }
 
+int app_bootloader_get_dl_stats(app_bootloader_dl_stats_t * stats)
+{
+	if(stats == NULL) return APP_BOOTLOADER_E_INVALID;
+	memcpy(stats, &dl_stats, sizeof(*stats));
+	return APP_BOOTLOADER_OK;
+}
+
 int app_bootloader_init(void)
 {
 	delay_init(&frame_timeout, APP_BOOTLOADER_FRAME_TIMEOUT);
+	delay_init(&baud_timeout, APP_BOOTLOADER_BAUD_IDLE_TIMEOUT);
+	app_bootloader_slot_init();
 	app_bootloader_set_state(APP_BOOTLOADER_STATE_INIT);
+
+	/* Application we booted last says it works. Handoff is cleared, a confirm is only taken once */
+	app_bootloader_handoff_t * handoff = app_bootloader_arch_handoff();
+	app_bootloader_slot_ctrl_t slot_ctrl = {0};
+	app_bootloader_slot_get(&slot_ctrl);
+	if(handoff->magic == APP_BOOTLOADER_HANDOFF_MAGIC && handoff->confirm == APP_BOOTLOADER_HANDOFF_CONFIRM
+			&& (handoff->flag & APP_BOOTLOADER_HANDOFF_FLAG_RAM) == 0 && handoff->slot == slot_ctrl.active_slot && !slot_ctrl.confirmed)
+	{
+		if(app_bootloader_slot_confirm() == APP_BOOTLOADER_SLOT_OK)
+			print_serial_info("Partition %d confirmed by application", handoff->slot);
+	}
+	memset(handoff, 0, sizeof(*handoff));
+
+	/* Strap keeps us waiting for a host, whatever boot control says */
+	listen_pending = (APP_BOOTLOADER_LISTEN_WINDOW != 0 && !app_bootloader_arch_boot_strap());
+	if(!listen_pending)
+		print_serial_warn("Waiting for host");
+	delay_init(&listen_timeout, APP_BOOTLOADER_LISTEN_WINDOW);
+	delay_read(&listen_timeout);
 	return APP_BOOTLOADER_OK;
 }
 
 int app_bootloader_start(void)
 {
 	uint16_t recv_length = 0;
+	uint16_t frame_size = 0;
 	bool frame_received = false;
 	int err = APP_BOOTLOADER_OK;
+	int rt = APP_BOOTLOADER_OK;
 	app_bootloader_build_res_t build_digest = {0};
 
-	int rt = console_recv_data(app_bootloader_buffer + app_bootloader_recv, &recv_length);
+	/* No probe at the new rate, or no host for a while at a negotiated one: go back where the host can find us */
+	if((console_baudrate != CONSOLE_UART_BAUDRATE || baud_fallback != 0) && delay_read(&baud_timeout))
+	{
+		uint32_t baudrate = (baud_fallback != 0)? baud_fallback : CONSOLE_UART_BAUDRATE;
+		if(baud_fallback != 0)
+			print_serial_warn("No probe at %u baud, back to %u", console_baudrate, baudrate);
+		else
+			print_serial_warn("Console idle at %u baud, back to %u", console_baudrate, baudrate);
+		baud_fallback = 0;
+		app_bootloader_set_baudrate(baudrate);
+	}
+
+	/* A whole console burst must fit after what we already hold */
+	if(sizeof(app_bootloader_buffer) - app_bootloader_recv < CONSOLE_MAX_RECV_SIZE)
+		app_bootlaoder_clean_buffer();
+
+	rt = console_recv_data(app_bootloader_buffer + app_bootloader_recv, &recv_length);
 	if(rt == 0 && recv_length != 0)
 		app_bootloader_recv += recv_length;
 
+	/* Any console activity in the listen window means a host is there */
+	if(listen_pending && app_bootloader_recv > 0)
+	{
+		listen_pending = false;
+	}
+	else if(listen_pending && delay_read(&listen_timeout))
+	{
+		listen_pending = false;
+		app_bootloader_autoboot();
+	}
+
 	if(app_bootloader_recv > 0)
 	{
 		if(delay_read(&frame_timeout) == true)
@@ -475,44 +1839,101 @@ int app_bootloader_start(void)
 			delay_init(&frame_timeout, APP_BOOTLOADER_FRAME_TIMEOUT);
 
 			app_bootlaoder_clean_buffer();
-			app_bootloader_build_retransmit(&build_digest);
+			app_bootloader_request_retransmit();
+		}
+	}
+
+	/* A console burst may carry several frames back to back when the host streams a download window */
+	while((frame_size = app_bootloader_get_frame_size()) != 0)
+	{
+		uint32_t frame_start = profile_begin();
+		delay_init(&frame_timeout, APP_BOOTLOADER_FRAME_TIMEOUT);
+		frame_received = true;
 
+		app_bootloader_frame_t * command_digest = NULL;
+		memset(&build_digest, 0, sizeof(build_digest));
+		rt = app_bootloader_command_check(app_bootloader_buffer, frame_size, &command_digest);
+		if(rt == APP_BOOTLOADER_CMD_OK)
+		{
+			rt = app_bootloader_process_command(command_digest, &build_digest);
+		}
+
+		if(build_digest.frame != NULL)
+		{
 			err = app_bootloader_send_frame(&build_digest);
 			if(err != 0)
-			{
-				print_serial_error("Error sending retransmit frame");
-			}
+				print_serial_error("Error sending built frame");
+		}
+		profile_end(PROFILE_SPAN_FRAME, (command_digest != NULL)? command_digest->command : UINT8_MAX, frame_start);
+
+		if(command_digest == NULL && rt == APP_BOOTLOADER_CMD_E_CRC)
+		{
+			/* Corruption is most likely in the data, not the length. Skip only this frame so the rest of the
+			 * burst stays aligned, and ask it again instead of waiting the host timeout */
+			print_serial_error("Frame CRC mismatch. Request retransmit");
+			app_bootloader_request_retransmit();
+			app_bootloader_consume_frame(frame_size);
+			continue;
 		}
+		if(command_digest == NULL)
+		{
+			/* We lost track of frames. Drop everything and let the host recover */
+			app_bootlaoder_clean_buffer();
+			break;
+		}
+		app_bootloader_consume_frame(frame_size);
 	}
 
-	if(app_bootloader_recv < sizeof(app_bootloader_frame_t))
-		return APP_BOOTLOADER_E_WAIT;
-	else
+	if(frame_received && baud_fallback == 0)
+		delay_init(&baud_timeout, APP_BOOTLOADER_BAUD_IDLE_TIMEOUT);
+
+	/* Accepted rate applies once the response went out at the previous one */
+	if(baud_next != 0)
 	{
-		app_bootloader_frame_t * recv_frame = (app_bootloader_frame_t *) app_bootloader_buffer;
-		if(app_bootloader_recv < sizeof(*recv_frame) + recv_frame->total_length)
-			return APP_BOOTLOADER_E_WAIT;
-		else
+		uint32_t baudrate = console_baudrate;
+		if(app_bootloader_set_baudrate(baud_next) == APP_BOOTLOADER_OK)
 		{
-			delay_init(&frame_timeout, APP_BOOTLOADER_FRAME_TIMEOUT);
-			frame_received = true;
+			baud_fallback = baudrate;
+			delay_init(&baud_timeout, APP_BOOTLOADER_BAUD_PROBE_TIMEOUT);
+			delay_read(&baud_timeout);
 		}
+		baud_next = 0;
 	}
 
-	if(frame_received)
+	/* Acknowledge the whole burst at once, only when nothing else is pending in buffer */
+	if(app_bootloader_recv == 0 && app_bootloader.dl_status.ack_pending)
 	{
-
-		app_bootloader_frame_t * command_digest = NULL;
-		rt = app_bootloader_command_check(app_bootloader_buffer, recv_length, &command_digest);
+		app_bootloader.dl_status.ack_pending = false;
+		memset(&build_digest, 0, sizeof(build_digest));
+		rt = app_bootloader_build_dl_block_ack(&build_digest, app_bootloader.dl_status.window_base, app_bootloader.dl_status.window_bitmap >> 1, app_bootloader.dl_status.window_size);
 		if(rt == APP_BOOTLOADER_CMD_OK)
 		{
-			rt = app_bootloader_process_command(command_digest, &build_digest);
+			err = app_bootloader_send_frame(&build_digest);
+			if(err != 0)
+				print_serial_error("Error sending acknowledge frame");
 		}
 	}
 
-	err = app_bootloader_send_frame(&build_digest);
-	if(err != 0)
-		print_serial_error("Error sending built frame");
+	/* Responses are out, keep programming pending blocks while the host sends the next ones */
+	if(program_buffer[program_buffer_tail].pending)
+	{
+		err = app_bootloader_program_run();
+		if(err != SPI_FLASH_OK)
+		{
+			print_serial_error("Error programming block %d", err);
+			app_bootloader_program_reset();
+			app_bootloader.dl_status.window_size = 0;
+			app_bootloader.dl_status.resumable = false;
+			app_bootloader.dl_status.ack_pending = false;
+
+			memset(&build_digest, 0, sizeof(build_digest));
+			if(app_bootloader_build_error(&build_digest, APP_BOOTLOADER_CMD_E_FAIL, "Error writing into flash") == APP_BOOTLOADER_CMD_OK)
+				app_bootloader_send_frame(&build_digest);
+		}
+	}
+
+	if(!frame_received)
+		return APP_BOOTLOADER_E_WAIT;
 
 	switch(app_bootloader_get_state())
 	{
@@ -534,7 +1955,7 @@ int app_bootloader_start(void)
 		case APP_BOOTLOADER_STATE_BOOT:
 		{
 			print_serial_warn("Booting previously set partition...");
-			bootloader_boot(APP_ADDR);
+			app_bootloader_boot(boot_address, boot_partition_nbr, APP_BOOTLOADER_HANDOFF_REASON_HOST);
 		}
 		default:
 		{
@@ -543,8 +1964,6 @@ int app_bootloader_start(void)
 		}
 	}
 
-	/* Reset buffer content and received data for next frame */
-	app_bootlaoder_clean_buffer();
 	return rt;
 }
 
@@ -1,74 +1,143 @@
-#include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include "app_bootloader_command.h"
+#include "app_bootloader_crc.h"
+
+static uint8_t app_bootloader_tx_pool[APP_BOOTLOADER_CMD_TX_POOL_SIZE] = {0};
+static uint8_t app_bootloader_features = 0;
+
+/**
+ * @brief Check if a command carries the CRC-32 trailer. Hellos never do, features are not agreed yet.
+ *
+ * @param command Command id.
+ * @return true: trailer is present. false: otherwise.
+ */
+static inline bool app_bootloader_command_has_crc(uint8_t command);
 
 /**
- * @brief Build a app bootloader command.
+ * @brief Build a app bootloader command. Header and fixed fields are serialized into the TX buffer,
+ * the payload is only referenced.
  *
  * @param command Command id.
- * @param data Command's data. Can be NULL.
+ * @param data Command's fixed fields. Can be NULL.
  * @param data_size Data size.
+ * @param payload Command's variable payload. Can be NULL.
+ * @param payload_size Payload size.
  * @param build_digest Build result.
  * @return
  * 			- APP_BOOTLOADER_CMD_OK if no error.
  */
-int static app_bootloader_command_build(app_bootloader_command command, uint8_t * data, uint32_t data_size, app_bootloader_build_res_t * build_digest);
+int static app_bootloader_command_build(app_bootloader_command command, uint8_t * data, uint32_t data_size, const uint8_t * payload, uint32_t payload_size, app_bootloader_build_res_t * build_digest);
 
-int static app_bootloader_command_build(app_bootloader_command command, uint8_t * data, uint32_t data_size, app_bootloader_build_res_t * build_digest)
+static inline bool app_bootloader_command_has_crc(uint8_t command)
+{
+	if(command == APP_BOOTLOADER_CMD_HELLO || command == APP_BOOTLOADER_CMD_HOST_HELLO)
+		return false;
+	return (app_bootloader_features & APP_BOOTLOADER_CMD_FEATURE_CRC32) != 0;
+}
+
+int static app_bootloader_command_build(app_bootloader_command command, uint8_t * data, uint32_t data_size, const uint8_t * payload, uint32_t payload_size, app_bootloader_build_res_t * build_digest)
 {
 	if(build_digest == NULL) return APP_BOOTLOADER_CMD_E_NULL;
 	if(command  > APP_BOOTLOADER_CMD_MAX) return APP_BOOTLOADER_CMD_E_UNKNOWN;
 	if(data != NULL && data_size == 0) return APP_BOOTLOADER_CMD_E_PARAM;
+	if(payload != NULL && payload_size == 0) return APP_BOOTLOADER_CMD_E_PARAM;
+	if(data_size + payload_size > UINT16_MAX) return APP_BOOTLOADER_CMD_E_SIZE;
+
+	uint8_t * frame = build_digest->tx_buffer;
+	uint32_t frame_capacity = build_digest->tx_buffer_size;
+	if(frame == NULL)
+	{
+		frame = app_bootloader_tx_pool;
+		frame_capacity = sizeof(app_bootloader_tx_pool);
+	}
 
 	app_bootloader_frame_t * cmd = NULL;
-	uint16_t frame_size = sizeof(*cmd) + data_size;
-	uint8_t * frame = calloc(frame_size, sizeof(*frame));
-	if(frame == NULL) return APP_BOOTLOADER_CMD_E_MEM;
+	uint32_t frame_size = sizeof(*cmd) + data_size;
+	if(frame_size > frame_capacity) return APP_BOOTLOADER_CMD_E_MEM;
 
 	cmd = (app_bootloader_frame_t *) frame;
 	cmd->magic = APP_BOOTLOADER_CMD_MAGIC_BYTE;
 	cmd->command = command;
-	cmd->total_length = data_size;
+	cmd->total_length = data_size + payload_size;
+
+	if(data_size != 0)
+		memcpy(frame + sizeof(*cmd), data, data_size);
 
 	build_digest->frame = frame;
 	build_digest->frame_size = frame_size;
+	build_digest->payload = (payload_size != 0)? payload : NULL;
+	build_digest->payload_size = payload_size;
+	build_digest->trailer_size = 0;
 
-	memcpy(frame + sizeof(*cmd), data, data_size);
+	if(app_bootloader_command_has_crc(command))
+	{
+		/* Payload is only referenced, so the CRC goes in a trailer sent after it */
+		app_bootloader_crc32_t crc_ctx;
+		app_bootloader_crc32_init(&crc_ctx);
+		app_bootloader_crc32_update(&crc_ctx, frame, frame_size);
+		if(payload_size != 0)
+			app_bootloader_crc32_update(&crc_ctx, payload, payload_size);
+		uint32_t crc = app_bootloader_crc32_final(&crc_ctx);
+		memcpy(build_digest->trailer, &crc, sizeof(crc));
+		build_digest->trailer_size = sizeof(crc);
+	}
 	return APP_BOOTLOADER_CMD_OK;
 }
 
-int app_bootloader_build_hello(app_bootloader_build_res_t * build_digest)
+void app_bootloader_command_set_features(uint8_t features)
+{
+	app_bootloader_features = features & APP_BOOTLOADER_CMD_FEATURES;
+}
+
+uint8_t app_bootloader_command_get_features(void)
+{
+	return app_bootloader_features;
+}
+
+uint32_t app_bootloader_command_frame_size(const app_bootloader_frame_t * frame)
 {
-	return app_bootloader_command_build(APP_BOOTLOADER_CMD_HELLO, NULL, 0, build_digest);
+	uint32_t frame_size = sizeof(*frame) + frame->total_length;
+	if(app_bootloader_command_has_crc(frame->command))
+		frame_size += APP_BOOTLOADER_CMD_CRC_SIZE;
+	return frame_size;
 }
 
-int app_bootloader_build_host_hello(app_bootloader_build_res_t * build_digest)
+int app_bootloader_build_hello(app_bootloader_build_res_t * build_digest, uint8_t features)
 {
-	return app_bootloader_command_build(APP_BOOTLOADER_CMD_HOST_HELLO, NULL, 0, build_digest);
+	app_bootloader_cmd_hello cmd_data = {.features = features};
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_HELLO, (uint8_t *)&cmd_data, sizeof(cmd_data), NULL, 0, build_digest);
 }
 
-int app_bootloader_build_dl_req(app_bootloader_build_res_t * build_digest, uint8_t partition_nbr, uint32_t binary_size)
+int app_bootloader_build_host_hello(app_bootloader_build_res_t * build_digest, uint8_t features)
 {
-	app_bootloader_cmd_dl_req cmd_data = {.part_nbr = partition_nbr, .binary_size = binary_size};
+	app_bootloader_cmd_hello cmd_data = {.features = features};
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_HOST_HELLO, (uint8_t *)&cmd_data, sizeof(cmd_data), NULL, 0, build_digest);
+}
+
+int app_bootloader_build_dl_req(app_bootloader_build_res_t * build_digest, uint8_t partition_nbr, uint32_t binary_size, uint32_t image_crc32)
+{
+	app_bootloader_cmd_dl_req cmd_data = {.part_nbr = partition_nbr, .binary_size = binary_size, .image_crc32 = image_crc32};
 	void * data = (void *) &cmd_data;
 	uint32_t data_size = sizeof(cmd_data);
-	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_REQ, data, data_size, build_digest);
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_REQ, data, data_size, NULL, 0, build_digest);
 }
 
-int app_bootloader_build_dl_param_req(app_bootloader_build_res_t * build_digest, uint8_t type, uint16_t block_size)
+int app_bootloader_build_dl_param_req(app_bootloader_build_res_t * build_digest, uint8_t type, uint16_t block_size, uint8_t window_size, uint32_t resume_block_nbr)
 {
-	app_bootloader_cmd_dl_param_req cmd_data = {.block_size = block_size, .type = type};
+	app_bootloader_cmd_dl_param_req cmd_data = {.block_size = block_size, .type = type, .window_size = window_size, .resume_block_nbr = resume_block_nbr};
 	void * data = (void *) &cmd_data;
 	uint32_t data_size = sizeof(cmd_data);
-	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_PARAM_REQ, data, data_size, build_digest);
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_PARAM_REQ, data, data_size, NULL, 0, build_digest);
 }
 
-int app_bootloader_build_dl_param_res(app_bootloader_build_res_t * build_digest, uint8_t type, uint32_t total_block_nbr, uint16_t block_size)
+int app_bootloader_build_dl_param_res(app_bootloader_build_res_t * build_digest, uint8_t type, uint32_t total_block_nbr, uint16_t block_size, uint8_t window_size, uint8_t base_partition_nbr, uint32_t base_crc32)
 {
-	app_bootloader_cmd_dl_param_res cmd_data = {.type = type, .total_block_nbr = total_block_nbr, .block_size = block_size};
+	app_bootloader_cmd_dl_param_res cmd_data = {.type = type, .total_block_nbr = total_block_nbr, .block_size = block_size, .window_size = window_size,
+			.base_partition_nbr = base_partition_nbr, .base_crc32 = base_crc32};
 	void * data = (void *) &cmd_data;
 	uint32_t data_size = sizeof(cmd_data);
-	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_PARAM_RES, data, data_size, build_digest);
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_PARAM_RES, data, data_size, NULL, 0, build_digest);
 }
 
 int app_bootloader_build_dl_block_req(app_bootloader_build_res_t * build_digest, uint32_t block_nbr)
@@ -76,61 +145,81 @@ int app_bootloader_build_dl_block_req(app_bootloader_build_res_t * build_digest,
 	app_bootloader_cmd_dl_block_req cmd_data = {.block_nbr = block_nbr};
 	void * data = (void *) &cmd_data;
 	uint32_t data_size = sizeof(cmd_data);
-	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_REQ, data, data_size, build_digest);
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_REQ, data, data_size, NULL, 0, build_digest);
 }
 
 int app_bootloader_build_dl_block_res(app_bootloader_build_res_t * build_digest, uint32_t block_nbr, uint32_t data_size, uint8_t * data)
 {
-	app_bootloader_cmd_dl_block_res * cmd_data = NULL;
-	uint32_t buffer_size = sizeof(*cmd_data) + data_size;
-	void * buffer = (void *) malloc(buffer_size);
-	if(buffer == NULL) return APP_BOOTLOADER_CMD_E_MEM;
-
-	/* Pass info into structure before build */
-	cmd_data = (app_bootloader_cmd_dl_block_res *) (buffer);
-	cmd_data->block_nbr = block_nbr;
-	cmd_data->data_size = data_size;
-	memcpy(cmd_data->data, data, data_size);
+	if(data == NULL || data_size == 0) return APP_BOOTLOADER_CMD_E_PARAM;
+	app_bootloader_cmd_dl_block_res cmd_data = {.block_nbr = block_nbr, .data_size = data_size};
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_RES, (uint8_t *)&cmd_data, sizeof(cmd_data), data, data_size, build_digest);
+}
 
-	int rt = app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_RES, (uint8_t *)buffer, buffer_size, build_digest);
-	free(buffer);
-	return rt;
+int app_bootloader_build_dl_block_ack(app_bootloader_build_res_t * build_digest, uint32_t block_nbr, uint32_t ack_bitmap, uint8_t window_size)
+{
+	app_bootloader_cmd_dl_block_ack cmd_data = {.block_nbr = block_nbr, .ack_bitmap = ack_bitmap, .window_size = window_size};
+	void * data = (void *) &cmd_data;
+	uint32_t data_size = sizeof(cmd_data);
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_ACK, data, data_size, NULL, 0, build_digest);
 }
 
 int app_bootloader_build_end(app_bootloader_build_res_t * build_digest)
 {
-	return app_bootloader_command_build(APP_BOOTLOADER_CMD_END, NULL, 0, build_digest);
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_END, NULL, 0, NULL, 0, build_digest);
 }
 
-int app_bootloader_build_boot_app(app_bootloader_build_res_t * build_digest, uint8_t partition_nbr)
+int app_bootloader_build_boot_app(app_bootloader_build_res_t * build_digest, uint8_t partition_nbr, app_bootloader_boot_mode_t mode)
 {
-	app_bootloader_cmd_boot_app cmd_data = {.partition_nbr = partition_nbr};
+	app_bootloader_cmd_boot_app cmd_data = {.partition_nbr = partition_nbr, .mode = mode};
 	void * data = (void *) &cmd_data;
 	uint32_t data_size = sizeof(cmd_data);
-	return app_bootloader_command_build(APP_BOOTLOADER_CMD_DOWNLOAD_REQ, data, data_size, build_digest);
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_BOOT_APP, data, data_size, NULL, 0, build_digest);
 }
 
 int app_bootloader_build_error(app_bootloader_build_res_t * build_digest, uint8_t error, char * message)
 {
 	if(build_digest == NULL) return APP_BOOTLOADER_CMD_E_NULL;
 	if(message == NULL) return APP_BOOTLOADER_CMD_E_PARAM;
-	app_bootloader_cmd_err * cmd_data = NULL;
-	uint32_t buffer_size = sizeof(*cmd_data) + strlen(message) + 1;
-	void * buffer = (void *) malloc(buffer_size);
-	if(buffer == NULL) return APP_BOOTLOADER_CMD_E_MEM;
+	app_bootloader_cmd_err cmd_data = {.error = error};
+	/* Message is sent with its null terminator */
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_ERROR, (uint8_t *)&cmd_data, sizeof(cmd_data), (uint8_t *)message, strlen(message) + 1, build_digest);
+}
 
-	cmd_data = (app_bootloader_cmd_err *) buffer;
-	cmd_data->error = error;
-	strcpy(cmd_data->error_msg, message);
+int app_bootloader_build_retransmit(app_bootloader_build_res_t * build_digest)
+{
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_RETRANSMIT, NULL, 0, NULL, 0, build_digest);
+}
 
-	int rt = app_bootloader_command_build(APP_BOOTLOADER_CMD_ERROR, (uint8_t *)buffer, buffer_size, build_digest);
-	free(buffer);
-	return rt;
+int app_bootloader_build_baud_req(app_bootloader_build_res_t * build_digest, uint32_t baudrate)
+{
+	app_bootloader_cmd_baud cmd_data = {.baudrate = baudrate};
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_BAUD_REQ, (uint8_t *)&cmd_data, sizeof(cmd_data), NULL, 0, build_digest);
 }
 
-int app_bootloader_build_retransmit(app_bootloader_build_res_t * build_digest)
+int app_bootloader_build_baud_res(app_bootloader_build_res_t * build_digest, uint32_t baudrate)
+{
+	app_bootloader_cmd_baud cmd_data = {.baudrate = baudrate};
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_BAUD_RES, (uint8_t *)&cmd_data, sizeof(cmd_data), NULL, 0, build_digest);
+}
+
+int app_bootloader_build_baud_probe(app_bootloader_build_res_t * build_digest, uint32_t baudrate)
+{
+	app_bootloader_cmd_baud cmd_data = {.baudrate = baudrate};
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_BAUD_PROBE, (uint8_t *)&cmd_data, sizeof(cmd_data), NULL, 0, build_digest);
+}
+
+int app_bootloader_build_profile_req(app_bootloader_build_res_t * build_digest, uint32_t first_span)
 {
-	return app_bootloader_command_build(APP_BOOTLOADER_CMD_RETRANSMIT, NULL, 0, build_digest);
+	app_bootloader_cmd_profile_req cmd_data = {.first_span = first_span};
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_PROFILE_REQ, (uint8_t *)&cmd_data, sizeof(cmd_data), NULL, 0, build_digest);
+}
+
+int app_bootloader_build_profile_res(app_bootloader_build_res_t * build_digest, uint32_t cycle_hz, uint32_t span_total, uint32_t first_span, uint8_t span_nbr, const app_bootloader_cmd_profile_span * spans)
+{
+	if(span_nbr > APP_BOOTLOADER_CMD_PROFILE_SPAN_MAX || (span_nbr != 0 && spans == NULL)) return APP_BOOTLOADER_CMD_E_PARAM;
+	app_bootloader_cmd_profile_res cmd_data = {.cycle_hz = cycle_hz, .span_total = span_total, .first_span = first_span, .span_nbr = span_nbr};
+	return app_bootloader_command_build(APP_BOOTLOADER_CMD_PROFILE_RES, (uint8_t *)&cmd_data, sizeof(cmd_data),
+			(span_nbr != 0)? (const uint8_t *)spans : NULL, span_nbr * sizeof(*spans), build_digest);
 }
 
 
@@ -147,33 +236,43 @@ int app_bootloader_command_check(uint8_t * buffer, uint16_t buffer_size, app_boo
 	app_bootloader_frame_t * frame = (app_bootloader_frame_t *) buffer;
 
 	if(frame->magic != APP_BOOTLOADER_CMD_MAGIC_BYTE) return APP_BOOTLOADER_CMD_E_INVALID;
+	if(buffer_size < app_bootloader_command_frame_size(frame)) return APP_BOOTLOADER_CMD_E_SIZE;
+
+	if(app_bootloader_command_has_crc(frame->command))
+	{
+		uint32_t crc = 0;
+		uint32_t crc_offset = sizeof(*frame) + frame->total_length;
+		memcpy(&crc, buffer + crc_offset, sizeof(crc));
+		if(app_bootloader_crc32(buffer, crc_offset) != crc) return APP_BOOTLOADER_CMD_E_CRC;
+	}
+
 	switch((app_bootloader_command) frame->command)
 	{
 		case APP_BOOTLOADER_CMD_HELLO:
-		{
-			res = APP_BOOTLOADER_CMD_OK;
-			break;
-		}
 		case APP_BOOTLOADER_CMD_HOST_HELLO:
 		{
-			res = APP_BOOTLOADER_CMD_OK;
+			/* Hello without content comes from a peer without optional features */
+			if(frame->total_length == 0 || frame->total_length == sizeof(app_bootloader_cmd_hello))
+				res = APP_BOOTLOADER_CMD_OK;
 			break;
 		}
 		case APP_BOOTLOADER_CMD_DOWNLOAD_REQ:
 		{
-			if(frame->total_length == sizeof(app_bootloader_cmd_dl_req))
+			/* Without image CRC-32 the download can not resume */
+			if(frame->total_length == sizeof(app_bootloader_cmd_dl_req) || frame->total_length == APP_BOOTLOADER_CMD_DL_REQ_BASIC_SIZE)
 				res = APP_BOOTLOADER_CMD_OK;
 			break;
 		}
 		case APP_BOOTLOADER_CMD_DOWNLOAD_PARAM_REQ:
 		{
-			if(frame->total_length == sizeof(app_bootloader_cmd_dl_param_req))
+			if(frame->total_length == sizeof(app_bootloader_cmd_dl_param_req) || frame->total_length == APP_BOOTLOADER_CMD_DL_PARAM_REQ_BASIC_SIZE)
 				res = APP_BOOTLOADER_CMD_OK;
 			break;
 		}
 		case APP_BOOTLOADER_CMD_DOWNLOAD_PARAM_RES:
 		{
-			if(frame->total_length == sizeof(app_bootloader_cmd_dl_param_res))
+			/* Base fields may be missing, they are only read for a delta download */
+			if(frame->total_length == sizeof(app_bootloader_cmd_dl_param_res) || frame->total_length == APP_BOOTLOADER_CMD_DL_PARAM_RES_BASIC_SIZE)
 				res = APP_BOOTLOADER_CMD_OK;
 			break;
 		}
@@ -193,6 +292,12 @@ int app_bootloader_command_check(uint8_t * buffer, uint16_t buffer_size, app_boo
 			}
 			break;
 		}
+		case APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_ACK:
+		{
+			if(frame->total_length == sizeof(app_bootloader_cmd_dl_block_ack))
+				res = APP_BOOTLOADER_CMD_OK;
+			break;
+		}
 		case APP_BOOTLOADER_CMD_END:
 		{
 			res = APP_BOOTLOADER_CMD_OK;
@@ -200,10 +305,46 @@ int app_bootloader_command_check(uint8_t * buffer, uint16_t buffer_size, app_boo
 		}
 		case APP_BOOTLOADER_CMD_BOOT_APP:
 		{
-			if(frame->total_length == sizeof(app_bootloader_cmd_boot_app))
+			/* Without mode the image is installed */
+			if(frame->total_length == sizeof(app_bootloader_cmd_boot_app) || frame->total_length == APP_BOOTLOADER_CMD_BOOT_APP_BASIC_SIZE)
+				res = APP_BOOTLOADER_CMD_OK;
+			break;
+		}
+		case APP_BOOTLOADER_CMD_ERROR:
+		{
+			if(frame->total_length >= sizeof(app_bootloader_cmd_err))
+				res = APP_BOOTLOADER_CMD_OK;
+			break;
+		}
+		case APP_BOOTLOADER_CMD_RETRANSMIT:
+		{
+			res = APP_BOOTLOADER_CMD_OK;
+			break;
+		}
+		case APP_BOOTLOADER_CMD_BAUD_REQ:
+		case APP_BOOTLOADER_CMD_BAUD_RES:
+		case APP_BOOTLOADER_CMD_BAUD_PROBE:
+		{
+			if(frame->total_length == sizeof(app_bootloader_cmd_baud))
 				res = APP_BOOTLOADER_CMD_OK;
 			break;
 		}
+		case APP_BOOTLOADER_CMD_PROFILE_REQ:
+		{
+			if(frame->total_length == sizeof(app_bootloader_cmd_profile_req))
+				res = APP_BOOTLOADER_CMD_OK;
+			break;
+		}
+		case APP_BOOTLOADER_CMD_PROFILE_RES:
+		{
+			if(frame->total_length >= sizeof(app_bootloader_cmd_profile_res))
+			{
+				app_bootloader_cmd_profile_res * data = (app_bootloader_cmd_profile_res *) frame->data;
+				if(frame->total_length == sizeof(*data) + data->span_nbr * sizeof(data->spans[0]))
+					res = APP_BOOTLOADER_CMD_OK;
+			}
+			break;
+		}
 		default:
 		{
 			res = APP_BOOTLOADER_CMD_E_UNKNOWN;
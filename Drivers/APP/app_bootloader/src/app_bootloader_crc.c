@@ -0,0 +1,112 @@
+/*
+ * app_bootloader_crc.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+#include <stdbool.h>
+#include "app_bootloader_crc.h"
+#include "app_bootloader_arch_common.h"
+
+static uint32_t crc32_table[256] = {0};
+static bool crc32_table_ready = false;
+
+/**
+ * @brief Build the byte table used by the software path.
+ *
+ */
+static void app_bootloader_crc32_table_init(void);
+/**
+ * @brief Software CRC-32, one table lookup per byte.
+ *
+ * @param crc Current CRC.
+ * @param data Data.
+ * @param size Data size.
+ * @return Updated CRC.
+ */
+static uint32_t app_bootloader_crc32_software(uint32_t crc, const uint8_t * data, uint32_t size);
+/**
+ * @brief Feed complete words. Hardware is used when the arch has it, software otherwise.
+ *
+ * @param ctx CRC context.
+ * @param data Data.
+ * @param word_nbr Words to feed.
+ */
+static void app_bootloader_crc32_words(app_bootloader_crc32_t * ctx, const uint8_t * data, uint32_t word_nbr);
+
+static void app_bootloader_crc32_table_init(void)
+{
+	if(crc32_table_ready)
+		return;
+
+	for(uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t crc = i << 24;
+		for(uint8_t bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80000000)? (crc << 1) ^ APP_BOOTLOADER_CRC32_POLY : (crc << 1);
+		crc32_table[i] = crc;
+	}
+	crc32_table_ready = true;
+}
+
+static uint32_t app_bootloader_crc32_software(uint32_t crc, const uint8_t * data, uint32_t size)
+{
+	app_bootloader_crc32_table_init();
+	for(uint32_t i = 0; i < size; i++)
+		crc = (crc << 8) ^ crc32_table[(crc >> 24) ^ data[i]];
+	return crc;
+}
+
+static void app_bootloader_crc32_words(app_bootloader_crc32_t * ctx, const uint8_t * data, uint32_t word_nbr)
+{
+	if(app_bootloader_arch_crc32_words(&ctx->crc, data, word_nbr) != APP_BOOTLOADER_ARCH_OK)
+		ctx->crc = app_bootloader_crc32_software(ctx->crc, data, word_nbr * sizeof(uint32_t));
+}
+
+void app_bootloader_crc32_init(app_bootloader_crc32_t * ctx)
+{
+	ctx->crc = APP_BOOTLOADER_CRC32_INIT;
+	ctx->tail_size = 0;
+}
+
+void app_bootloader_crc32_update(app_bootloader_crc32_t * ctx, const uint8_t * data, uint32_t size)
+{
+	/* Complete a word left from a previous update first */
+	while(ctx->tail_size != 0 && size != 0)
+	{
+		ctx->tail[ctx->tail_size++] = *data++;
+		size--;
+		if(ctx->tail_size == sizeof(ctx->tail))
+		{
+			app_bootloader_crc32_words(ctx, ctx->tail, 1);
+			ctx->tail_size = 0;
+		}
+	}
+
+	uint32_t word_nbr = size / sizeof(uint32_t);
+	if(word_nbr != 0)
+	{
+		app_bootloader_crc32_words(ctx, data, word_nbr);
+		data += word_nbr * sizeof(uint32_t);
+		size -= word_nbr * sizeof(uint32_t);
+	}
+
+	while(size--)
+		ctx->tail[ctx->tail_size++] = *data++;
+}
+
+uint32_t app_bootloader_crc32_final(app_bootloader_crc32_t * ctx)
+{
+	/* Hardware only takes words, trailing bytes always go by software */
+	uint32_t crc = app_bootloader_crc32_software(ctx->crc, ctx->tail, ctx->tail_size);
+	ctx->tail_size = 0;
+	return crc;
+}
+
+uint32_t app_bootloader_crc32(const uint8_t * data, uint32_t size)
+{
+	app_bootloader_crc32_t ctx;
+	app_bootloader_crc32_init(&ctx);
+	app_bootloader_crc32_update(&ctx, data, size);
+	return app_bootloader_crc32_final(&ctx);
+}
@@ -0,0 +1,168 @@
+/*
+ * app_bootloader_delta.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+#include <stddef.h>
+#include <string.h>
+#include "app_bootloader_delta.h"
+#include "app_bootloader_lz4.h"
+
+/**
+ * @brief Get the base range read by the COPY and ADD ops of an op stream.
+ *
+ * @param op Op stream.
+ * @param op_end End of op stream.
+ * @param start Where the first base offset read is saved.
+ * @param end Where the base offset after the last byte read is saved. Same as 'start' if none is read.
+ * @return
+ * 			- APP_BOOTLOADER_DELTA_OK if no error.
+ * 			- APP_BOOTLOADER_DELTA_E_CORRUPT if op stream is truncated.
+ */
+static int app_bootloader_delta_base_range(const uint8_t * op, const uint8_t * op_end, uint32_t * start, uint32_t * end);
+/**
+ * @brief Read base bytes, from the window when it holds them.
+ *
+ * @param base Base image.
+ * @param window_offset Base offset of the window. Updated when the window is read again.
+ * @param window_size Bytes held by the window. Updated when the window is read again.
+ * @param offset Base offset.
+ * @param buffer Where bytes are copied.
+ * @param size Size to read.
+ * @return 0 if no error.
+ */
+static int app_bootloader_delta_base_read(const app_bootloader_delta_base_t * base, uint32_t * window_offset, uint32_t * window_size, uint32_t offset, uint8_t * buffer, uint32_t size);
+
+static int app_bootloader_delta_base_range(const uint8_t * op, const uint8_t * op_end, uint32_t * start, uint32_t * end)
+{
+	*start = UINT32_MAX;
+	*end = 0;
+	while(op < op_end)
+	{
+		if(op_end - op < APP_BOOTLOADER_DELTA_OP_HEADER_SIZE)
+			return APP_BOOTLOADER_DELTA_E_CORRUPT;
+		uint8_t type = op[0];
+		uint32_t length = op[1] | ((uint32_t)op[2] << 8);
+		op += APP_BOOTLOADER_DELTA_OP_HEADER_SIZE;
+
+		if(type == APP_BOOTLOADER_DELTA_OP_COPY || type == APP_BOOTLOADER_DELTA_OP_ADD)
+		{
+			if(op_end - op < APP_BOOTLOADER_DELTA_OP_OFFSET_SIZE)
+				return APP_BOOTLOADER_DELTA_E_CORRUPT;
+			uint32_t offset = op[0] | ((uint32_t)op[1] << 8) | ((uint32_t)op[2] << 16) | ((uint32_t)op[3] << 24);
+			op += APP_BOOTLOADER_DELTA_OP_OFFSET_SIZE;
+			if(offset < *start)
+				*start = offset;
+			if(offset + length > *end)
+				*end = offset + length;
+		}
+		if(type == APP_BOOTLOADER_DELTA_OP_ADD || type == APP_BOOTLOADER_DELTA_OP_INSERT)
+		{
+			if((uint32_t)(op_end - op) < length)
+				return APP_BOOTLOADER_DELTA_E_CORRUPT;
+			op += length;
+		}
+	}
+	if(*start > *end)
+		*start = *end;
+	return APP_BOOTLOADER_DELTA_OK;
+}
+
+static int app_bootloader_delta_base_read(const app_bootloader_delta_base_t * base, uint32_t * window_offset, uint32_t * window_size, uint32_t offset, uint8_t * buffer, uint32_t size)
+{
+	if(base->window == NULL || size > base->window_size)
+		return base->read_cb(offset, buffer, size, base->arg);
+
+	if(offset < *window_offset || offset + size > *window_offset + *window_size)
+	{
+		/* Ops mostly go forward through the base, the window starts at the op it misses */
+		uint32_t read_size = base->size - offset;
+		if(read_size > base->window_size)
+			read_size = base->window_size;
+		*window_offset = offset;
+		*window_size = 0;
+		if(base->read_cb(offset, base->window, read_size, base->arg) != 0)
+			return -1;
+		*window_size = read_size;
+	}
+	memcpy(buffer, base->window + (offset - *window_offset), size);
+	return 0;
+}
+
+int app_bootloader_delta_apply(const uint8_t * patch, uint32_t patch_size, uint8_t * dst, uint32_t dst_size, const app_bootloader_delta_base_t * base, uint8_t * scratch, uint32_t scratch_size)
+{
+	if(patch == NULL || dst == NULL || base == NULL || base->read_cb == NULL) return APP_BOOTLOADER_DELTA_E_PARAM;
+	if(patch_size == 0 || (patch[0] & ~APP_BOOTLOADER_DELTA_FLAGS) != 0) return APP_BOOTLOADER_DELTA_E_CORRUPT;
+
+	const uint8_t * op = patch + 1;
+	uint32_t ops_size = patch_size - 1;
+	if(patch[0] & APP_BOOTLOADER_DELTA_FLAG_LZ4)
+	{
+		if(scratch == NULL) return APP_BOOTLOADER_DELTA_E_PARAM;
+		if(app_bootloader_lz4_decompress(op, ops_size, scratch, scratch_size, &ops_size) != APP_BOOTLOADER_LZ4_OK)
+			return APP_BOOTLOADER_DELTA_E_CORRUPT;
+		op = scratch;
+	}
+	const uint8_t * op_end = op + ops_size;
+
+	/* Each base read may suspend a SPI flash erase or program, a patch with many small ops reads its
+	 * whole base range once if the window takes it */
+	uint32_t window_offset = 0;
+	uint32_t window_size = 0;
+	if(base->window != NULL)
+	{
+		uint32_t start = 0;
+		uint32_t end = 0;
+		if(app_bootloader_delta_base_range(op, op_end, &start, &end) != APP_BOOTLOADER_DELTA_OK)
+			return APP_BOOTLOADER_DELTA_E_CORRUPT;
+		if(end > start && end - start <= base->window_size && end <= base->size)
+		{
+			if(base->read_cb(start, base->window, end - start, base->arg) != 0)
+				return APP_BOOTLOADER_DELTA_E_READ;
+			window_offset = start;
+			window_size = end - start;
+		}
+	}
+
+	uint32_t done = 0;
+	while(op < op_end)
+	{
+		if(op_end - op < APP_BOOTLOADER_DELTA_OP_HEADER_SIZE)
+			return APP_BOOTLOADER_DELTA_E_CORRUPT;
+		uint8_t type = op[0];
+		uint32_t length = op[1] | ((uint32_t)op[2] << 8);
+		op += APP_BOOTLOADER_DELTA_OP_HEADER_SIZE;
+		if(type >= APP_BOOTLOADER_DELTA_OP_MAX || length == 0 || length > dst_size - done)
+			return APP_BOOTLOADER_DELTA_E_CORRUPT;
+
+		if(type == APP_BOOTLOADER_DELTA_OP_COPY || type == APP_BOOTLOADER_DELTA_OP_ADD)
+		{
+			if(op_end - op < APP_BOOTLOADER_DELTA_OP_OFFSET_SIZE)
+				return APP_BOOTLOADER_DELTA_E_CORRUPT;
+			uint32_t offset = op[0] | ((uint32_t)op[1] << 8) | ((uint32_t)op[2] << 16) | ((uint32_t)op[3] << 24);
+			op += APP_BOOTLOADER_DELTA_OP_OFFSET_SIZE;
+			if(offset > base->size || length > base->size - offset)
+				return APP_BOOTLOADER_DELTA_E_CORRUPT;
+			if(app_bootloader_delta_base_read(base, &window_offset, &window_size, offset, dst + done, length) != 0)
+				return APP_BOOTLOADER_DELTA_E_READ;
+		}
+
+		if(type == APP_BOOTLOADER_DELTA_OP_ADD || type == APP_BOOTLOADER_DELTA_OP_INSERT)
+		{
+			if((uint32_t)(op_end - op) < length)
+				return APP_BOOTLOADER_DELTA_E_CORRUPT;
+			if(type == APP_BOOTLOADER_DELTA_OP_ADD)
+			{
+				for(uint32_t i = 0; i < length; i++)
+					dst[done + i] += op[i];
+			}
+			else
+				memcpy(dst + done, op, length);
+			op += length;
+		}
+		done += length;
+	}
+
+	return (done == dst_size)? APP_BOOTLOADER_DELTA_OK : APP_BOOTLOADER_DELTA_E_CORRUPT;
+}
@@ -0,0 +1,107 @@
+#include <stddef.h>
+#include "app_bootloader_flash.h"
+#include "app_bootloader_arch_common.h"
+
+#define APP_BOOTLOADER_FLASH_BANK_SIZE (0x100000) /* 1 MiB */
+#define APP_BOOTLOADER_FLASH_BANK_SECTOR_NBR (12)
+#define APP_BOOTLOADER_FLASH_SMALL_SECTOR_SIZE (0x4000) /* Sectors 0 to 3 */
+#define APP_BOOTLOADER_FLASH_MEDIUM_SECTOR_SIZE (0x10000) /* Sector 4 */
+#define APP_BOOTLOADER_FLASH_LARGE_SECTOR_SIZE (0x20000) /* Sectors 5 to 11 */
+
+/**
+ * @brief Program bytes one at a time. Used for unaligned head and tail.
+ *
+ * @param address Internal flash address.
+ * @param data Data to program.
+ * @param size Bytes to program.
+ * @return
+ * 			- APP_BOOTLOADER_FLASH_OK if no error.
+ */
+static int app_bootloader_flash_program_bytes(uint32_t address, const uint8_t * data, uint32_t size);
+
+static int app_bootloader_flash_program_bytes(uint32_t address, const uint8_t * data, uint32_t size)
+{
+	for(uint32_t i = 0; i < size; i++)
+	{
+		if(app_bootloader_arch_flash_program_byte(address + i, data[i]) != APP_BOOTLOADER_ARCH_OK)
+			return APP_BOOTLOADER_FLASH_E_FAIL;
+	}
+	return APP_BOOTLOADER_FLASH_OK;
+}
+
+int app_bootloader_flash_program(uint32_t address, const uint8_t * data, uint32_t size)
+{
+	if(data == NULL) return APP_BOOTLOADER_FLASH_E_PARAM;
+
+	uint32_t head = (APP_BOOTLOADER_FLASH_WORD_SIZE - (address % APP_BOOTLOADER_FLASH_WORD_SIZE)) % APP_BOOTLOADER_FLASH_WORD_SIZE;
+	if(head > size)
+		head = size;
+	uint32_t word_nbr = (size - head) / APP_BOOTLOADER_FLASH_WORD_SIZE;
+	uint32_t body = word_nbr * APP_BOOTLOADER_FLASH_WORD_SIZE;
+
+	app_bootloader_arch_flash_unlock();
+	int rt = app_bootloader_flash_program_bytes(address, data, head);
+	if(rt == APP_BOOTLOADER_FLASH_OK && word_nbr)
+	{
+		if(app_bootloader_arch_flash_program_words(address + head, data + head, word_nbr) != APP_BOOTLOADER_ARCH_OK)
+			rt = APP_BOOTLOADER_FLASH_E_FAIL;
+	}
+	if(rt == APP_BOOTLOADER_FLASH_OK)
+		rt = app_bootloader_flash_program_bytes(address + head + body, data + head + body, size - head - body);
+	app_bootloader_arch_flash_lock();
+
+	return rt;
+}
+
+int app_bootloader_flash_get_sector(uint32_t address, app_bootloader_flash_sector_t * sector)
+{
+	if(sector == NULL || address < APP_BOOTLOADER_FLASH_BASE || address > APP_BOOTLOADER_FLASH_END) return APP_BOOTLOADER_FLASH_E_PARAM;
+
+	uint32_t bank = (address - APP_BOOTLOADER_FLASH_BASE) / APP_BOOTLOADER_FLASH_BANK_SIZE;
+	uint32_t bank_base = APP_BOOTLOADER_FLASH_BASE + bank * APP_BOOTLOADER_FLASH_BANK_SIZE;
+	uint32_t offset = address - bank_base;
+
+	if(offset < 4 * APP_BOOTLOADER_FLASH_SMALL_SECTOR_SIZE)
+	{
+		sector->nbr = offset / APP_BOOTLOADER_FLASH_SMALL_SECTOR_SIZE;
+		sector->address = bank_base + sector->nbr * APP_BOOTLOADER_FLASH_SMALL_SECTOR_SIZE;
+		sector->size = APP_BOOTLOADER_FLASH_SMALL_SECTOR_SIZE;
+	}
+	else if(offset < APP_BOOTLOADER_FLASH_LARGE_SECTOR_SIZE)
+	{
+		sector->nbr = 4;
+		sector->address = bank_base + 4 * APP_BOOTLOADER_FLASH_SMALL_SECTOR_SIZE;
+		sector->size = APP_BOOTLOADER_FLASH_MEDIUM_SECTOR_SIZE;
+	}
+	else
+	{
+		/* Sector 5 starts at 128 KiB, from there every sector is 128 KiB */
+		uint32_t large = offset / APP_BOOTLOADER_FLASH_LARGE_SECTOR_SIZE;
+		sector->nbr = 4 + large;
+		sector->address = bank_base + large * APP_BOOTLOADER_FLASH_LARGE_SECTOR_SIZE;
+		sector->size = APP_BOOTLOADER_FLASH_LARGE_SECTOR_SIZE;
+	}
+
+	sector->nbr += bank * APP_BOOTLOADER_FLASH_BANK_SECTOR_NBR;
+	return APP_BOOTLOADER_FLASH_OK;
+}
+
+int app_bootloader_flash_erase_sector(const app_bootloader_flash_sector_t * sector)
+{
+	if(sector == NULL) return APP_BOOTLOADER_FLASH_E_PARAM;
+
+	app_bootloader_arch_flash_unlock();
+	int rt = app_bootloader_arch_flash_erase_sector(sector);
+	app_bootloader_arch_flash_lock();
+
+	return (rt == APP_BOOTLOADER_ARCH_OK)? APP_BOOTLOADER_FLASH_OK : APP_BOOTLOADER_FLASH_E_FAIL;
+}
+
+int app_bootloader_flash_read(uint32_t address, uint8_t * buffer, uint32_t size)
+{
+	if(buffer == NULL) return APP_BOOTLOADER_FLASH_E_PARAM;
+	if(address < APP_BOOTLOADER_FLASH_BASE || address > APP_BOOTLOADER_FLASH_END || size > (APP_BOOTLOADER_FLASH_END + 1 - address)) return APP_BOOTLOADER_FLASH_E_PARAM;
+
+	app_bootloader_arch_flash_read(address, buffer, size);
+	return APP_BOOTLOADER_FLASH_OK;
+}
@@ -0,0 +1,105 @@
+/*
+ * app_bootloader_lz4.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ *
+ * LZ4 block decoder. Each sequence is a token (literal length in the high nibble, match length - 4 in the
+ * low one), optional length bytes, literals, a little endian 16 bit match offset and optional match length
+ * bytes. The last sequence only has literals.
+ */
+#include <stddef.h>
+#include <string.h>
+#include "app_bootloader_lz4.h"
+
+#define LZ4_MIN_MATCH (4)
+#define LZ4_LENGTH_EXTENDED (15) /* Nibble value meaning more length bytes follow */
+
+/**
+ * @brief Read the length bytes following a token nibble.
+ *
+ * @param ip Input pointer, moved past the length bytes.
+ * @param ip_end End of input.
+ * @param length Nibble value in, whole length out.
+ * @param limit Longest valid length.
+ * @return
+ * 			- APP_BOOTLOADER_LZ4_OK if no error.
+ */
+static int app_bootloader_lz4_read_length(const uint8_t ** ip, const uint8_t * ip_end, uint32_t * length, uint32_t limit);
+
+static int app_bootloader_lz4_read_length(const uint8_t ** ip, const uint8_t * ip_end, uint32_t * length, uint32_t limit)
+{
+	if(*length == LZ4_LENGTH_EXTENDED)
+	{
+		uint8_t byte = 0;
+		do
+		{
+			if(*ip >= ip_end)
+				return APP_BOOTLOADER_LZ4_E_CORRUPT;
+			byte = *(*ip)++;
+			*length += byte;
+			/* Also stops a run of 0xFF from overflowing */
+			if(*length > limit)
+				return APP_BOOTLOADER_LZ4_E_CORRUPT;
+		}while(byte == UINT8_MAX);
+	}
+	return (*length > limit)? APP_BOOTLOADER_LZ4_E_CORRUPT : APP_BOOTLOADER_LZ4_OK;
+}
+
+int app_bootloader_lz4_decompress(const uint8_t * src, uint32_t src_size, uint8_t * dst, uint32_t dst_capacity, uint32_t * dst_size)
+{
+	if(src == NULL || dst == NULL || dst_size == NULL) return APP_BOOTLOADER_LZ4_E_PARAM;
+
+	const uint8_t * ip = src;
+	const uint8_t * ip_end = src + src_size;
+	uint8_t * op = dst;
+	uint8_t * op_end = dst + dst_capacity;
+
+	while(ip < ip_end)
+	{
+		uint8_t token = *ip++;
+
+		uint32_t length = token >> 4;
+		if(app_bootloader_lz4_read_length(&ip, ip_end, &length, (uint32_t)(ip_end - ip)) != APP_BOOTLOADER_LZ4_OK)
+			return APP_BOOTLOADER_LZ4_E_CORRUPT;
+		if(length > (uint32_t)(op_end - op))
+			return APP_BOOTLOADER_LZ4_E_CORRUPT;
+		memcpy(op, ip, length);
+		op += length;
+		ip += length;
+
+		/* Last sequence ends after its literals */
+		if(ip == ip_end)
+			break;
+
+		if(ip_end - ip < 2)
+			return APP_BOOTLOADER_LZ4_E_CORRUPT;
+		uint32_t offset = ip[0] | ((uint32_t)ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > (uint32_t)(op - dst))
+			return APP_BOOTLOADER_LZ4_E_CORRUPT;
+
+		length = token & 0x0F;
+		if(app_bootloader_lz4_read_length(&ip, ip_end, &length, (uint32_t)(op_end - op)) != APP_BOOTLOADER_LZ4_OK)
+			return APP_BOOTLOADER_LZ4_E_CORRUPT;
+		length += LZ4_MIN_MATCH;
+		if(length > (uint32_t)(op_end - op))
+			return APP_BOOTLOADER_LZ4_E_CORRUPT;
+
+		const uint8_t * match = op - offset;
+		if(offset >= length)
+		{
+			memcpy(op, match, length);
+			op += length;
+		}
+		else
+		{
+			/* Overlapping match repeats the last 'offset' bytes, copy byte by byte */
+			while(length--)
+				*op++ = *match++;
+		}
+	}
+
+	*dst_size = (uint32_t)(op - dst);
+	return APP_BOOTLOADER_LZ4_OK;
+}
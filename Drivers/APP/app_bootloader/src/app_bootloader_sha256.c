@@ -0,0 +1,136 @@
+/*
+ * app_bootloader_sha256.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ *
+ * FIPS 180-4 SHA-256. Cortex-M4 has no hash unit, this is plain C.
+ */
+#include <string.h>
+#include "app_bootloader_sha256.h"
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define SHA256_CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define SHA256_MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SHA256_EP0(x) (SHA256_ROTR(x, 2) ^ SHA256_ROTR(x, 13) ^ SHA256_ROTR(x, 22))
+#define SHA256_EP1(x) (SHA256_ROTR(x, 6) ^ SHA256_ROTR(x, 11) ^ SHA256_ROTR(x, 25))
+#define SHA256_SIG0(x) (SHA256_ROTR(x, 7) ^ SHA256_ROTR(x, 18) ^ ((x) >> 3))
+#define SHA256_SIG1(x) (SHA256_ROTR(x, 17) ^ SHA256_ROTR(x, 19) ^ ((x) >> 10))
+
+static const uint32_t sha256_k[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/**
+ * @brief Process one 64 bytes block.
+ *
+ * @param state Hash state.
+ * @param block Block.
+ */
+static void app_bootloader_sha256_transform(uint32_t * state, const uint8_t * block);
+
+static void app_bootloader_sha256_transform(uint32_t * state, const uint8_t * block)
+{
+	uint32_t w[64];
+	for(uint8_t i = 0; i < 16; i++, block += 4)
+		w[i] = ((uint32_t)block[0] << 24) | ((uint32_t)block[1] << 16) | ((uint32_t)block[2] << 8) | block[3];
+	for(uint8_t i = 16; i < 64; i++)
+		w[i] = SHA256_SIG1(w[i - 2]) + w[i - 7] + SHA256_SIG0(w[i - 15]) + w[i - 16];
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+	for(uint8_t i = 0; i < 64; i++)
+	{
+		uint32_t t1 = h + SHA256_EP1(e) + SHA256_CH(e, f, g) + sha256_k[i] + w[i];
+		uint32_t t2 = SHA256_EP0(a) + SHA256_MAJ(a, b, c);
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+void app_bootloader_sha256_init(app_bootloader_sha256_t * ctx)
+{
+	static const uint32_t sha256_init[8] =
+	{
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+	memcpy(ctx->state, sha256_init, sizeof(ctx->state));
+	ctx->length = 0;
+	ctx->block_size = 0;
+}
+
+void app_bootloader_sha256_update(app_bootloader_sha256_t * ctx, const uint8_t * data, uint32_t size)
+{
+	ctx->length += size;
+
+	if(ctx->block_size != 0)
+	{
+		uint32_t to_copy = APP_BOOTLOADER_SHA256_BLOCK_SIZE - ctx->block_size;
+		if(to_copy > size)
+			to_copy = size;
+		memcpy(ctx->block + ctx->block_size, data, to_copy);
+		ctx->block_size += to_copy;
+		data += to_copy;
+		size -= to_copy;
+		if(ctx->block_size < APP_BOOTLOADER_SHA256_BLOCK_SIZE)
+			return;
+		app_bootloader_sha256_transform(ctx->state, ctx->block);
+		ctx->block_size = 0;
+	}
+
+	/* Whole blocks straight from caller data */
+	for(; size >= APP_BOOTLOADER_SHA256_BLOCK_SIZE; data += APP_BOOTLOADER_SHA256_BLOCK_SIZE, size -= APP_BOOTLOADER_SHA256_BLOCK_SIZE)
+		app_bootloader_sha256_transform(ctx->state, data);
+
+	memcpy(ctx->block, data, size);
+	ctx->block_size = size;
+}
+
+void app_bootloader_sha256_final(app_bootloader_sha256_t * ctx, uint8_t * digest)
+{
+	uint64_t bit_length = ctx->length * 8;
+
+	/* Padding: 0x80, zeros, then the length in bits as big endian in the last 8 bytes of a block */
+	ctx->block[ctx->block_size++] = 0x80;
+	if(ctx->block_size > APP_BOOTLOADER_SHA256_BLOCK_SIZE - 8)
+	{
+		memset(ctx->block + ctx->block_size, 0, APP_BOOTLOADER_SHA256_BLOCK_SIZE - ctx->block_size);
+		app_bootloader_sha256_transform(ctx->state, ctx->block);
+		ctx->block_size = 0;
+	}
+	memset(ctx->block + ctx->block_size, 0, APP_BOOTLOADER_SHA256_BLOCK_SIZE - 8 - ctx->block_size);
+	for(uint8_t i = 0; i < 8; i++)
+		ctx->block[APP_BOOTLOADER_SHA256_BLOCK_SIZE - 1 - i] = (uint8_t)(bit_length >> (8 * i));
+	app_bootloader_sha256_transform(ctx->state, ctx->block);
+
+	for(uint8_t i = 0; i < 8; i++)
+	{
+		digest[4 * i] = (uint8_t)(ctx->state[i] >> 24);
+		digest[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+		digest[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+		digest[4 * i + 3] = (uint8_t)(ctx->state[i]);
+	}
+}
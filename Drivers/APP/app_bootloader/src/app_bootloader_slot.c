@@ -0,0 +1,176 @@
+/*
+ * app_bootloader_slot.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+#include <stddef.h>
+#include <string.h>
+#include "app_bootloader_slot.h"
+#include "app_bootloader_crc.h"
+
+#define APP_BOOTLOADER_SLOT_RECORD_MAGIC_BYTE (0x0AB0)
+
+/**
+ * @brief Copy of the boot control record as saved in SPI flash.
+ *
+ */
+typedef struct __attribute__((packed))
+{
+	uint16_t magic_byte;
+	uint32_t sequence; /* Incremented on each update. Newest valid copy is the current one */
+	app_bootloader_slot_ctrl_t ctrl;
+	uint32_t crc32; /* CRC-32 of the fields above */
+}app_bootloader_slot_record_t;
+
+static app_bootloader_slot_record_t slot_record = {
+	.ctrl = {.active_slot = APP_BOOTLOADER_SLOT_NONE, .previous_slot = APP_BOOTLOADER_SLOT_NONE, .installed_slot = APP_BOOTLOADER_SLOT_NONE},
+};
+static uint8_t slot_record_copy = APP_BOOTLOADER_SLOT_RECORD_COPY_NBR - 1; /* Copy holding 'slot_record'. Next update goes to the other */
+
+/**
+ * @brief Read one copy of the record.
+ *
+ * @param copy Copy number.
+ * @param record Pointer where copy will be read.
+ * @return
+ * 			- true if the copy is valid.
+ */
+static bool app_bootloader_slot_read_copy(uint8_t copy, app_bootloader_slot_record_t * record);
+/**
+ * @brief Save a new state into the older copy. Nothing is written if state does not change.
+ *
+ * @param ctrl New state.
+ * @return
+ * 			- APP_BOOTLOADER_SLOT_OK if no error.
+ * 			- APP_BOOTLOADER_SLOT_E_FLASH if copy can not be written or does not read back.
+ */
+static int app_bootloader_slot_save(const app_bootloader_slot_ctrl_t * ctrl);
+
+static bool app_bootloader_slot_read_copy(uint8_t copy, app_bootloader_slot_record_t * record)
+{
+	uint32_t address = APP_BOOTLOADER_SLOT_RECORD_OFFSET + copy * APP_BOOTLOADER_SLOT_RECORD_COPY_SIZE;
+	if(spi_flash_read((uint8_t *)record, address, sizeof(*record)) != SPI_FLASH_OK)
+		return false;
+	if(record->magic_byte != APP_BOOTLOADER_SLOT_RECORD_MAGIC_BYTE)
+		return false;
+	return record->crc32 == app_bootloader_crc32((uint8_t *)record, offsetof(app_bootloader_slot_record_t, crc32));
+}
+
+static int app_bootloader_slot_save(const app_bootloader_slot_ctrl_t * ctrl)
+{
+	if(memcmp(ctrl, &slot_record.ctrl, sizeof(*ctrl)) == 0)
+		return APP_BOOTLOADER_SLOT_OK;
+
+	app_bootloader_slot_record_t record = {
+		.magic_byte = APP_BOOTLOADER_SLOT_RECORD_MAGIC_BYTE,
+		.sequence = slot_record.sequence + 1,
+		.ctrl = *ctrl,
+	};
+	record.crc32 = app_bootloader_crc32((uint8_t *)&record, offsetof(app_bootloader_slot_record_t, crc32));
+
+	uint8_t copy = (slot_record_copy + 1) % APP_BOOTLOADER_SLOT_RECORD_COPY_NBR;
+	uint32_t address = APP_BOOTLOADER_SLOT_RECORD_OFFSET + copy * APP_BOOTLOADER_SLOT_RECORD_COPY_SIZE;
+	if(spi_flash_erase_range(address, APP_BOOTLOADER_SLOT_RECORD_COPY_SIZE) != SPI_FLASH_OK)
+		return APP_BOOTLOADER_SLOT_E_FLASH;
+	if(spi_flash_write((uint8_t *)&record, address, sizeof(record)) != SPI_FLASH_OK)
+		return APP_BOOTLOADER_SLOT_E_FLASH;
+
+	/* Current copy stays in use until the new one is known to be good */
+	app_bootloader_slot_record_t check;
+	if(!app_bootloader_slot_read_copy(copy, &check) || memcmp(&check, &record, sizeof(record)) != 0)
+		return APP_BOOTLOADER_SLOT_E_FLASH;
+
+	slot_record = record;
+	slot_record_copy = copy;
+	return APP_BOOTLOADER_SLOT_OK;
+}
+
+int app_bootloader_slot_init(void)
+{
+	bool found = false;
+	for(uint8_t copy = 0; copy < APP_BOOTLOADER_SLOT_RECORD_COPY_NBR; copy++)
+	{
+		app_bootloader_slot_record_t record;
+		if(!app_bootloader_slot_read_copy(copy, &record))
+			continue;
+		/* Sequence may wrap, difference tells which one is newer */
+		if(!found || (int32_t)(record.sequence - slot_record.sequence) > 0)
+		{
+			slot_record = record;
+			slot_record_copy = copy;
+			found = true;
+		}
+	}
+	return APP_BOOTLOADER_SLOT_OK;
+}
+
+int app_bootloader_slot_get(app_bootloader_slot_ctrl_t * ctrl)
+{
+	if(ctrl == NULL) return APP_BOOTLOADER_SLOT_E_PARAM;
+	*ctrl = slot_record.ctrl;
+	return APP_BOOTLOADER_SLOT_OK;
+}
+
+int app_bootloader_slot_set_active(uint8_t slot)
+{
+	if(slot == APP_BOOTLOADER_SLOT_NONE) return APP_BOOTLOADER_SLOT_E_PARAM;
+
+	app_bootloader_slot_ctrl_t ctrl = slot_record.ctrl;
+	if(ctrl.active_slot == slot)
+		return APP_BOOTLOADER_SLOT_OK;
+	if(ctrl.confirmed)
+		ctrl.previous_slot = ctrl.active_slot;
+	ctrl.active_slot = slot;
+	ctrl.try_nbr = 0;
+	ctrl.confirmed = false;
+	return app_bootloader_slot_save(&ctrl);
+}
+
+int app_bootloader_slot_confirm(void)
+{
+	app_bootloader_slot_ctrl_t ctrl = slot_record.ctrl;
+	if(ctrl.active_slot == APP_BOOTLOADER_SLOT_NONE) return APP_BOOTLOADER_SLOT_E_EMPTY;
+
+	ctrl.try_nbr = 0;
+	ctrl.confirmed = true;
+	return app_bootloader_slot_save(&ctrl);
+}
+
+int app_bootloader_slot_select(uint8_t * slot)
+{
+	if(slot == NULL) return APP_BOOTLOADER_SLOT_E_PARAM;
+
+	app_bootloader_slot_ctrl_t ctrl = slot_record.ctrl;
+	if(ctrl.active_slot == APP_BOOTLOADER_SLOT_NONE) return APP_BOOTLOADER_SLOT_E_EMPTY;
+
+	if(!ctrl.confirmed)
+	{
+		if(ctrl.try_nbr >= APP_BOOTLOADER_SLOT_MAX_TRY && ctrl.previous_slot != APP_BOOTLOADER_SLOT_NONE)
+		{
+			ctrl.active_slot = ctrl.previous_slot;
+			ctrl.previous_slot = APP_BOOTLOADER_SLOT_NONE;
+			ctrl.try_nbr = 0;
+			ctrl.confirmed = true;
+		}
+		else if(ctrl.try_nbr < UINT8_MAX)
+		{
+			/* Counted before the jump, a slot that hangs or resets still uses its tries */
+			ctrl.try_nbr++;
+		}
+	}
+
+	int rt = app_bootloader_slot_save(&ctrl);
+	if(rt != APP_BOOTLOADER_SLOT_OK)
+		return rt;
+	*slot = ctrl.active_slot;
+	return APP_BOOTLOADER_SLOT_OK;
+}
+
+int app_bootloader_slot_set_installed(uint8_t slot, uint32_t crc32)
+{
+	app_bootloader_slot_ctrl_t ctrl = slot_record.ctrl;
+	ctrl.installed_slot = slot;
+	ctrl.installed_crc32 = (slot == APP_BOOTLOADER_SLOT_NONE)? 0 : crc32;
+	return app_bootloader_slot_save(&ctrl);
+}
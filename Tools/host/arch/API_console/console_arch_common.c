@@ -0,0 +1,370 @@
+/*
+ * console_arch_common.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ *
+ * Host port. Console handle is an endpoint string:
+ *  - NULL or "pty": a pseudo terminal is opened and its slave path printed on stderr.
+ *  - "unix:<path>": a UNIX stream socket is listened on <path>, one client at a time.
+ *
+ * Sockets and pseudo terminals have no line rate. With CONSOLE_ARCH_LINE_PACING set, bytes are paced at the
+ * current baud rate (8N1) both ways, like the UART, and CONSOLE_ARCH_LINE_LATENCY_US adds a round trip
+ * latency to host bytes, like a USB serial adapter does.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "console_arch_common.h"
+
+#define CONSOLE_ARCH_PTY_ENDPOINT "pty"
+#define CONSOLE_ARCH_UNIX_ENDPOINT_PREFIX "unix:"
+/* Optional symlink to the pty slave, so host tools can use a fixed path */
+#define CONSOLE_ARCH_PTY_LINK_ENV "CONSOLE_ARCH_PTY_LINK"
+#define CONSOLE_ARCH_TRANSMIT_TIMEOUT (100)
+#define CONSOLE_ARCH_LINE_PACING_ENV "CONSOLE_ARCH_LINE_PACING"
+#define CONSOLE_ARCH_LINE_LATENCY_ENV "CONSOLE_ARCH_LINE_LATENCY_US"
+#define CONSOLE_ARCH_LINE_BITS_PER_BYTE (10) /* Start, 8 data and stop bits */
+#define CONSOLE_ARCH_LINE_CHUNK_MAX (64)
+
+/**
+ * @brief Host bytes read from the client but not yet delivered, when pacing.
+ *
+ */
+typedef struct
+{
+	bool enable;
+	uint64_t latency_ns; /* Round trip latency, all of it applied to host bytes */
+	uint64_t byte_ns; /* Time of one byte at current baud rate */
+	uint64_t rx_free_ns; /* Time when the line to the client is idle again */
+	uint8_t rx_buffer[CONSOLE_MAX_RECV_SIZE];
+	uint32_t rx_size;
+	struct
+	{
+		uint64_t seen_ns; /* Time the chunk was read from the client */
+		uint32_t size;
+	}rx_chunk[CONSOLE_ARCH_LINE_CHUNK_MAX]; /* Chunks in 'rx_buffer', oldest first */
+	uint8_t rx_chunk_nbr;
+}console_arch_line_t;
+
+static volatile console_state_t * console_state = NULL;
+static int console_fd = -1; /* Pty master or connected client */
+static int console_listen_fd = -1; /* UNIX socket waiting for clients */
+static int console_pty_slave_fd = -1; /* Kept open so the master never reads EIO between clients */
+static console_arch_line_t console_line = {0};
+
+/**
+ * @brief Open a raw pseudo terminal.
+ *
+ * @return
+ * 			- CONSOLE_ARCH_OK if no error.
+ */
+static int console_arch_open_pty(void);
+/**
+ * @brief Listen on a UNIX stream socket.
+ *
+ * @param path Socket path.
+ * @return
+ * 			- CONSOLE_ARCH_OK if no error.
+ */
+static int console_arch_open_unix(const char * path);
+/**
+ * @brief Accept a pending client if none is connected.
+ *
+ * @return true: a client is connected. false: no client.
+ */
+static bool console_arch_client_ready(void);
+/**
+ * @brief Get monotonic time.
+ *
+ * @return Time in nanoseconds.
+ */
+static uint64_t console_arch_now_ns(void);
+/**
+ * @brief Set paced byte time from a baud rate.
+ *
+ * @param baudrate Baud rate.
+ */
+static void console_arch_line_set_baudrate(uint32_t baudrate);
+/**
+ * @brief Read whatever the client sent into the pacing buffer, then deliver the bytes that are through the line by now.
+ *
+ * @param data Buffer.
+ * @param data_size Delivered size.
+ * @return
+ * 			- CONSOLE_ARCH_OK if bytes were delivered, or with 'data_size' 0 if client left.
+ * 			- CONSOLE_ARCH_E_BUSY if none are through yet.
+ * 			- CONSOLE_ARCH_E_IO if client can not be read.
+ */
+static int console_arch_line_receive(uint8_t * data, uint16_t * data_size);
+
+static int console_arch_open_pty(void)
+{
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+		return CONSOLE_ARCH_E_IO;
+
+	const char * slave_path = ptsname(master);
+	int slave = open(slave_path, O_RDWR | O_NOCTTY);
+	if(slave < 0)
+		return CONSOLE_ARCH_E_IO;
+
+	/* Frames are binary, no line discipline */
+	struct termios tio = {0};
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+	const char * link_path = getenv(CONSOLE_ARCH_PTY_LINK_ENV);
+	if(link_path != NULL)
+	{
+		unlink(link_path);
+		if(symlink(slave_path, link_path) != 0)
+			perror(link_path);
+	}
+
+	fprintf(stderr, "Console on %s\n", slave_path);
+	console_fd = master;
+	console_pty_slave_fd = slave;
+	return CONSOLE_ARCH_OK;
+}
+
+static int console_arch_open_unix(const char * path)
+{
+	struct sockaddr_un address = {.sun_family = AF_UNIX};
+	if(strlen(path) >= sizeof(address.sun_path))
+		return CONSOLE_ARCH_E_IO;
+	strcpy(address.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+	if(fd < 0)
+		return CONSOLE_ARCH_E_IO;
+
+	unlink(path);
+	if(bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 1) != 0)
+	{
+		perror(path);
+		close(fd);
+		return CONSOLE_ARCH_E_IO;
+	}
+
+	fprintf(stderr, "Console on unix:%s\n", path);
+	console_listen_fd = fd;
+	return CONSOLE_ARCH_OK;
+}
+
+static bool console_arch_client_ready(void)
+{
+	if(console_fd >= 0)
+		return true;
+	if(console_listen_fd < 0)
+		return false;
+
+	console_fd = accept4(console_listen_fd, NULL, NULL, SOCK_NONBLOCK);
+	return (console_fd >= 0);
+}
+
+static uint64_t console_arch_now_ns(void)
+{
+	struct timespec now = {0};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void console_arch_line_set_baudrate(uint32_t baudrate)
+{
+	console_line.byte_ns = (uint64_t)CONSOLE_ARCH_LINE_BITS_PER_BYTE * 1000000000 / baudrate;
+}
+
+static int console_arch_line_receive(uint8_t * data, uint16_t * data_size)
+{
+	uint64_t now = console_arch_now_ns();
+	if(console_line.rx_chunk_nbr < CONSOLE_ARCH_LINE_CHUNK_MAX && console_line.rx_size < sizeof(console_line.rx_buffer))
+	{
+		ssize_t rt = read(console_fd, console_line.rx_buffer + console_line.rx_size, sizeof(console_line.rx_buffer) - console_line.rx_size);
+		if(rt > 0)
+		{
+			console_line.rx_chunk[console_line.rx_chunk_nbr].seen_ns = now;
+			console_line.rx_chunk[console_line.rx_chunk_nbr].size = rt;
+			console_line.rx_chunk_nbr++;
+			console_line.rx_size += rt;
+		}
+		else if(rt == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		{
+			/* Bytes in flight are lost with the client, like a cable pulled out */
+			console_line.rx_size = 0;
+			console_line.rx_chunk_nbr = 0;
+			return (rt == 0)? CONSOLE_ARCH_OK : CONSOLE_ARCH_E_IO;
+		}
+	}
+
+	/* A chunk goes on the line once its latency elapsed and the line is idle, one byte each 'byte_ns' */
+	uint32_t size = 0;
+	while(console_line.rx_chunk_nbr && size < CONSOLE_MAX_RECV_SIZE)
+	{
+		uint64_t start = console_line.rx_chunk[0].seen_ns + console_line.latency_ns;
+		if(start < console_line.rx_free_ns)
+			start = console_line.rx_free_ns;
+		if(now < start + console_line.byte_ns)
+			break;
+
+		uint64_t through = (now - start) / console_line.byte_ns;
+		if(through > console_line.rx_chunk[0].size)
+			through = console_line.rx_chunk[0].size;
+		if(through > CONSOLE_MAX_RECV_SIZE - size)
+			through = CONSOLE_MAX_RECV_SIZE - size;
+		size += through;
+		console_line.rx_free_ns = start + through * console_line.byte_ns;
+		console_line.rx_chunk[0].size -= through;
+		if(console_line.rx_chunk[0].size == 0)
+		{
+			console_line.rx_chunk_nbr--;
+			memmove(console_line.rx_chunk, console_line.rx_chunk + 1, console_line.rx_chunk_nbr * sizeof(console_line.rx_chunk[0]));
+		}
+	}
+	if(size == 0)
+		return CONSOLE_ARCH_E_BUSY;
+
+	memcpy(data, console_line.rx_buffer, size);
+	console_line.rx_size -= size;
+	memmove(console_line.rx_buffer, console_line.rx_buffer + size, console_line.rx_size);
+	*data_size = size;
+	return CONSOLE_ARCH_OK;
+}
+
+int console_arch_common_comm_channel_init(void * channel_hdle, volatile console_state_t * state_ref)
+{
+	if(state_ref == NULL) return CONSOLE_ARCH_E_IO;
+	if(console_state != NULL) return CONSOLE_ARCH_E_READY;
+
+	const char * endpoint = (const char *) channel_hdle;
+	int rt = CONSOLE_ARCH_E_IO;
+	if(endpoint == NULL || strcmp(endpoint, CONSOLE_ARCH_PTY_ENDPOINT) == 0)
+		rt = console_arch_open_pty();
+	else if(strncmp(endpoint, CONSOLE_ARCH_UNIX_ENDPOINT_PREFIX, strlen(CONSOLE_ARCH_UNIX_ENDPOINT_PREFIX)) == 0)
+		rt = console_arch_open_unix(endpoint + strlen(CONSOLE_ARCH_UNIX_ENDPOINT_PREFIX));
+
+	if(rt != CONSOLE_ARCH_OK)
+		return rt;
+
+	const char * pacing = getenv(CONSOLE_ARCH_LINE_PACING_ENV);
+	const char * latency = getenv(CONSOLE_ARCH_LINE_LATENCY_ENV);
+	console_line.enable = (pacing != NULL && strcmp(pacing, "0") != 0);
+	console_line.latency_ns = (latency != NULL)? strtoull(latency, NULL, 0) * 1000 : 0;
+	console_arch_line_set_baudrate(CONSOLE_UART_BAUDRATE);
+	if(console_line.enable)
+		fprintf(stderr, "Console paced at %u baud, %lu us round trip\n", CONSOLE_UART_BAUDRATE, (unsigned long)(console_line.latency_ns / 1000));
+
+	console_state = state_ref;
+	*console_state = CONSOLE_STATE_LISTEN;
+	return CONSOLE_ARCH_OK;
+}
+
+int console_arch_common_comm_channel_send(uint8_t * data, uint16_t data_size)
+{
+	if(console_state == NULL) return CONSOLE_ARCH_E_READY;
+	if(!console_arch_client_ready()) return CONSOLE_ARCH_E_IO;
+
+	uint16_t sent = 0;
+	while(sent < data_size)
+	{
+		ssize_t rt = write(console_fd, data + sent, data_size - sent);
+		if(rt > 0)
+		{
+			sent += rt;
+			continue;
+		}
+		if(rt < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			return CONSOLE_ARCH_E_IO;
+
+		/* Peer is slower than us, wait like a blocking UART transmit would */
+		struct pollfd pfd = {.fd = console_fd, .events = POLLOUT};
+		if(poll(&pfd, 1, CONSOLE_ARCH_TRANSMIT_TIMEOUT) <= 0)
+			return CONSOLE_ARCH_E_IO;
+	}
+
+	if(console_line.enable)
+	{
+		/* UART transmit blocks until the last stop bit */
+		uint64_t line_ns = data_size * console_line.byte_ns;
+		struct timespec line_time = {.tv_sec = line_ns / 1000000000, .tv_nsec = line_ns % 1000000000};
+		while(nanosleep(&line_time, &line_time) != 0 && errno == EINTR);
+	}
+	return CONSOLE_ARCH_OK;
+}
+
+int console_arch_common_comm_channel_receive(uint8_t * data, uint16_t * data_size)
+{
+	if(console_state == NULL) return CONSOLE_ARCH_E_READY;
+
+	*data_size = 0;
+	if(!console_arch_client_ready()) return CONSOLE_ARCH_E_BUSY;
+
+	if(console_line.enable)
+	{
+		int line_rt = console_arch_line_receive(data, data_size);
+		if(line_rt == CONSOLE_ARCH_OK && *data_size == 0 && console_listen_fd >= 0)
+		{
+			/* Client left, wait for the next one */
+			close(console_fd);
+			console_fd = -1;
+			return CONSOLE_ARCH_E_BUSY;
+		}
+		if(line_rt == CONSOLE_ARCH_E_IO)
+			*console_state = CONSOLE_STATE_ERROR;
+		else if(line_rt == CONSOLE_ARCH_OK)
+			*console_state = CONSOLE_STATE_LISTEN;
+		return line_rt;
+	}
+
+	ssize_t rt = read(console_fd, data, CONSOLE_MAX_RECV_SIZE);
+	if(rt > 0)
+	{
+		*data_size = (uint16_t) rt;
+		*console_state = CONSOLE_STATE_LISTEN;
+		return CONSOLE_ARCH_OK;
+	}
+
+	if(rt == 0 && console_listen_fd >= 0)
+	{
+		/* Client left, wait for the next one */
+		close(console_fd);
+		console_fd = -1;
+	}
+	else if(rt < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	{
+		*console_state = CONSOLE_STATE_ERROR;
+		return CONSOLE_ARCH_E_IO;
+	}
+	return CONSOLE_ARCH_E_BUSY;
+}
+
+int console_arch_common_comm_channel_check_baudrate(uint32_t baudrate)
+{
+	if(console_state == NULL) return CONSOLE_ARCH_E_READY;
+	/* Sockets and pseudo terminals have no line rate, every rate works. Pacing follows it */
+	return (baudrate != 0)? CONSOLE_ARCH_OK : CONSOLE_ARCH_E_PARAM;
+}
+
+int console_arch_common_comm_channel_set_baudrate(uint32_t baudrate)
+{
+	int rt = console_arch_common_comm_channel_check_baudrate(baudrate);
+	if(rt == CONSOLE_ARCH_OK)
+		console_arch_line_set_baudrate(baudrate);
+	return rt;
+}
@@ -0,0 +1,16 @@
+/*
+ * delay_arch_common.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+#include <time.h>
+
+#include "delay_arch_common.h"
+
+uint32_t delay_arch_common_tick(void)
+{
+	struct timespec now = {0};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
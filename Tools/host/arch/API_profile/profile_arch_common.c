@@ -0,0 +1,27 @@
+/*
+ * profile_arch_common.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+#include <time.h>
+
+#include "profile_arch_common.h"
+
+#define PROFILE_ARCH_CYCLE_HZ (1000000000) /* One cycle per nanosecond */
+
+void profile_arch_common_init(void)
+{
+}
+
+uint32_t profile_arch_common_cycles(void)
+{
+	struct timespec now = {0};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)(now.tv_sec * PROFILE_ARCH_CYCLE_HZ + now.tv_nsec);
+}
+
+uint32_t profile_arch_common_cycle_hz(void)
+{
+	return PROFILE_ARCH_CYCLE_HZ;
+}
@@ -0,0 +1,617 @@
+/*
+ * spi_flash_arch_common.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ *
+ * Host port. Emulates a W25Q64JV on top of a memory mapped file. The file is
+ * given as SPI handle (path string), erased chips read 0xFF, page program wraps
+ * inside the page and busy/WEL bits follow datasheet typical timings. Program and
+ * erase can be suspended to read, the array is updated when the command is taken.
+ * A suspend issued less than tSUS after a resume is ignored and reported.
+ */
+#define _DEFAULT_SOURCE
+#include <spi_flash_arch_common.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "API_spi_flash_def.h"
+
+#define SPI_FLASH_EMU_DEFAULT_FILE "spi_flash.bin"
+#define SPI_FLASH_EMU_FILE_ENV "SPI_FLASH_EMU_FILE"
+/* Percentage applied to busy timings. 0 makes every operation instant */
+#define SPI_FLASH_EMU_TIME_SCALE_ENV "SPI_FLASH_EMU_TIME_SCALE"
+
+#define SPI_FLASH_EMU_SIZE (8 * 1024 * 1024) /* 64 Mbit */
+#define SPI_FLASH_EMU_PAGE_SIZE (256)
+#define SPI_FLASH_EMU_ADDRESS_SIZE (3)
+#define SPI_FLASH_EMU_WRITE_DATA_MAX_SIZE (2)
+
+/* W25Q64JV typical timings in microseconds */
+#define SPI_FLASH_EMU_T_PP_US (400)
+#define SPI_FLASH_EMU_T_SE_US (45000)
+#define SPI_FLASH_EMU_T_BE1_US (120000)
+#define SPI_FLASH_EMU_T_BE2_US (150000)
+#define SPI_FLASH_EMU_T_CE_US (20000000)
+#define SPI_FLASH_EMU_T_W_US (10000)
+#define SPI_FLASH_EMU_T_SUS_US (20) /* Resume to next suspend. Not scaled, it is not a busy time */
+
+#define SPI_FLASH_EMU_CMD_DEL_CHIP_ALT (0x60U) /* Chip erase alternative opcode */
+#define SPI_FLASH_EMU_SR1_WRITABLE_MASK (0xFC) /* BUSY and WEL are read only */
+
+static const uint8_t spi_flash_emu_jedec_id[] = {0xEF, 0x40, 0x17};
+static const uint8_t spi_flash_emu_unique_id[] = {0xD2, 0x64, 0x5C, 0x91, 0x26, 0x09, 0x20, 0x24};
+
+/**
+ * @brief Emulated chip and ongoing transaction.
+ *
+ */
+typedef struct
+{
+	uint8_t * memory; /* Mapped file */
+	int fd;
+	uint32_t time_scale; /* Percentage applied to busy timings */
+	uint8_t status_reg[3];
+	uint64_t busy_until_us; /* End of current program/erase */
+	uint64_t suspended_us; /* Busy time left when program/erase was suspended */
+	uint64_t resumed_at_us; /* Time of last resume */
+	bool reset_enabled; /* Last command was enable reset */
+	/* Transaction, from CS low to CS high */
+	bool selected;
+	bool ignored; /* Command arrived while busy */
+	bool has_opcode;
+	uint8_t opcode;
+	uint8_t address_nbr; /* Address bytes received */
+	uint32_t address;
+	uint8_t dummy_nbr; /* Dummy bytes still expected */
+	uint32_t data_nbr; /* Data bytes transferred */
+	uint8_t write_data[SPI_FLASH_EMU_WRITE_DATA_MAX_SIZE]; /* Status register write data */
+	uint8_t page[SPI_FLASH_EMU_PAGE_SIZE]; /* Page program latch */
+	bool page_written[SPI_FLASH_EMU_PAGE_SIZE];
+}spi_flash_emu_t;
+
+static void * ARCH_SPI_HANDLE_NAME = NULL;
+static spi_flash_arch_rx_it_hdle _spi_rx_hdle = NULL;
+static spi_flash_arch_tx_it_hdle _spi_tx_hdle = NULL;
+static spi_flash_emu_t spi_flash_emu = {.fd = -1};
+
+/**
+ * @brief Check if SPI handle is ready.
+ *
+ * @return true: read. false: not ready.
+ */
+static inline bool spi_flash_arch_ready(void);
+/**
+ * @brief Get monotonic time in microseconds.
+ *
+ * @return Microseconds.
+ */
+static uint64_t spi_flash_emu_now_us(void);
+/**
+ * @brief Release BUSY and WEL bits when the ongoing operation is over.
+ *
+ */
+static void spi_flash_emu_update(void);
+/**
+ * @brief Set chip busy for a datasheet time.
+ *
+ * @param time_us Typical time in microseconds.
+ */
+static void spi_flash_emu_set_busy(uint32_t time_us);
+/**
+ * @brief Address bytes expected after an opcode.
+ *
+ * @param opcode Command.
+ * @return Address size.
+ */
+static uint8_t spi_flash_emu_address_size(uint8_t opcode);
+/**
+ * @brief Dummy bytes expected after the address.
+ *
+ * @param opcode Command.
+ * @return Dummy size.
+ */
+static uint8_t spi_flash_emu_dummy_size(uint8_t opcode);
+/**
+ * @brief Clock one byte out of the master.
+ *
+ * @param byte Byte.
+ */
+static void spi_flash_emu_write_byte(uint8_t byte);
+/**
+ * @brief Clock one byte into the master.
+ *
+ * @return Byte.
+ */
+static uint8_t spi_flash_emu_read_byte(void);
+/**
+ * @brief Execute the command latched during the transaction. Called on CS high.
+ *
+ */
+static void spi_flash_emu_execute(void);
+/**
+ * @brief Map backing file. It is created and erased if needed.
+ *
+ * @param path File path.
+ * @return
+ * 			- SPI_FLASH_ARCH_OK if no error.
+ */
+static int spi_flash_emu_open(const char * path);
+
+static inline bool spi_flash_arch_ready(void)
+{
+	return (_spi_hdle == NULL?false:true);
+}
+
+static uint64_t spi_flash_emu_now_us(void)
+{
+	struct timespec now = {0};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void spi_flash_emu_update(void)
+{
+	if(API_SPI_FLASH_BSY_IS_SET(spi_flash_emu.status_reg[0]) && spi_flash_emu_now_us() >= spi_flash_emu.busy_until_us)
+		spi_flash_emu.status_reg[0] &= ~(API_SPI_FLASH_BSY_BIT | API_SPI_FLASH_WEL_BIT);
+}
+
+static void spi_flash_emu_set_busy(uint32_t time_us)
+{
+	spi_flash_emu.status_reg[0] |= API_SPI_FLASH_BSY_BIT;
+	spi_flash_emu.busy_until_us = spi_flash_emu_now_us() + ((uint64_t)time_us * spi_flash_emu.time_scale) / 100;
+}
+
+static uint8_t spi_flash_emu_address_size(uint8_t opcode)
+{
+	switch(opcode)
+	{
+		case API_SPI_FLASH_CMD_READ_DATA:
+		case API_SPI_FLASH_CMD_FAST_READ:
+		case API_SPI_FLASH_CMD_FAST_READ_DUAL_OUTPUT:
+		case API_SPI_FLASH_CMD_FAST_READ_QUAD_OUTPUT:
+		case API_SPI_FLASH_CMD_WRITE_PAGE:
+		case API_SPI_FLASH_CMD_DEL_SECTOR:
+		case API_SPI_FLASH_CMD_DEL_32KB_BLOCK:
+		case API_SPI_FLASH_CMD_DEL_64KB_BLOCK:
+			return SPI_FLASH_EMU_ADDRESS_SIZE;
+		default:
+			return 0;
+	}
+}
+
+static uint8_t spi_flash_emu_dummy_size(uint8_t opcode)
+{
+	switch(opcode)
+	{
+		case API_SPI_FLASH_CMD_FAST_READ:
+		case API_SPI_FLASH_CMD_FAST_READ_DUAL_OUTPUT:
+		case API_SPI_FLASH_CMD_FAST_READ_QUAD_OUTPUT:
+			return 1;
+		case API_SPI_FLASH_CMD_READ_UNIQUE_ID_NUMBER:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+static void spi_flash_emu_write_byte(uint8_t byte)
+{
+	spi_flash_emu_t * emu = &spi_flash_emu;
+	if(!emu->selected)
+		return;
+
+	if(!emu->has_opcode)
+	{
+		spi_flash_emu_update();
+		emu->has_opcode = true;
+		emu->opcode = byte;
+		emu->dummy_nbr = spi_flash_emu_dummy_size(byte);
+		/* Only status reads and suspend are accepted while a program/erase is ongoing */
+		emu->ignored = API_SPI_FLASH_BSY_IS_SET(emu->status_reg[0])
+				&& byte != API_SPI_FLASH_CMD_READ_STATUS_REG_1
+				&& byte != API_SPI_FLASH_CMD_READ_STATUS_REG_2
+				&& byte != API_SPI_FLASH_CMD_READ_STATUS_REG_3
+				&& byte != API_SPI_FLASH_CMD_SUSPEND;
+		/* No other program/erase can start while one is suspended */
+		if(API_SPI_FLASH_SUS_IS_SET(emu->status_reg[1]))
+			emu->ignored = byte == API_SPI_FLASH_CMD_WRITE_PAGE
+					|| byte == API_SPI_FLASH_CMD_DEL_SECTOR
+					|| byte == API_SPI_FLASH_CMD_DEL_32KB_BLOCK
+					|| byte == API_SPI_FLASH_CMD_DEL_64KB_BLOCK
+					|| byte == API_SPI_FLASH_CMD_DEL_CHIP
+					|| byte == SPI_FLASH_EMU_CMD_DEL_CHIP_ALT
+					|| byte == API_SPI_FLASH_CMD_WRITE_STATUS_REG_1
+					|| byte == API_SPI_FLASH_CMD_WRITE_STATUS_REG_2
+					|| byte == API_SPI_FLASH_CMD_WRITE_STATUS_REG_3;
+		return;
+	}
+	if(emu->address_nbr < spi_flash_emu_address_size(emu->opcode))
+	{
+		emu->address = (emu->address << 8) | byte;
+		emu->address_nbr++;
+		return;
+	}
+	if(emu->dummy_nbr)
+	{
+		emu->dummy_nbr--;
+		return;
+	}
+
+	/* Data phase */
+	switch(emu->opcode)
+	{
+		case API_SPI_FLASH_CMD_WRITE_PAGE:
+		{
+			/* Latch wraps to the start of the page when more than a page is sent */
+			uint8_t offset = (uint8_t)((emu->address + emu->data_nbr) % SPI_FLASH_EMU_PAGE_SIZE);
+			emu->page[offset] = byte;
+			emu->page_written[offset] = true;
+			break;
+		}
+		case API_SPI_FLASH_CMD_WRITE_STATUS_REG_1:
+		case API_SPI_FLASH_CMD_WRITE_STATUS_REG_2:
+		case API_SPI_FLASH_CMD_WRITE_STATUS_REG_3:
+		{
+			if(emu->data_nbr < SPI_FLASH_EMU_WRITE_DATA_MAX_SIZE)
+				emu->write_data[emu->data_nbr] = byte;
+			break;
+		}
+		default:
+			/* Master clocks zeros while reading */
+			break;
+	}
+	emu->data_nbr++;
+}
+
+static uint8_t spi_flash_emu_read_byte(void)
+{
+	spi_flash_emu_t * emu = &spi_flash_emu;
+	if(!emu->selected || !emu->has_opcode || emu->ignored)
+		return 0xFF;
+
+	/* Dummy and address bytes are clocked by writes. Reading before gives nothing useful */
+	if(emu->address_nbr < spi_flash_emu_address_size(emu->opcode) || emu->dummy_nbr)
+		return 0xFF;
+
+	uint8_t byte = 0xFF;
+	switch(emu->opcode)
+	{
+		case API_SPI_FLASH_CMD_READ_STATUS_REG_1:
+		{
+			/* Status register is continuously updated while CS stays low */
+			spi_flash_emu_update();
+			byte = emu->status_reg[0];
+			break;
+		}
+		case API_SPI_FLASH_CMD_READ_STATUS_REG_2:
+		{
+			byte = emu->status_reg[1];
+			break;
+		}
+		case API_SPI_FLASH_CMD_READ_STATUS_REG_3:
+		{
+			byte = emu->status_reg[2];
+			break;
+		}
+		case API_SPI_FLASH_CMD_READ_JEDEC_ID:
+		{
+			byte = spi_flash_emu_jedec_id[emu->data_nbr % sizeof(spi_flash_emu_jedec_id)];
+			break;
+		}
+		case API_SPI_FLASH_CMD_READ_UNIQUE_ID_NUMBER:
+		{
+			byte = spi_flash_emu_unique_id[emu->data_nbr % sizeof(spi_flash_emu_unique_id)];
+			break;
+		}
+		case API_SPI_FLASH_CMD_FAST_READ_QUAD_OUTPUT:
+		{
+			/* IO2/IO3 are WP/HOLD until QE is set, data would be garbage */
+			if(!API_SPI_FLASH_QE_IS_SET(emu->status_reg[1]))
+				break;
+		}
+		/* fall through */
+		case API_SPI_FLASH_CMD_READ_DATA:
+		case API_SPI_FLASH_CMD_FAST_READ:
+		case API_SPI_FLASH_CMD_FAST_READ_DUAL_OUTPUT:
+		{
+			/* Continuous read wraps at the end of the array */
+			byte = emu->memory[(emu->address + emu->data_nbr) % SPI_FLASH_EMU_SIZE];
+			break;
+		}
+		default:
+			break;
+	}
+	emu->data_nbr++;
+	return byte;
+}
+
+static void spi_flash_emu_execute(void)
+{
+	spi_flash_emu_t * emu = &spi_flash_emu;
+	if(!emu->has_opcode || emu->ignored)
+		return;
+
+	bool reset_enabled = emu->reset_enabled;
+	emu->reset_enabled = false;
+
+	bool wel = API_SPI_FLASH_WEL_IS_SET(emu->status_reg[0]);
+	bool address_complete = (emu->address_nbr == spi_flash_emu_address_size(emu->opcode));
+	uint32_t address = emu->address % SPI_FLASH_EMU_SIZE;
+
+	switch(emu->opcode)
+	{
+		case API_SPI_FLASH_CMD_WRITE_EN:
+		{
+			emu->status_reg[0] |= API_SPI_FLASH_WEL_BIT;
+			break;
+		}
+		case API_SPI_FLASH_CMD_WRITE_DIS:
+		{
+			emu->status_reg[0] &= ~API_SPI_FLASH_WEL_BIT;
+			break;
+		}
+		case API_SPI_FLASH_CMD_WRITE_PAGE:
+		{
+			if(!wel || !address_complete || emu->data_nbr == 0)
+				break;
+			/* Program only clears bits */
+			uint32_t page_address = address - (address % SPI_FLASH_EMU_PAGE_SIZE);
+			for(uint32_t i = 0; i < SPI_FLASH_EMU_PAGE_SIZE; i++)
+			{
+				if(emu->page_written[i])
+					emu->memory[page_address + i] &= emu->page[i];
+			}
+			spi_flash_emu_set_busy(SPI_FLASH_EMU_T_PP_US);
+			break;
+		}
+		case API_SPI_FLASH_CMD_DEL_SECTOR:
+		case API_SPI_FLASH_CMD_DEL_32KB_BLOCK:
+		case API_SPI_FLASH_CMD_DEL_64KB_BLOCK:
+		{
+			if(!wel || !address_complete)
+				break;
+			uint32_t size = 4 * 1024;
+			uint32_t time_us = SPI_FLASH_EMU_T_SE_US;
+			if(emu->opcode == API_SPI_FLASH_CMD_DEL_32KB_BLOCK)
+			{
+				size = 32 * 1024;
+				time_us = SPI_FLASH_EMU_T_BE1_US;
+			}
+			else if(emu->opcode == API_SPI_FLASH_CMD_DEL_64KB_BLOCK)
+			{
+				size = 64 * 1024;
+				time_us = SPI_FLASH_EMU_T_BE2_US;
+			}
+			memset(emu->memory + (address - (address % size)), 0xFF, size);
+			spi_flash_emu_set_busy(time_us);
+			break;
+		}
+		case API_SPI_FLASH_CMD_DEL_CHIP:
+		case SPI_FLASH_EMU_CMD_DEL_CHIP_ALT:
+		{
+			if(!wel)
+				break;
+			memset(emu->memory, 0xFF, SPI_FLASH_EMU_SIZE);
+			spi_flash_emu_set_busy(SPI_FLASH_EMU_T_CE_US);
+			break;
+		}
+		case API_SPI_FLASH_CMD_WRITE_STATUS_REG_1:
+		{
+			if(!wel || emu->data_nbr == 0)
+				break;
+			emu->status_reg[0] = (emu->status_reg[0] & ~SPI_FLASH_EMU_SR1_WRITABLE_MASK) | (emu->write_data[0] & SPI_FLASH_EMU_SR1_WRITABLE_MASK);
+			/* Legacy two bytes write also sets status register 2 */
+			if(emu->data_nbr > 1)
+				emu->status_reg[1] = emu->write_data[1];
+			spi_flash_emu_set_busy(SPI_FLASH_EMU_T_W_US);
+			break;
+		}
+		case API_SPI_FLASH_CMD_WRITE_STATUS_REG_2:
+		case API_SPI_FLASH_CMD_WRITE_STATUS_REG_3:
+		{
+			if(!wel || emu->data_nbr == 0)
+				break;
+			emu->status_reg[(emu->opcode == API_SPI_FLASH_CMD_WRITE_STATUS_REG_2)? 1 : 2] = emu->write_data[0];
+			spi_flash_emu_set_busy(SPI_FLASH_EMU_T_W_US);
+			break;
+		}
+		case API_SPI_FLASH_CMD_SUSPEND:
+		{
+			/* Ignored when nothing is running, suspend itself is taken as instant */
+			if(!API_SPI_FLASH_BSY_IS_SET(emu->status_reg[0]))
+				break;
+			uint64_t now = spi_flash_emu_now_us();
+			if(now - emu->resumed_at_us < SPI_FLASH_EMU_T_SUS_US)
+			{
+				fprintf(stderr, "spi_flash_emu: suspend %lu us after resume, tSUS is %u us\n", (unsigned long)(now - emu->resumed_at_us), SPI_FLASH_EMU_T_SUS_US);
+				break;
+			}
+			emu->suspended_us = (emu->busy_until_us > now)? emu->busy_until_us - now : 0;
+			emu->status_reg[0] &= ~API_SPI_FLASH_BSY_BIT;
+			emu->status_reg[1] |= API_SPI_FLASH_SUS_BIT;
+			break;
+		}
+		case API_SPI_FLASH_CMD_RESUME:
+		{
+			if(!API_SPI_FLASH_SUS_IS_SET(emu->status_reg[1]))
+				break;
+			emu->status_reg[1] &= ~API_SPI_FLASH_SUS_BIT;
+			emu->status_reg[0] |= API_SPI_FLASH_BSY_BIT;
+			emu->resumed_at_us = spi_flash_emu_now_us();
+			emu->busy_until_us = emu->resumed_at_us + emu->suspended_us;
+			break;
+		}
+		case API_SPI_FLASH_CMD_ENABLE_RESET:
+		{
+			emu->reset_enabled = true;
+			break;
+		}
+		case API_SPI_FLASH_CMD_RESET_DEVICE:
+		{
+			if(!reset_enabled)
+				break;
+			/* Volatile bits go back to default, non volatile ones are kept */
+			emu->status_reg[0] &= ~(API_SPI_FLASH_BSY_BIT | API_SPI_FLASH_WEL_BIT);
+			emu->status_reg[1] &= ~API_SPI_FLASH_SUS_BIT;
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+static int spi_flash_emu_open(const char * path)
+{
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if(fd < 0)
+	{
+		perror(path);
+		return SPI_FLASH_ARCH_E_READY;
+	}
+
+	struct stat file_stat = {0};
+	if(fstat(fd, &file_stat) != 0 || (file_stat.st_size < SPI_FLASH_EMU_SIZE && ftruncate(fd, SPI_FLASH_EMU_SIZE) != 0))
+	{
+		perror(path);
+		close(fd);
+		return SPI_FLASH_ARCH_E_READY;
+	}
+
+	uint8_t * memory = mmap(NULL, SPI_FLASH_EMU_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(memory == MAP_FAILED)
+	{
+		perror(path);
+		close(fd);
+		return SPI_FLASH_ARCH_E_READY;
+	}
+
+	/* New chips come erased */
+	if(file_stat.st_size < SPI_FLASH_EMU_SIZE)
+		memset(memory + file_stat.st_size, 0xFF, SPI_FLASH_EMU_SIZE - file_stat.st_size);
+
+	spi_flash_emu.fd = fd;
+	spi_flash_emu.memory = memory;
+	return SPI_FLASH_ARCH_OK;
+}
+
+int spi_flash_arch_init_spi(void * spi_hdle, spi_flash_arch_rx_it_hdle spi_rx_it_hdle, spi_flash_arch_tx_it_hdle spi_tx_it_hdle)
+{
+	if(spi_flash_arch_ready() == true) return SPI_FLASH_ARCH_E_READY;
+
+	/* SPI handle is the backing file path */
+	const char * path = (const char *) spi_hdle;
+	if(path == NULL)
+		path = getenv(SPI_FLASH_EMU_FILE_ENV);
+	if(path == NULL)
+		path = SPI_FLASH_EMU_DEFAULT_FILE;
+
+	int rt = spi_flash_emu_open(path);
+	if(rt != SPI_FLASH_ARCH_OK)
+		return rt;
+
+	const char * time_scale = getenv(SPI_FLASH_EMU_TIME_SCALE_ENV);
+	spi_flash_emu.time_scale = (time_scale != NULL)? (uint32_t)strtoul(time_scale, NULL, 10) : 100;
+
+	_spi_hdle = (void *) path;
+	_spi_rx_hdle = spi_rx_it_hdle;
+	_spi_tx_hdle = spi_tx_it_hdle;
+	return SPI_FLASH_ARCH_OK;
+}
+
+int spi_flash_arch_init_cs(uint32_t port, uint16_t pin)
+{
+	/* Emulated chip is always wired */
+	return SPI_FLASH_ARCH_OK;
+}
+
+void spi_flash_arch_select_cs(void)
+{
+	spi_flash_emu_t * emu = &spi_flash_emu;
+	emu->selected = true;
+	emu->ignored = false;
+	emu->has_opcode = false;
+	emu->address_nbr = 0;
+	emu->address = 0;
+	emu->dummy_nbr = 0;
+	emu->data_nbr = 0;
+	memset(emu->page_written, 0, sizeof(emu->page_written));
+}
+
+void spi_flash_arch_deselect_cs(void)
+{
+	if(!spi_flash_emu.selected)
+		return;
+	spi_flash_emu_execute();
+	spi_flash_emu.selected = false;
+}
+
+int spi_flash_arch_read_spi(uint8_t * buffer, uint16_t buffer_size, uint32_t timeout)
+{
+	if(spi_flash_arch_ready() == false) return SPI_FLASH_ARCH_E_READY;
+
+	for(uint16_t i = 0; i < buffer_size; i++)
+		buffer[i] = spi_flash_emu_read_byte();
+	return SPI_FLASH_ARCH_OK;
+}
+
+int spi_flash_arch_write_spi(uint8_t * data, uint16_t data_size, uint32_t timeout)
+{
+	if(spi_flash_arch_ready() == false) return SPI_FLASH_ARCH_E_READY;
+
+	for(uint16_t i = 0; i < data_size; i++)
+		spi_flash_emu_write_byte(data[i]);
+	return SPI_FLASH_ARCH_OK;
+}
+
+int spi_flash_arch_read_spi_lines(uint8_t * buffer, uint16_t buffer_size, uint8_t lines, uint32_t timeout)
+{
+	/* Line count only changes the bus timing, emulated data is the same */
+	return spi_flash_arch_read_spi(buffer, buffer_size, timeout);
+}
+
+uint32_t spi_flash_arch_get_read_modes(void)
+{
+	return SPI_FLASH_READ_MODE_BIT(SPI_FLASH_READ_MODE_SINGLE) | SPI_FLASH_READ_MODE_BIT(SPI_FLASH_READ_MODE_FAST)
+			| SPI_FLASH_READ_MODE_BIT(SPI_FLASH_READ_MODE_DUAL_OUTPUT) | SPI_FLASH_READ_MODE_BIT(SPI_FLASH_READ_MODE_QUAD_OUTPUT);
+}
+
+int spi_flash_arch_read_it_spi(uint8_t * data, uint16_t data_size)
+{
+	return spi_flash_arch_read_dma_spi(data, data_size);
+}
+
+int spi_flash_arch_read_dma_spi(uint8_t * buffer, uint16_t buffer_size)
+{
+	/* No DMA on host. Transfer is done in place and completion reported right away */
+	int rt = spi_flash_arch_read_spi(buffer, buffer_size, 0);
+	if(rt != SPI_FLASH_ARCH_OK)
+		return rt;
+
+	if(_spi_rx_hdle != NULL)
+		_spi_rx_hdle(_spi_hdle, buffer, buffer_size);
+	return SPI_FLASH_ARCH_OK;
+}
+
+int spi_flash_arch_write_dma_spi(uint8_t * data, uint16_t data_size)
+{
+	int rt = spi_flash_arch_write_spi(data, data_size, 0);
+	if(rt != SPI_FLASH_ARCH_OK)
+		return rt;
+
+	if(_spi_tx_hdle != NULL)
+		_spi_tx_hdle(_spi_hdle, data, data_size);
+	return SPI_FLASH_ARCH_OK;
+}
+
+void spi_flash_arch_block_delay(uint32_t milliseconds)
+{
+	usleep(milliseconds * 1000);
+}
@@ -0,0 +1,133 @@
+/*
+ * app_bootloader_arch_common.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+#include <stdbool.h>
+#include <string.h>
+
+#include "app_bootloader_arch_common.h"
+
+#include "API_log.h"
+#define tag "app_bootloader_arch"
+#define print_serial_info(format, ...) LOG_LEVEL(LOG_INFO, tag, format, ##__VA_ARGS__)
+#define print_serial_warn(format, ...) LOG_LEVEL(LOG_WARN, tag, format, ##__VA_ARGS__)
+
+#define APP_BOOTLOADER_ARCH_FLASH_SIZE (APP_BOOTLOADER_FLASH_END + 1 - APP_BOOTLOADER_FLASH_BASE)
+#define APP_BOOTLOADER_ARCH_FLASH_OFFSET(address) ((address) - APP_BOOTLOADER_FLASH_BASE)
+
+/* Internal flash is emulated in RAM. Content is lost when the process ends */
+static uint8_t internal_flash[APP_BOOTLOADER_ARCH_FLASH_SIZE];
+static bool internal_flash_ready = false;
+static bool internal_flash_unlocked = false;
+/* SRAM application region is emulated too */
+static uint8_t ram_app[APP_BOOTLOADER_RAM_APP_SIZE];
+/* Handoff area too */
+static app_bootloader_handoff_t handoff_area;
+
+/**
+ * @brief Erase the whole emulated flash the first time it is used.
+ *
+ */
+static void app_bootloader_arch_flash_init(void);
+
+static void app_bootloader_arch_flash_init(void)
+{
+	if(internal_flash_ready)
+		return;
+	memset(internal_flash, 0xFF, sizeof(internal_flash));
+	internal_flash_ready = true;
+}
+
+void app_bootloader_arch_boot(uint32_t boot_address)
+{
+	uint32_t stack_pointer = 0;
+	uint8_t * ram = app_bootloader_arch_ram_app_map(boot_address, sizeof(stack_pointer));
+	if(ram != NULL)
+		memcpy(&stack_pointer, ram, sizeof(stack_pointer));
+	else
+		app_bootloader_arch_flash_read(boot_address, (uint8_t *)&stack_pointer, sizeof(stack_pointer));
+	if((stack_pointer & (0x2FF00000)) == 0x20000000)
+	{
+		/* Nothing to tear down on host, the clock tree is the one the application would get */
+		handoff_area.flag |= APP_BOOTLOADER_HANDOFF_FLAG_CLOCKS;
+		print_serial_info("Application found! Host port does not jump to 0x%x", boot_address);
+	}
+	else
+	{
+		print_serial_warn("No application found in 0x%x", boot_address);
+	}
+}
+
+app_bootloader_handoff_t * app_bootloader_arch_handoff(void)
+{
+	return &handoff_area;
+}
+
+bool app_bootloader_arch_boot_strap(void)
+{
+	/* No strap on host, the listen window is the only way to stay */
+	return false;
+}
+
+uint8_t * app_bootloader_arch_ram_app_map(uint32_t address, uint32_t size)
+{
+	if(address < APP_BOOTLOADER_RAM_APP_BASE || size > APP_BOOTLOADER_RAM_APP_SIZE
+			|| address - APP_BOOTLOADER_RAM_APP_BASE > APP_BOOTLOADER_RAM_APP_SIZE - size)
+		return NULL;
+	return &ram_app[address - APP_BOOTLOADER_RAM_APP_BASE];
+}
+
+void app_bootloader_arch_flash_unlock(void)
+{
+	internal_flash_unlocked = true;
+}
+
+void app_bootloader_arch_flash_lock(void)
+{
+	internal_flash_unlocked = false;
+}
+
+int app_bootloader_arch_flash_program_byte(uint32_t address, uint8_t data)
+{
+	if(!internal_flash_unlocked) return APP_BOOTLOADER_ARCH_E_FAIL;
+
+	app_bootloader_arch_flash_init();
+	/* Programming only clears bits */
+	internal_flash[APP_BOOTLOADER_ARCH_FLASH_OFFSET(address)] &= data;
+	return APP_BOOTLOADER_ARCH_OK;
+}
+
+int app_bootloader_arch_flash_program_words(uint32_t address, const uint8_t * data, uint32_t word_nbr)
+{
+	if(!internal_flash_unlocked) return APP_BOOTLOADER_ARCH_E_FAIL;
+	if(address % APP_BOOTLOADER_FLASH_WORD_SIZE) return APP_BOOTLOADER_ARCH_E_FAIL;
+
+	app_bootloader_arch_flash_init();
+	uint8_t * flash = &internal_flash[APP_BOOTLOADER_ARCH_FLASH_OFFSET(address)];
+	for(uint32_t i = 0; i < word_nbr * APP_BOOTLOADER_FLASH_WORD_SIZE; i++)
+		flash[i] &= data[i];
+	return APP_BOOTLOADER_ARCH_OK;
+}
+
+int app_bootloader_arch_flash_erase_sector(const app_bootloader_flash_sector_t * sector)
+{
+	if(!internal_flash_unlocked) return APP_BOOTLOADER_ARCH_E_FAIL;
+
+	app_bootloader_arch_flash_init();
+	memset(&internal_flash[APP_BOOTLOADER_ARCH_FLASH_OFFSET(sector->address)], 0xFF, sector->size);
+	return APP_BOOTLOADER_ARCH_OK;
+}
+
+void app_bootloader_arch_flash_read(uint32_t address, uint8_t * buffer, uint32_t size)
+{
+	app_bootloader_arch_flash_init();
+	memcpy(buffer, &internal_flash[APP_BOOTLOADER_ARCH_FLASH_OFFSET(address)], size);
+}
+
+int app_bootloader_arch_crc32_words(uint32_t * crc, const uint8_t * data, uint32_t word_nbr)
+{
+	/* No CRC unit on host */
+	return APP_BOOTLOADER_ARCH_E_FAIL;
+}
@@ -0,0 +1,1051 @@
+/*
+ * bootloader_flash.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ *
+ * Reference host side of the app_bootloader protocol. Streams an image from
+ * disk (mmap) into a SPI flash partition and reports per block latency,
+ * effective throughput and retransmits. Blocks are LZ4 compressed when the
+ * bootloader offers it, or sent as patches against another partition with -D.
+ * With -P, the bootloader profiling spans are read back and summarized.
+ *
+ * Usage: bootloader_flash -d <tty|unix:path> [-s baudrate] [-S baudrate] [-p partition]
+ *                         [-w window] [-t timeout_ms] [-N] [-R] [-D base.bin]
+ *                         [-b base_partition] [-B [-X]] [-P] [-v] image.bin
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "API_profile.h"
+#include "app_bootloader_command.h"
+#include "app_bootloader_crc.h"
+#include "app_bootloader_delta.h"
+#include "app_bootloader_lz4.h"
+#include "app_bootloader_sha256.h"
+#include "flash_tool_delta.h"
+#include "flash_tool_lz4.h"
+
+#define FLASH_TOOL_UNIX_PREFIX "unix:"
+#define FLASH_TOOL_DEFAULT_BAUDRATE (115200)
+#define FLASH_TOOL_DEFAULT_TIMEOUT_MS (2000)
+#define FLASH_TOOL_BOOT_TIMEOUT_MS (60000) /* Installing into MCU flash erases 128 KiB sectors */
+#define FLASH_TOOL_MAX_RETRIES (10)
+#define FLASH_TOOL_RX_BUFFER_SIZE (128 * 1024)
+#define FLASH_TOOL_MAX_FRAME_SIZE (sizeof(app_bootloader_frame_t) + UINT16_MAX + APP_BOOTLOADER_CMD_CRC_SIZE)
+/* Bootloader switches rate right after its response and waits a probe for 500 ms */
+#define FLASH_TOOL_BAUD_SETTLE_US (2000)
+#define FLASH_TOOL_BAUD_PROBE_TIMEOUT_MS (100)
+#define FLASH_TOOL_BAUD_PROBE_TRIES (3)
+#define FLASH_TOOL_BAUD_FALLBACK_US (600000)
+
+/**
+ * @brief Link with the bootloader and frame reassembly.
+ *
+ */
+typedef struct
+{
+	int fd;
+	bool tty; /* false for a UNIX socket, which has no line rate */
+	uint32_t baudrate;
+	uint8_t rx_buffer[FLASH_TOOL_RX_BUFFER_SIZE];
+	uint32_t rx_size;
+	uint32_t drop_nbr; /* Received frames dropped, CRC mismatch included */
+}flash_tool_link_t;
+
+/**
+ * @brief Download session.
+ *
+ */
+typedef struct
+{
+	const uint8_t * image; /* Mapped image */
+	uint32_t image_size;
+	uint32_t block_size;
+	uint32_t block_nbr;
+	uint8_t window_size;
+	uint8_t type; /* APP_BOOTLOADER_DL_* */
+	const uint8_t * base; /* Mapped base image. Only with APP_BOOTLOADER_DL_DELTA */
+	uint32_t base_size;
+	uint8_t base_partition_nbr; /* Partition holding 'base' in the bootloader */
+	uint8_t * packed; /* Compressed or patch blocks, 'block_size' bytes apart. Not with APP_BOOTLOADER_DL_RAW */
+	uint32_t * packed_size; /* Encoded size of each block. Blocks that do not get smaller are sent as is */
+	uint64_t data_size; /* Block data bytes sent, resends included */
+	double * sent_at; /* Last send time of each block, seconds */
+	double * latency; /* Send to acknowledge time of each block, seconds. Negative until acknowledged */
+	uint32_t * in_flight; /* Blocks not acknowledged in current request/window, resent on RETRANSMIT */
+	uint32_t in_flight_nbr;
+	uint32_t retransmit_nbr; /* Blocks sent again because of RETRANSMIT or timeout */
+	uint32_t timeout_nbr;
+}flash_tool_dl_t;
+
+static bool verbose = false;
+
+/**
+ * @brief Get monotonic time.
+ *
+ * @return Seconds.
+ */
+static double flash_tool_now(void);
+/**
+ * @brief Open link. Either a tty configured raw at 'baudrate' or a UNIX socket.
+ *
+ * @param link Link.
+ * @param device Device path or "unix:<path>".
+ * @param baudrate Serial baudrate.
+ * @return
+ * 			- 0 if no error.
+ */
+static int flash_tool_open(flash_tool_link_t * link, const char * device, uint32_t baudrate);
+/**
+ * @brief Set the local line rate. Nothing to do on a UNIX socket.
+ *
+ * @param link Link.
+ * @param baudrate Serial baudrate.
+ * @return 0 if no error.
+ */
+static int flash_tool_set_baudrate(flash_tool_link_t * link, uint32_t baudrate);
+/**
+ * @brief Agree a new baudrate with the bootloader and check it with a probe. Both sides go back to the
+ * current rate if the probe fails.
+ *
+ * @param link Link.
+ * @param baudrate Proposed baudrate.
+ * @param timeout_ms Response timeout.
+ * @return 0 if the link runs at 'baudrate'.
+ */
+static int flash_tool_switch_baudrate(flash_tool_link_t * link, uint32_t baudrate, int timeout_ms);
+/**
+ * @brief Send a built frame. Header and referenced payload go in one write.
+ *
+ * @param link Link.
+ * @param build_digest Build result.
+ * @return
+ * 			- 0 if no error.
+ */
+static int flash_tool_send(flash_tool_link_t * link, app_bootloader_build_res_t * build_digest);
+/**
+ * @brief Receive next valid frame.
+ *
+ * @param link Link.
+ * @param frame Buffer of FLASH_TOOL_MAX_FRAME_SIZE where the frame is copied.
+ * @param timeout_ms Timeout.
+ * @return
+ * 			- 0 if no error.
+ * 			- -ETIMEDOUT if no frame arrived in time.
+ */
+static int flash_tool_recv(flash_tool_link_t * link, app_bootloader_frame_t * frame, int timeout_ms);
+/**
+ * @brief Send a control frame and wait the answer. Frame is sent again on timeout or RETRANSMIT.
+ *
+ * @param link Link.
+ * @param build_digest Build result. Must not be overwritten by another build meanwhile.
+ * @param frame Buffer of FLASH_TOOL_MAX_FRAME_SIZE where the answer is copied.
+ * @param timeout_ms Timeout waiting the answer.
+ * @return
+ * 			- 0 if no error.
+ */
+static int flash_tool_request(flash_tool_link_t * link, app_bootloader_build_res_t * build_digest, app_bootloader_frame_t * frame, int timeout_ms);
+/**
+ * @brief Print an error frame.
+ *
+ * @param frame Error frame.
+ */
+static void flash_tool_print_error(app_bootloader_frame_t * frame);
+/**
+ * @brief Send one block.
+ *
+ * @param link Link.
+ * @param dl Download session.
+ * @param block_nbr Block number.
+ * @return
+ * 			- 0 if no error.
+ */
+static int flash_tool_send_block(flash_tool_link_t * link, flash_tool_dl_t * dl, uint32_t block_nbr);
+/**
+ * @brief Record acknowledge time of a block.
+ *
+ * @param dl Download session.
+ * @param block_nbr Block number.
+ * @param now Acknowledge time.
+ */
+static void flash_tool_ack_block(flash_tool_dl_t * dl, uint32_t block_nbr, double now);
+/**
+ * @brief Compress every block of the image, or diff it against the base image. Each block is encoded on its
+ * own, so the bootloader can decode blocks in any order. Every block is decoded back with the bootloader
+ * code, a block it would reject is sent as is.
+ *
+ * @param dl Download session.
+ * @return
+ * 			- 0 if no error.
+ */
+static int flash_tool_pack(flash_tool_dl_t * dl);
+/**
+ * @brief Read base image bytes when checking a patch block.
+ *
+ * @param offset Offset inside the base image.
+ * @param buffer Where bytes are read.
+ * @param size Size to read.
+ * @param arg Download session.
+ * @return 0 if no error.
+ */
+static int flash_tool_base_read(uint32_t offset, uint8_t * buffer, uint32_t size, void * arg);
+/**
+ * @brief Run the download until END is received.
+ *
+ * @param link Link.
+ * @param dl Download session.
+ * @param partition_nbr Partition.
+ * @param max_window Max window the host accepts.
+ * @param timeout_ms Timeout waiting a frame.
+ * @return
+ * 			- 0 if no error.
+ */
+static int flash_tool_download(flash_tool_link_t * link, flash_tool_dl_t * dl, uint8_t partition_nbr, uint8_t max_window, int timeout_ms);
+/**
+ * @brief Print download statistics.
+ *
+ * @param dl Download session.
+ * @param elapsed Download time in seconds.
+ */
+static void flash_tool_report(flash_tool_dl_t * dl, double elapsed);
+/**
+ * @brief Read every profiling span kept by the bootloader and print a summary per span id.
+ * Raw spans are printed too in verbose mode.
+ *
+ * @param link Link.
+ * @param frame Buffer where responses will be received.
+ * @param timeout_ms Time to wait each response.
+ * @return
+ * 			- 0 if no error.
+ * 			- Negative errno otherwise.
+ */
+static int flash_tool_profile(flash_tool_link_t * link, app_bootloader_frame_t * frame, int timeout_ms);
+
+static double flash_tool_now(void)
+{
+	struct timespec now = {0};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int flash_tool_open(flash_tool_link_t * link, const char * device, uint32_t baudrate)
+{
+	link->rx_size = 0;
+	link->baudrate = baudrate;
+	link->tty = false;
+	if(strncmp(device, FLASH_TOOL_UNIX_PREFIX, strlen(FLASH_TOOL_UNIX_PREFIX)) == 0)
+	{
+		struct sockaddr_un address = {.sun_family = AF_UNIX};
+		const char * path = device + strlen(FLASH_TOOL_UNIX_PREFIX);
+		if(strlen(path) >= sizeof(address.sun_path))
+			return -ENAMETOOLONG;
+		strcpy(address.sun_path, path);
+
+		link->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(link->fd < 0 || connect(link->fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+			return -errno;
+		return 0;
+	}
+
+	link->fd = open(device, O_RDWR | O_NOCTTY);
+	if(link->fd < 0)
+		return -errno;
+	link->tty = true;
+
+	struct termios tio = {0};
+	if(tcgetattr(link->fd, &tio) != 0)
+		return -errno;
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~CRTSCTS;
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	if(tcsetattr(link->fd, TCSANOW, &tio) != 0)
+		return -errno;
+
+	return flash_tool_set_baudrate(link, baudrate);
+}
+
+static int flash_tool_set_baudrate(flash_tool_link_t * link, uint32_t baudrate)
+{
+	static const struct
+	{
+		uint32_t baudrate;
+		speed_t speed;
+	}speeds[] =
+	{
+		{9600, B9600}, {57600, B57600}, {115200, B115200}, {230400, B230400}, {460800, B460800},
+		{500000, B500000}, {921600, B921600}, {1000000, B1000000}, {1500000, B1500000},
+		{2000000, B2000000}, {2500000, B2500000}, {3000000, B3000000}, {4000000, B4000000},
+	};
+
+	link->baudrate = baudrate;
+	if(!link->tty)
+		return 0;
+
+	uint32_t i = 0;
+	while(i < sizeof(speeds) / sizeof(speeds[0]) && speeds[i].baudrate != baudrate)
+		i++;
+	if(i == sizeof(speeds) / sizeof(speeds[0]))
+	{
+		fprintf(stderr, "Unsupported baudrate %u\n", baudrate);
+		return -EINVAL;
+	}
+
+	struct termios tio = {0};
+	if(tcgetattr(link->fd, &tio) != 0)
+		return -errno;
+	cfsetspeed(&tio, speeds[i].speed);
+	/* Whatever is on its way was sent at the previous rate */
+	if(tcsetattr(link->fd, TCSADRAIN, &tio) != 0)
+		return -errno;
+	tcflush(link->fd, TCIFLUSH);
+	link->rx_size = 0;
+	return 0;
+}
+
+static int flash_tool_switch_baudrate(flash_tool_link_t * link, uint32_t baudrate, int timeout_ms)
+{
+	static uint8_t frame_buffer[FLASH_TOOL_MAX_FRAME_SIZE];
+	app_bootloader_frame_t * frame = (app_bootloader_frame_t *) frame_buffer;
+	app_bootloader_build_res_t build_digest = {0};
+
+	app_bootloader_build_baud_req(&build_digest, baudrate);
+	int rt = flash_tool_request(link, &build_digest, frame, timeout_ms);
+	if(rt != 0)
+		return rt;
+	if(frame->command == APP_BOOTLOADER_CMD_ERROR)
+		flash_tool_print_error(frame);
+	if(frame->command != APP_BOOTLOADER_CMD_BAUD_RES)
+		return -EPROTO;
+	/* Bootloader answers its current rate when it can not reach the proposed one */
+	if(((app_bootloader_cmd_baud *)frame->data)->baudrate != baudrate)
+		return -ENOTSUP;
+
+	uint32_t previous = link->baudrate;
+	rt = flash_tool_set_baudrate(link, baudrate);
+	if(rt == 0)
+	{
+		usleep(FLASH_TOOL_BAUD_SETTLE_US);
+		rt = -ETIMEDOUT;
+		for(uint8_t tries = 0; tries < FLASH_TOOL_BAUD_PROBE_TRIES && rt != 0; tries++)
+		{
+			app_bootloader_build_baud_probe(&build_digest, baudrate);
+			rt = flash_tool_send(link, &build_digest);
+			if(rt == 0)
+				rt = flash_tool_recv(link, frame, FLASH_TOOL_BAUD_PROBE_TIMEOUT_MS);
+			if(rt == 0 && frame->command != APP_BOOTLOADER_CMD_BAUD_PROBE)
+				rt = -EPROTO;
+		}
+		if(rt == 0)
+			return 0;
+	}
+
+	/* Bootloader goes back by itself once the probe timeout expires */
+	flash_tool_set_baudrate(link, previous);
+	usleep(FLASH_TOOL_BAUD_FALLBACK_US);
+	tcflush(link->fd, TCIFLUSH);
+	link->rx_size = 0;
+	return rt;
+}
+
+static int flash_tool_send(flash_tool_link_t * link, app_bootloader_build_res_t * build_digest)
+{
+	struct iovec iov[3] = {{.iov_base = build_digest->frame, .iov_len = build_digest->frame_size}};
+	int iov_nbr = 1;
+	if(build_digest->payload != NULL)
+		iov[iov_nbr++] = (struct iovec){.iov_base = (void *)build_digest->payload, .iov_len = build_digest->payload_size};
+	if(build_digest->trailer_size != 0)
+		iov[iov_nbr++] = (struct iovec){.iov_base = build_digest->trailer, .iov_len = build_digest->trailer_size};
+
+	while(iov_nbr > 0)
+	{
+		ssize_t sent = writev(link->fd, iov, iov_nbr);
+		if(sent < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return -errno;
+		}
+		/* Partial write, skip what is already out */
+		for(int i = 0; i < iov_nbr && sent > 0; )
+		{
+			size_t done = ((size_t)sent < iov[i].iov_len)? (size_t)sent : iov[i].iov_len;
+			iov[i].iov_base = (uint8_t *)iov[i].iov_base + done;
+			iov[i].iov_len -= done;
+			sent -= done;
+			if(iov[i].iov_len == 0)
+			{
+				memmove(&iov[i], &iov[i + 1], (iov_nbr - i - 1) * sizeof(iov[0]));
+				iov_nbr--;
+			}
+		}
+	}
+	return 0;
+}
+
+static int flash_tool_recv(flash_tool_link_t * link, app_bootloader_frame_t * frame, int timeout_ms)
+{
+	double deadline = flash_tool_now() + timeout_ms / 1000.0;
+	while(true)
+	{
+		/* Resynchronize on magic byte, drop anything else */
+		uint32_t skip = 0;
+		while(skip < link->rx_size && link->rx_buffer[skip] != APP_BOOTLOADER_CMD_MAGIC_BYTE)
+			skip++;
+		if(skip)
+		{
+			memmove(link->rx_buffer, link->rx_buffer + skip, link->rx_size - skip);
+			link->rx_size -= skip;
+		}
+
+		if(link->rx_size >= sizeof(app_bootloader_frame_t))
+		{
+			app_bootloader_frame_t * header = (app_bootloader_frame_t *) link->rx_buffer;
+			uint32_t frame_size = app_bootloader_command_frame_size(header);
+			if(frame_size > UINT16_MAX)
+			{
+				/* Garbage that looked like a header */
+				link->rx_size--;
+				memmove(link->rx_buffer, link->rx_buffer + 1, link->rx_size);
+				continue;
+			}
+			if(link->rx_size >= frame_size)
+			{
+				app_bootloader_frame_t * digest = NULL;
+				int rt = app_bootloader_command_check(link->rx_buffer, frame_size, &digest);
+				if(rt == APP_BOOTLOADER_CMD_OK)
+					memcpy(frame, link->rx_buffer, frame_size);
+				link->rx_size -= frame_size;
+				memmove(link->rx_buffer, link->rx_buffer + frame_size, link->rx_size);
+				if(rt == APP_BOOTLOADER_CMD_OK)
+					return 0;
+				link->drop_nbr++;
+				if(verbose)
+					fprintf(stderr, "Dropped invalid frame (%d)\n", rt);
+				continue;
+			}
+		}
+
+		int remaining_ms = (int)((deadline - flash_tool_now()) * 1000);
+		if(remaining_ms <= 0)
+			return -ETIMEDOUT;
+
+		struct pollfd pfd = {.fd = link->fd, .events = POLLIN};
+		int rt = poll(&pfd, 1, remaining_ms);
+		if(rt < 0 && errno != EINTR)
+			return -errno;
+		if(rt <= 0)
+			continue;
+
+		ssize_t len = read(link->fd, link->rx_buffer + link->rx_size, sizeof(link->rx_buffer) - link->rx_size);
+		if(len == 0)
+			return -ECONNRESET;
+		if(len < 0 && errno != EINTR && errno != EAGAIN)
+			return -errno;
+		if(len > 0)
+			link->rx_size += len;
+	}
+}
+
+static int flash_tool_request(flash_tool_link_t * link, app_bootloader_build_res_t * build_digest, app_bootloader_frame_t * frame, int timeout_ms)
+{
+	for(uint32_t retries = 0; retries <= FLASH_TOOL_MAX_RETRIES; retries++)
+	{
+		int rt = flash_tool_send(link, build_digest);
+		if(rt != 0)
+			return rt;
+
+		rt = flash_tool_recv(link, frame, timeout_ms);
+		if(rt == -ETIMEDOUT || (rt == 0 && frame->command == APP_BOOTLOADER_CMD_RETRANSMIT))
+			continue;
+		return rt;
+	}
+	return -ETIMEDOUT;
+}
+
+static void flash_tool_print_error(app_bootloader_frame_t * frame)
+{
+	app_bootloader_cmd_err * err = (app_bootloader_cmd_err *) frame->data;
+	int msg_size = (frame->total_length > sizeof(*err))? (int)(frame->total_length - sizeof(*err)) : 0;
+	fprintf(stderr, "Bootloader error %u: %.*s\n", err->error, msg_size, err->error_msg);
+}
+
+static int flash_tool_send_block(flash_tool_link_t * link, flash_tool_dl_t * dl, uint32_t block_nbr)
+{
+	uint32_t offset = block_nbr * dl->block_size;
+	uint32_t size = dl->image_size - offset;
+	if(size > dl->block_size)
+		size = dl->block_size;
+	uint8_t * data = (uint8_t *)dl->image + offset;
+	if(dl->type != APP_BOOTLOADER_DL_RAW && dl->packed_size[block_nbr] < size)
+	{
+		data = dl->packed + offset;
+		size = dl->packed_size[block_nbr];
+	}
+	dl->data_size += size;
+
+	app_bootloader_build_res_t build_digest = {0};
+	int rt = app_bootloader_build_dl_block_res(&build_digest, block_nbr, size, data);
+	if(rt != APP_BOOTLOADER_CMD_OK)
+		return -EINVAL;
+
+	/* Resend restarts the latency measure, it is what the bootloader sees */
+	dl->sent_at[block_nbr] = flash_tool_now();
+	return flash_tool_send(link, &build_digest);
+}
+
+static void flash_tool_ack_block(flash_tool_dl_t * dl, uint32_t block_nbr, double now)
+{
+	if(block_nbr >= dl->block_nbr || dl->latency[block_nbr] >= 0 || dl->sent_at[block_nbr] == 0)
+		return;
+	dl->latency[block_nbr] = now - dl->sent_at[block_nbr];
+	if(verbose)
+		fprintf(stderr, "Block %u acknowledged in %.3f ms\n", block_nbr, dl->latency[block_nbr] * 1000);
+}
+
+static int flash_tool_base_read(uint32_t offset, uint8_t * buffer, uint32_t size, void * arg)
+{
+	flash_tool_dl_t * dl = (flash_tool_dl_t *) arg;
+	if(offset > dl->base_size || size > dl->base_size - offset)
+		return -1;
+	memcpy(buffer, dl->base + offset, size);
+	return 0;
+}
+
+static int flash_tool_pack(flash_tool_dl_t * dl)
+{
+	dl->packed = malloc((size_t)dl->block_nbr * dl->block_size);
+	dl->packed_size = malloc(dl->block_nbr * sizeof(*dl->packed_size));
+	uint8_t * check = malloc(dl->block_size);
+	uint8_t * scratch = malloc(dl->block_size + APP_BOOTLOADER_DELTA_OPS_MARGIN);
+	flash_tool_delta_t delta = {0};
+	if(dl->packed == NULL || dl->packed_size == NULL || check == NULL || scratch == NULL
+			|| (dl->type == APP_BOOTLOADER_DL_DELTA && flash_tool_delta_init(&delta, dl->base, dl->base_size) != 0))
+	{
+		free(check);
+		free(scratch);
+		return -ENOMEM;
+	}
+	app_bootloader_delta_base_t base = {.size = dl->base_size, .read_cb = flash_tool_base_read, .arg = dl};
+
+	uint64_t packed_total = 0;
+	for(uint32_t i = 0; i < dl->block_nbr; i++)
+	{
+		uint32_t offset = i * dl->block_size;
+		uint32_t size = dl->image_size - offset;
+		if(size > dl->block_size)
+			size = dl->block_size;
+
+		/* Output must be smaller than the block, otherwise the block goes as is */
+		uint32_t packed_size = 0;
+		bool valid = false;
+		if(dl->type == APP_BOOTLOADER_DL_DELTA)
+		{
+			packed_size = flash_tool_delta_block(&delta, dl->image + offset, size, dl->packed + offset, size - 1, dl->block_size + APP_BOOTLOADER_DELTA_OPS_MARGIN);
+			valid = (packed_size != 0 && app_bootloader_delta_apply(dl->packed + offset, packed_size, check, size, &base, scratch, dl->block_size + APP_BOOTLOADER_DELTA_OPS_MARGIN) == APP_BOOTLOADER_DELTA_OK);
+		}
+		else
+		{
+			uint32_t check_size = 0;
+			packed_size = flash_tool_lz4_compress(dl->image + offset, size, dl->packed + offset, size - 1);
+			valid = (packed_size != 0 && app_bootloader_lz4_decompress(dl->packed + offset, packed_size, check, size, &check_size) == APP_BOOTLOADER_LZ4_OK && check_size == size);
+		}
+		if(packed_size != 0 && (!valid || memcmp(check, dl->image + offset, size) != 0))
+		{
+			fprintf(stderr, "Block %u does not decode back, sent as is\n", i);
+			packed_size = 0;
+		}
+		dl->packed_size[i] = packed_size? packed_size : size;
+		packed_total += dl->packed_size[i];
+	}
+	free(check);
+	free(scratch);
+	flash_tool_delta_deinit(&delta);
+	printf("%s %u bytes into %lu (%.1f%%)\n", (dl->type == APP_BOOTLOADER_DL_DELTA)? "Patched" : "Compressed",
+			dl->image_size, (unsigned long)packed_total, 100.0 * packed_total / dl->image_size);
+	return 0;
+}
+
+static int flash_tool_download(flash_tool_link_t * link, flash_tool_dl_t * dl, uint8_t partition_nbr, uint8_t max_window, int timeout_ms)
+{
+	static uint8_t frame_buffer[FLASH_TOOL_MAX_FRAME_SIZE];
+	app_bootloader_frame_t * frame = (app_bootloader_frame_t *) frame_buffer;
+	app_bootloader_build_res_t build_digest = {0};
+
+	/* Image CRC-32 lets the bootloader resume an interrupted download of the same image */
+	app_bootloader_build_dl_req(&build_digest, partition_nbr, dl->image_size, app_bootloader_crc32(dl->image, dl->image_size));
+	int rt = flash_tool_request(link, &build_digest, frame, timeout_ms);
+	if(rt != 0)
+		return rt;
+	if(frame->command == APP_BOOTLOADER_CMD_ERROR)
+	{
+		flash_tool_print_error(frame);
+		return -EIO;
+	}
+	if(frame->command != APP_BOOTLOADER_CMD_DOWNLOAD_PARAM_REQ)
+		return -EPROTO;
+
+	app_bootloader_cmd_dl_param_req * param_req = (app_bootloader_cmd_dl_param_req *) frame->data;
+	dl->block_size = param_req->block_size;
+	dl->block_nbr = (dl->image_size + dl->block_size - 1) / dl->block_size;
+	dl->window_size = (param_req->window_size < max_window)? param_req->window_size : max_window;
+	if(dl->window_size > 1 + sizeof(((app_bootloader_cmd_dl_block_ack *)0)->ack_bitmap) * 8)
+		dl->window_size = 1 + sizeof(((app_bootloader_cmd_dl_block_ack *)0)->ack_bitmap) * 8;
+	printf("Block size %u, %u blocks, window %u (bootloader offers %u)\n", dl->block_size, dl->block_nbr, dl->window_size, param_req->window_size);
+	if(frame->total_length == sizeof(*param_req) && param_req->resume_block_nbr != 0)
+		printf("Bootloader resumes from block %u if parameters are kept\n", param_req->resume_block_nbr);
+	/* Bootloader offers its highest type, every lower one is accepted too */
+	if(dl->type > param_req->type)
+	{
+		if(dl->type == APP_BOOTLOADER_DL_DELTA)
+			fprintf(stderr, "Bootloader does not take delta downloads, image is sent whole\n");
+		dl->type = (param_req->type < APP_BOOTLOADER_DL_COMPRESS)? param_req->type : APP_BOOTLOADER_DL_COMPRESS;
+	}
+	if(dl->type != APP_BOOTLOADER_DL_RAW && (rt = flash_tool_pack(dl)) != 0)
+		return rt;
+	uint32_t base_crc32 = (dl->type == APP_BOOTLOADER_DL_DELTA)? app_bootloader_crc32(dl->base, dl->base_size) : 0;
+
+	dl->sent_at = calloc(dl->block_nbr, sizeof(*dl->sent_at));
+	dl->latency = malloc(dl->block_nbr * sizeof(*dl->latency));
+	dl->in_flight = calloc(dl->window_size? dl->window_size : 1, sizeof(*dl->in_flight));
+	if(dl->sent_at == NULL || dl->latency == NULL || dl->in_flight == NULL)
+		return -ENOMEM;
+	for(uint32_t i = 0; i < dl->block_nbr; i++)
+		dl->latency[i] = -1;
+
+	/* Partition erase happens before the first request, give it time */
+	app_bootloader_build_dl_param_res(&build_digest, dl->type, dl->block_nbr, dl->block_size, dl->window_size, dl->base_partition_nbr, base_crc32);
+	rt = flash_tool_send(link, &build_digest);
+	if(rt != 0)
+		return rt;
+	int wait_ms = FLASH_TOOL_BOOT_TIMEOUT_MS;
+
+	uint32_t retries = 0;
+	while(true)
+	{
+		rt = flash_tool_recv(link, frame, wait_ms);
+		double now = flash_tool_now();
+		wait_ms = timeout_ms;
+
+		if(rt == -ETIMEDOUT)
+		{
+			/* Request or blocks were lost, resend what the bootloader did not confirm */
+			if(++retries > FLASH_TOOL_MAX_RETRIES)
+				return rt;
+			dl->timeout_nbr++;
+			rt = 0;
+			/* No block sent yet, parameters response was lost */
+			if(dl->in_flight_nbr == 0)
+			{
+				app_bootloader_build_dl_param_res(&build_digest, dl->type, dl->block_nbr, dl->block_size, dl->window_size, dl->base_partition_nbr, base_crc32);
+				rt = flash_tool_send(link, &build_digest);
+			}
+			for(uint32_t i = 0; i < dl->in_flight_nbr && rt == 0; i++)
+			{
+				dl->retransmit_nbr++;
+				rt = flash_tool_send_block(link, dl, dl->in_flight[i]);
+			}
+			if(rt != 0)
+				return rt;
+			continue;
+		}
+		if(rt != 0)
+			return rt;
+		retries = 0;
+
+		switch(frame->command)
+		{
+			case APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_REQ:
+			{
+				app_bootloader_cmd_dl_block_req * req = (app_bootloader_cmd_dl_block_req *) frame->data;
+				/* Asking the next block acknowledges every block before it */
+				if(req->block_nbr > 0)
+					flash_tool_ack_block(dl, req->block_nbr - 1, now);
+				if(req->block_nbr >= dl->block_nbr)
+					return -EPROTO;
+
+				dl->in_flight[0] = req->block_nbr;
+				dl->in_flight_nbr = 1;
+				rt = flash_tool_send_block(link, dl, req->block_nbr);
+				break;
+			}
+			case APP_BOOTLOADER_CMD_DOWNLOAD_BLOCK_ACK:
+			{
+				app_bootloader_cmd_dl_block_ack * ack = (app_bootloader_cmd_dl_block_ack *) frame->data;
+				for(uint32_t i = 0; i < ack->block_nbr && i < dl->block_nbr; i++)
+					flash_tool_ack_block(dl, i, now);
+				/* Newest send among acknowledged blocks. Blocks go through the line in order, so any block sent
+				 * before it and not acknowledged was lost */
+				double acked_sent_at = (ack->block_nbr > 0 && ack->block_nbr <= dl->block_nbr)? dl->sent_at[ack->block_nbr - 1] : 0;
+				for(uint32_t i = 0; i < sizeof(ack->ack_bitmap) * 8; i++)
+				{
+					if(!(ack->ack_bitmap & (1UL << i)) || ack->block_nbr + 1 + i >= dl->block_nbr)
+						continue;
+					flash_tool_ack_block(dl, ack->block_nbr + 1 + i, now);
+					if(dl->sent_at[ack->block_nbr + 1 + i] > acked_sent_at)
+						acked_sent_at = dl->sent_at[ack->block_nbr + 1 + i];
+				}
+
+				/* Send every block of the window not acknowledged yet. A block already sent is only sent again
+				 * if it was lost, otherwise it may still be on its way. On a slow line the bootloader acknowledges
+				 * each block as it comes, while the rest of the window is still on the line */
+				dl->in_flight_nbr = 0;
+				uint8_t window = (ack->window_size < dl->window_size)? ack->window_size : dl->window_size;
+				for(uint32_t i = 0; i < window && ack->block_nbr + i < dl->block_nbr; i++)
+				{
+					if(i > 0 && (ack->ack_bitmap & (1UL << (i - 1))))
+						continue;
+					uint32_t block_nbr = ack->block_nbr + i;
+					dl->in_flight[dl->in_flight_nbr++] = block_nbr;
+					if(dl->sent_at[block_nbr] != 0)
+					{
+						if(dl->sent_at[block_nbr] > acked_sent_at)
+							continue;
+						dl->retransmit_nbr++;
+					}
+					if((rt = flash_tool_send_block(link, dl, block_nbr)) != 0)
+						break;
+				}
+				break;
+			}
+			case APP_BOOTLOADER_CMD_RETRANSMIT:
+			{
+				/* Bootloader got a partial or corrupted frame, resend what is in flight */
+				if(dl->in_flight_nbr == 0)
+				{
+					app_bootloader_build_dl_param_res(&build_digest, dl->type, dl->block_nbr, dl->block_size, dl->window_size, dl->base_partition_nbr, base_crc32);
+					rt = flash_tool_send(link, &build_digest);
+				}
+				for(uint32_t i = 0; i < dl->in_flight_nbr && rt == 0; i++)
+				{
+					dl->retransmit_nbr++;
+					rt = flash_tool_send_block(link, dl, dl->in_flight[i]);
+				}
+				break;
+			}
+			case APP_BOOTLOADER_CMD_END:
+			{
+				for(uint32_t i = 0; i < dl->block_nbr; i++)
+					flash_tool_ack_block(dl, i, now);
+				return 0;
+			}
+			case APP_BOOTLOADER_CMD_ERROR:
+			{
+				flash_tool_print_error(frame);
+				return -EIO;
+			}
+			default:
+			{
+				if(verbose)
+					fprintf(stderr, "Unexpected command %u\n", frame->command);
+				break;
+			}
+		}
+		if(rt != 0)
+			return rt;
+	}
+}
+
+static int flash_tool_compare_double(const void * a, const void * b)
+{
+	double da = *(const double *)a;
+	double db = *(const double *)b;
+	return (da > db) - (da < db);
+}
+
+static void flash_tool_report(flash_tool_dl_t * dl, double elapsed)
+{
+	double * sorted = malloc(dl->block_nbr * sizeof(*sorted));
+	uint32_t nbr = 0;
+	double sum = 0;
+	for(uint32_t i = 0; sorted != NULL && i < dl->block_nbr; i++)
+	{
+		if(dl->latency[i] < 0)
+			continue;
+		sorted[nbr++] = dl->latency[i];
+		sum += dl->latency[i];
+	}
+
+	/* Blocks kept by a resumed download are never sent */
+	uint32_t image_size = 0;
+	for(uint32_t i = 0; i < dl->block_nbr; i++)
+	{
+		if(dl->sent_at[i] != 0)
+			image_size += (i + 1 < dl->block_nbr)? dl->block_size : dl->image_size - i * dl->block_size;
+	}
+	if(image_size != dl->image_size)
+		printf("Resumed download, %u image bytes were already in partition\n", dl->image_size - image_size);
+
+	printf("Transferred %u bytes in %.3f s: %.1f bytes/s (%.2f KiB/s)\n", image_size, elapsed, image_size / elapsed, image_size / elapsed / 1024);
+	printf("Retransmitted blocks %u, timeouts %u\n", dl->retransmit_nbr, dl->timeout_nbr);
+	static const char * type_name[] = {[APP_BOOTLOADER_DL_RAW] = "raw", [APP_BOOTLOADER_DL_COMPRESS] = "compressed", [APP_BOOTLOADER_DL_DELTA] = "delta"};
+	printf("Sent %lu bytes of block data (%s)\n", (unsigned long)dl->data_size, type_name[dl->type]);
+	if(nbr)
+	{
+		qsort(sorted, nbr, sizeof(*sorted), flash_tool_compare_double);
+		printf("Block latency ms: min %.3f avg %.3f p50 %.3f p95 %.3f max %.3f\n",
+				sorted[0] * 1000, sum / nbr * 1000, sorted[nbr / 2] * 1000, sorted[(nbr * 95) / 100] * 1000, sorted[nbr - 1] * 1000);
+	}
+	free(sorted);
+}
+
+static int flash_tool_profile(flash_tool_link_t * link, app_bootloader_frame_t * frame, int timeout_ms)
+{
+	static const char * span_name[PROFILE_SPAN_MAX] = {
+		[PROFILE_SPAN_SPI_FLASH_INIT] = "spi flash init",
+		[PROFILE_SPAN_SPI_FLASH_ERASE] = "spi flash erase",
+		[PROFILE_SPAN_SPI_FLASH_PROGRAM] = "spi flash program",
+		[PROFILE_SPAN_FRAME] = "frame",
+		[PROFILE_SPAN_INSTALL] = "install",
+	};
+	uint32_t count[PROFILE_SPAN_MAX] = {0};
+	uint64_t sum[PROFILE_SPAN_MAX] = {0};
+	uint32_t max[PROFILE_SPAN_MAX] = {0};
+	uint32_t cycle_hz = 0;
+	uint32_t span_total = 0;
+	uint32_t first_span = 0;
+	app_bootloader_build_res_t build_digest = {0};
+
+	while(1)
+	{
+		app_bootloader_build_profile_req(&build_digest, first_span);
+		int rt = flash_tool_request(link, &build_digest, frame, timeout_ms);
+		if(rt != 0)
+			return rt;
+		app_bootloader_cmd_profile_res * res = (app_bootloader_cmd_profile_res *) frame->data;
+		if(frame->command != APP_BOOTLOADER_CMD_PROFILE_RES || frame->total_length < sizeof(*res)
+				|| frame->total_length < sizeof(*res) + res->span_nbr * sizeof(res->spans[0]))
+		{
+			if(frame->command == APP_BOOTLOADER_CMD_ERROR)
+				flash_tool_print_error(frame);
+			return -EPROTO;
+		}
+		if(res->first_span != first_span)
+			printf("Spans %u to %u were overwritten\n", first_span, res->first_span - 1);
+		cycle_hz = res->cycle_hz;
+		span_total = res->span_total;
+		for(uint8_t i = 0; i < res->span_nbr; i++)
+		{
+			app_bootloader_cmd_profile_span * span = &res->spans[i];
+			if(verbose)
+				printf("Span %u: %s arg %u start %u cycles %u\n", res->first_span + i,
+						(span->id < PROFILE_SPAN_MAX)? span_name[span->id] : "unknown", span->arg, span->start, span->cycles);
+			if(span->id >= PROFILE_SPAN_MAX)
+				continue;
+			count[span->id]++;
+			sum[span->id] += span->cycles;
+			if(span->cycles > max[span->id])
+				max[span->id] = span->cycles;
+		}
+		first_span = res->first_span + res->span_nbr;
+		if(res->span_nbr == 0 || first_span >= span_total)
+			break;
+	}
+
+	printf("Profile: %u spans, cycle counter at %u Hz\n", span_total, cycle_hz);
+	if(cycle_hz == 0)
+		return 0;
+	/* Spans are only taken once the clock setup ended, all of them run at this rate */
+	double us_per_cycle = 1e6 / cycle_hz;
+	for(uint8_t id = 0; id < PROFILE_SPAN_MAX; id++)
+	{
+		if(count[id] == 0)
+			continue;
+		printf("  %-18s count %6u total %12.1f us avg %10.1f us max %10.1f us\n", span_name[id], count[id],
+				sum[id] * us_per_cycle, (double)sum[id] / count[id] * us_per_cycle, max[id] * us_per_cycle);
+	}
+	return 0;
+}
+
+int main(int argc, char ** argv)
+{
+	const char * device = NULL;
+	uint32_t baudrate = FLASH_TOOL_DEFAULT_BAUDRATE;
+	uint32_t fast_baudrate = 0;
+	uint8_t partition_nbr = 0;
+	uint8_t max_window = UINT8_MAX;
+	int timeout_ms = FLASH_TOOL_DEFAULT_TIMEOUT_MS;
+	bool boot = false;
+	bool profile = false;
+	app_bootloader_boot_mode_t boot_mode = APP_BOOTLOADER_BOOT_INSTALL;
+	uint8_t features = APP_BOOTLOADER_CMD_FEATURES;
+	uint8_t type = APP_BOOTLOADER_DL_COMPRESS;
+	const char * base_path = NULL;
+	uint8_t base_partition_nbr = 0;
+
+	int opt = 0;
+	while((opt = getopt(argc, argv, "d:s:S:p:w:t:NRD:b:BXPv")) != -1)
+	{
+		switch(opt)
+		{
+			case 'd': device = optarg; break;
+			case 's': baudrate = strtoul(optarg, NULL, 0); break;
+			case 'S': fast_baudrate = strtoul(optarg, NULL, 0); break;
+			case 'p': partition_nbr = strtoul(optarg, NULL, 0); break;
+			case 'w': max_window = strtoul(optarg, NULL, 0); break;
+			case 't': timeout_ms = strtol(optarg, NULL, 0); break;
+			case 'N': features &= ~APP_BOOTLOADER_CMD_FEATURE_CRC32; break;
+			case 'R': type = APP_BOOTLOADER_DL_RAW; break;
+			case 'D': base_path = optarg; break;
+			case 'b': base_partition_nbr = strtoul(optarg, NULL, 0); break;
+			case 'B': boot = true; break;
+			case 'X': boot_mode = APP_BOOTLOADER_BOOT_RAM; break;
+			case 'P': profile = true; break;
+			case 'v': verbose = true; break;
+			default: device = NULL; optind = argc + 1; break;
+		}
+	}
+	if(device == NULL || optind != argc - 1)
+	{
+		fprintf(stderr, "Usage: %s -d <tty|unix:path> [-s baudrate] [-S baudrate] [-p partition] [-w window] [-t timeout_ms] [-N] [-R]\n"
+				"          [-D base.bin] [-b base_partition] [-B [-X]] [-P] [-v] image.bin\n"
+				"  -s is the rate the bootloader listens at, -S the rate to switch to for the download\n"
+				"  -w 1 forces stop-and-wait, default takes the window offered by the bootloader\n"
+				"  -N does not offer frame CRC-32\n"
+				"  -R sends raw blocks even if the bootloader takes compressed ones\n"
+				"  -D sends patches against base.bin, which must be the image in base_partition (default 0)\n"
+				"  -B boots the partition once downloaded\n"
+				"  -X with -B, loads the image into SRAM and runs it there instead of installing it\n"
+				"  -P dumps the bootloader profiling spans once the download ends, before any boot\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int image_fd = open(argv[optind], O_RDONLY);
+	struct stat image_stat = {0};
+	if(image_fd < 0 || fstat(image_fd, &image_stat) != 0 || image_stat.st_size == 0)
+	{
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	const uint8_t * image = mmap(NULL, image_stat.st_size, PROT_READ, MAP_PRIVATE, image_fd, 0);
+	if(image == MAP_FAILED)
+	{
+		perror("mmap");
+		return EXIT_FAILURE;
+	}
+	madvise((void *)image, image_stat.st_size, MADV_SEQUENTIAL);
+
+	const uint8_t * base = NULL;
+	struct stat base_stat = {0};
+	if(base_path != NULL)
+	{
+		int base_fd = open(base_path, O_RDONLY);
+		if(base_fd < 0 || fstat(base_fd, &base_stat) != 0 || base_stat.st_size == 0
+				|| (base = mmap(NULL, base_stat.st_size, PROT_READ, MAP_PRIVATE, base_fd, 0)) == MAP_FAILED)
+		{
+			perror(base_path);
+			return EXIT_FAILURE;
+		}
+		close(base_fd);
+		type = APP_BOOTLOADER_DL_DELTA;
+	}
+
+	/* Same digest the bootloader saves in the partition header and checks on install */
+	uint8_t sha256[APP_BOOTLOADER_SHA256_SIZE] = {0};
+	app_bootloader_sha256_t sha256_ctx;
+	app_bootloader_sha256_init(&sha256_ctx);
+	app_bootloader_sha256_update(&sha256_ctx, image, image_stat.st_size);
+	app_bootloader_sha256_final(&sha256_ctx, sha256);
+	printf("Image %ld bytes, CRC-32 0x%08x, SHA-256 ", (long)image_stat.st_size, app_bootloader_crc32(image, image_stat.st_size));
+	for(uint8_t i = 0; i < sizeof(sha256); i++)
+		printf("%02x", sha256[i]);
+	printf("\n");
+
+	static flash_tool_link_t link = {0};
+	int rt = flash_tool_open(&link, device, baudrate);
+	if(rt != 0)
+	{
+		fprintf(stderr, "%s: %s\n", device, strerror(-rt));
+		return EXIT_FAILURE;
+	}
+
+	static uint8_t frame_buffer[FLASH_TOOL_MAX_FRAME_SIZE];
+	app_bootloader_frame_t * frame = (app_bootloader_frame_t *) frame_buffer;
+	app_bootloader_build_res_t build_digest = {0};
+
+	/* Hellos never carry a trailer, features apply from the next frame on */
+	app_bootloader_command_set_features(0);
+	app_bootloader_build_host_hello(&build_digest, features);
+	rt = flash_tool_request(&link, &build_digest, frame, timeout_ms);
+	if(rt != 0 || frame->command != APP_BOOTLOADER_CMD_HELLO)
+	{
+		fprintf(stderr, "No hello from bootloader: %s\n", rt? strerror(-rt) : "unexpected frame");
+		return EXIT_FAILURE;
+	}
+	features = (frame->total_length == sizeof(app_bootloader_cmd_hello))? ((app_bootloader_cmd_hello *)frame->data)->features & features : 0;
+	app_bootloader_command_set_features(features);
+	printf("Frame CRC-32 %s\n", (features & APP_BOOTLOADER_CMD_FEATURE_CRC32)? "on" : "off");
+
+	if(fast_baudrate != 0 && fast_baudrate != baudrate)
+	{
+		rt = flash_tool_switch_baudrate(&link, fast_baudrate, timeout_ms);
+		if(rt == 0)
+			printf("Link at %u baud\n", fast_baudrate);
+		else
+			fprintf(stderr, "Link stays at %u baud: %s\n", baudrate, strerror(-rt));
+	}
+
+	flash_tool_dl_t dl = {.image = image, .image_size = image_stat.st_size, .type = type,
+			.base = base, .base_size = base_stat.st_size, .base_partition_nbr = base_partition_nbr};
+	double start = flash_tool_now();
+	rt = flash_tool_download(&link, &dl, partition_nbr, max_window, timeout_ms);
+	double elapsed = flash_tool_now() - start;
+	if(rt != 0)
+	{
+		fprintf(stderr, "Download failed: %s\n", strerror(-rt));
+		return EXIT_FAILURE;
+	}
+	flash_tool_report(&dl, elapsed);
+	printf("Dropped received frames %u\n", link.drop_nbr);
+
+	/* Bootloader is gone after a boot, spans are read while it still listens */
+	if(profile && (rt = flash_tool_profile(&link, frame, timeout_ms)) != 0)
+		fprintf(stderr, "Profile read failed: %s\n", strerror(-rt));
+
+	if(boot)
+	{
+		app_bootloader_build_boot_app(&build_digest, partition_nbr, boot_mode);
+		rt = flash_tool_request(&link, &build_digest, frame, FLASH_TOOL_BOOT_TIMEOUT_MS);
+		if(rt != 0 || frame->command != APP_BOOTLOADER_CMD_END)
+		{
+			if(rt == 0 && frame->command == APP_BOOTLOADER_CMD_ERROR)
+				flash_tool_print_error(frame);
+			fprintf(stderr, "Boot failed\n");
+			return EXIT_FAILURE;
+		}
+		if(boot_mode == APP_BOOTLOADER_BOOT_RAM)
+			printf("Partition %u loaded into RAM, booting\n", partition_nbr);
+		else
+			printf("Partition %u installed, booting\n", partition_nbr);
+	}
+	else if(link.baudrate != baudrate && flash_tool_switch_baudrate(&link, baudrate, timeout_ms) != 0)
+	{
+		/* Bootloader gets back there by itself after some idle time */
+		fprintf(stderr, "Bootloader stays at %u baud for a while\n", link.baudrate);
+	}
+
+	munmap((void *)image, image_stat.st_size);
+	if(base != NULL)
+		munmap((void *)base, base_stat.st_size);
+	close(image_fd);
+	close(link.fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+/*
+ * bootloader_sim.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ *
+ * Runs the bootloader superloop on a host. SPI flash is emulated in a file and
+ * console is a pty or a UNIX socket (see linux arch backends in arch/).
+ *
+ * Usage: bootloader_sim [-f flash_file] [-c pty|unix:<path>]
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "API_console.h"
+#include "API_log.h"
+#include "API_profile.h"
+#include "API_spi_flash.h"
+#include "app_bootloader.h"
+
+#define tag "bootloader_sim"
+#define print_serial_info(format, ...) LOG_LEVEL(LOG_INFO, tag, format, ##__VA_ARGS__)
+#define print_serial_error(format, ...) LOG_LEVEL(LOG_ERROR, tag, format, ##__VA_ARGS__)
+
+/* Idle sleep when waiting for host. Keeps a core free without hurting latency much */
+#define BOOTLOADER_SIM_IDLE_US (50)
+
+static void log_by_stderr(uint8_t * data, uint16_t data_size)
+{
+	fwrite(data, 1, data_size, stderr);
+}
+
+int main(int argc, char ** argv)
+{
+	char * flash_file = NULL;
+	char * console_endpoint = NULL;
+
+	int opt = 0;
+	while((opt = getopt(argc, argv, "f:c:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'f':
+				flash_file = optarg;
+				break;
+			case 'c':
+				console_endpoint = optarg;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-f flash_file] [-c pty|unix:<path>]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	/* A host leaving while we answer is a send error, like a disconnected UART, not the end of the simulator */
+	signal(SIGPIPE, SIG_IGN);
+
+	profile_init();
+	log_set_transmit_function((log_transmit_f)log_by_stderr);
+	print_serial_info("------ Host bootloader ------");
+
+	if(console_init((comm_channel_hdle)console_endpoint) != 0)
+	{
+		print_serial_error("Console error...");
+		return EXIT_FAILURE;
+	}
+
+	spi_flash_cs_t cs_gpio = {0};
+	uint32_t profile_start = profile_begin();
+	int rt = spi_flash_init((spi_if_hdle)flash_file, cs_gpio);
+	profile_end(PROFILE_SPAN_SPI_FLASH_INIT, 0, profile_start);
+	if(rt != SPI_FLASH_OK)
+	{
+		print_serial_error("SPI flash error...");
+		return EXIT_FAILURE;
+	}
+
+	app_bootloader_init();
+	while(1)
+	{
+		if(app_bootloader_start() == APP_BOOTLOADER_E_WAIT)
+			usleep(BOOTLOADER_SIM_IDLE_US);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,250 @@
+/*
+ * flash_tool_delta.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ *
+ * Diff generator for delta downloads. Matches are seeded with exact 8 byte hits in the base and then
+ * extended over mismatches as long as most bytes still agree, like bsdiff: code moved by an insertion
+ * keeps its alignment and the changed addresses inside it become small diffs that compress well.
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "app_bootloader_delta.h"
+#include "flash_tool_delta.h"
+#include "flash_tool_lz4.h"
+
+#define DELTA_SEED_SIZE (8)
+#define DELTA_HASH_BITS (16)
+#define DELTA_MAX_CANDIDATES (32) /* Seed positions tried for each block position */
+#define DELTA_MIN_SCORE (12) /* Matching bytes minus mismatching ones for a region to beat new bytes */
+#define DELTA_GIVE_UP (32) /* Score drop below the best one where extension stops */
+
+/**
+ * @brief Hash the seed at 'data'.
+ *
+ * @param data Data.
+ * @return Hash table index.
+ */
+static uint32_t flash_tool_delta_hash(const uint8_t * data);
+/**
+ * @brief Extend an alignment between block and base over mismatches.
+ *
+ * @param delta Delta generator.
+ * @param block Block data from the aligned position.
+ * @param size Block bytes left.
+ * @param base_pos Aligned base position.
+ * @param length Where the region length is saved.
+ * @return Region score: matching bytes minus mismatching ones.
+ */
+static int32_t flash_tool_delta_extend(const flash_tool_delta_t * delta, const uint8_t * block, uint32_t size, uint32_t base_pos, uint32_t * length);
+/**
+ * @brief Append one op.
+ *
+ * @param op Output pointer, moved past the op.
+ * @param op_end End of output.
+ * @param type APP_BOOTLOADER_DELTA_OP_*.
+ * @param length Op length.
+ * @param base_pos Base position. Ignored for APP_BOOTLOADER_DELTA_OP_INSERT.
+ * @param data New bytes for APP_BOOTLOADER_DELTA_OP_INSERT, diffs for APP_BOOTLOADER_DELTA_OP_ADD.
+ * @return true if it fits in output.
+ */
+static bool flash_tool_delta_write_op(uint8_t ** op, uint8_t * op_end, uint8_t type, uint32_t length, uint32_t base_pos, const uint8_t * data);
+
+static uint32_t flash_tool_delta_hash(const uint8_t * data)
+{
+	uint64_t seed = 0;
+	memcpy(&seed, data, sizeof(seed));
+	return (uint32_t)((seed * 0x9E3779B97F4A7C15ULL) >> (64 - DELTA_HASH_BITS));
+}
+
+static int32_t flash_tool_delta_extend(const flash_tool_delta_t * delta, const uint8_t * block, uint32_t size, uint32_t base_pos, uint32_t * length)
+{
+	uint32_t limit = delta->base_size - base_pos;
+	if(limit > size)
+		limit = size;
+
+	int32_t score = 0;
+	int32_t best_score = 0;
+	*length = 0;
+	for(uint32_t i = 0; i < limit && score > best_score - DELTA_GIVE_UP; i++)
+	{
+		score += (block[i] == delta->base[base_pos + i])? 1 : -1;
+		if(score > best_score)
+		{
+			best_score = score;
+			*length = i + 1;
+		}
+	}
+	return best_score;
+}
+
+static bool flash_tool_delta_write_op(uint8_t ** op, uint8_t * op_end, uint8_t type, uint32_t length, uint32_t base_pos, const uint8_t * data)
+{
+	uint32_t op_size = APP_BOOTLOADER_DELTA_OP_HEADER_SIZE;
+	if(type != APP_BOOTLOADER_DELTA_OP_INSERT)
+		op_size += APP_BOOTLOADER_DELTA_OP_OFFSET_SIZE;
+	if(type != APP_BOOTLOADER_DELTA_OP_COPY)
+		op_size += length;
+	if(length > UINT16_MAX || (uint32_t)(op_end - *op) < op_size)
+		return false;
+
+	uint8_t * p = *op;
+	*p++ = type;
+	*p++ = (uint8_t)length;
+	*p++ = (uint8_t)(length >> 8);
+	if(type != APP_BOOTLOADER_DELTA_OP_INSERT)
+	{
+		for(uint8_t i = 0; i < APP_BOOTLOADER_DELTA_OP_OFFSET_SIZE; i++)
+			*p++ = (uint8_t)(base_pos >> (8 * i));
+	}
+	if(type != APP_BOOTLOADER_DELTA_OP_COPY)
+	{
+		memcpy(p, data, length);
+		p += length;
+	}
+	*op = p;
+	return true;
+}
+
+int flash_tool_delta_init(flash_tool_delta_t * delta, const uint8_t * base, uint32_t base_size)
+{
+	delta->base = base;
+	delta->base_size = base_size;
+	delta->head = malloc((1 << DELTA_HASH_BITS) * sizeof(*delta->head));
+	delta->chain = malloc((base_size + 1) * sizeof(*delta->chain));
+	if(delta->head == NULL || delta->chain == NULL)
+	{
+		flash_tool_delta_deinit(delta);
+		return -1;
+	}
+
+	memset(delta->head, 0xFF, (1 << DELTA_HASH_BITS) * sizeof(*delta->head));
+	for(uint32_t i = 0; i + DELTA_SEED_SIZE <= base_size; i++)
+	{
+		uint32_t hash = flash_tool_delta_hash(base + i);
+		delta->chain[i] = delta->head[hash];
+		delta->head[hash] = i;
+	}
+	return 0;
+}
+
+void flash_tool_delta_deinit(flash_tool_delta_t * delta)
+{
+	free(delta->head);
+	free(delta->chain);
+	delta->head = NULL;
+	delta->chain = NULL;
+}
+
+uint32_t flash_tool_delta_block(const flash_tool_delta_t * delta, const uint8_t * block, uint32_t size, uint8_t * dst, uint32_t dst_capacity, uint32_t ops_capacity)
+{
+	if(size == 0)
+		return 0;
+
+	uint8_t * ops = malloc(ops_capacity);
+	uint8_t * diff = malloc(size);
+	uint8_t * packed = malloc(dst_capacity);
+	if(ops == NULL || diff == NULL || packed == NULL)
+	{
+		free(ops);
+		free(diff);
+		free(packed);
+		return 0;
+	}
+
+	uint8_t * op = ops;
+	uint8_t * op_end = ops + ops_capacity;
+	bool fits = true;
+	uint32_t literal = 0; /* First new byte not encoded yet */
+	bool aligned = false;
+	int64_t alignment = 0; /* Base minus block position of the last region, tried first at next position */
+	uint32_t pos = 0;
+	while(fits && pos < size)
+	{
+		int32_t best_score = 0;
+		uint32_t best_length = 0;
+		uint32_t best_base = 0;
+
+		/* Last alignment continues over changed bytes that break every seed */
+		if(aligned && alignment + pos >= 0 && alignment + pos < delta->base_size)
+		{
+			uint32_t length = 0;
+			int32_t score = flash_tool_delta_extend(delta, block + pos, size - pos, alignment + pos, &length);
+			if(score > best_score)
+			{
+				best_score = score;
+				best_length = length;
+				best_base = alignment + pos;
+			}
+		}
+
+		if(pos + DELTA_SEED_SIZE <= size)
+		{
+			int32_t candidate = delta->head[flash_tool_delta_hash(block + pos)];
+			for(uint32_t tries = 0; candidate >= 0 && tries < DELTA_MAX_CANDIDATES; tries++, candidate = delta->chain[candidate])
+			{
+				if(memcmp(delta->base + candidate, block + pos, DELTA_SEED_SIZE) != 0)
+					continue;
+				uint32_t length = 0;
+				int32_t score = flash_tool_delta_extend(delta, block + pos, size - pos, candidate, &length);
+				if(score > best_score)
+				{
+					best_score = score;
+					best_length = length;
+					best_base = candidate;
+				}
+			}
+		}
+
+		if(best_score < DELTA_MIN_SCORE)
+		{
+			pos++;
+			continue;
+		}
+
+		if(pos > literal)
+			fits = flash_tool_delta_write_op(&op, op_end, APP_BOOTLOADER_DELTA_OP_INSERT, pos - literal, 0, block + literal);
+
+		bool same = true;
+		for(uint32_t i = 0; i < best_length; i++)
+		{
+			diff[i] = block[pos + i] - delta->base[best_base + i];
+			same &= (diff[i] == 0);
+		}
+		fits = fits && flash_tool_delta_write_op(&op, op_end, same? APP_BOOTLOADER_DELTA_OP_COPY : APP_BOOTLOADER_DELTA_OP_ADD, best_length, best_base, diff);
+
+		aligned = true;
+		alignment = (int64_t)best_base - pos;
+		pos += best_length;
+		literal = pos;
+	}
+	if(fits && size > literal)
+		fits = flash_tool_delta_write_op(&op, op_end, APP_BOOTLOADER_DELTA_OP_INSERT, size - literal, 0, block + literal);
+
+	/* Smallest of plain and compressed op stream, both must beat the raw block */
+	uint32_t patch_size = 0;
+	uint32_t ops_size = (uint32_t)(op - ops);
+	if(fits && dst_capacity > 1)
+	{
+		uint32_t packed_size = flash_tool_lz4_compress(ops, ops_size, packed + 1, dst_capacity - 1);
+		if(packed_size != 0 && packed_size < ops_size)
+		{
+			dst[0] = APP_BOOTLOADER_DELTA_FLAG_LZ4;
+			memcpy(dst + 1, packed + 1, packed_size);
+			patch_size = packed_size + 1;
+		}
+		else if(ops_size < dst_capacity)
+		{
+			dst[0] = 0;
+			memcpy(dst + 1, ops, ops_size);
+			patch_size = ops_size + 1;
+		}
+	}
+
+	free(ops);
+	free(diff);
+	free(packed);
+	return patch_size;
+}
@@ -0,0 +1,56 @@
+/*
+ * flash_tool_delta.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef TOOLS_HOST_FLASH_TOOL_DELTA_H_
+#define TOOLS_HOST_FLASH_TOOL_DELTA_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Base image indexed for match search.
+ *
+ */
+typedef struct
+{
+	const uint8_t * base;
+	uint32_t base_size;
+	int32_t * head; /* Last base position of each seed hash. -1 if none */
+	int32_t * chain; /* Previous base position with the same seed hash. -1 if none */
+}flash_tool_delta_t;
+
+/**
+ * @brief Index a base image.
+ *
+ * @param delta Delta generator.
+ * @param base Base image. Must stay valid until deinit.
+ * @param base_size Base image size.
+ * @return
+ * 			- 0 if no error.
+ */
+int flash_tool_delta_init(flash_tool_delta_t * delta, const uint8_t * base, uint32_t base_size);
+/**
+ * @brief Free the base index.
+ *
+ * @param delta Delta generator.
+ */
+void flash_tool_delta_deinit(flash_tool_delta_t * delta);
+/**
+ * @brief Build the patch block (app_bootloader_delta format) that rebuilds one block of the new image.
+ * Regions aligned with the base are encoded as base plus a diff (bsdiff style), the rest as new bytes,
+ * and the op stream is LZ4 compressed when that makes it smaller.
+ *
+ * @param delta Delta generator.
+ * @param block New image block.
+ * @param size Block size.
+ * @param dst Output buffer.
+ * @param dst_capacity Output buffer size.
+ * @param ops_capacity Largest op stream the bootloader decompresses.
+ * @return Patch block size. 0 if it does not fit in 'dst_capacity'.
+ */
+uint32_t flash_tool_delta_block(const flash_tool_delta_t * delta, const uint8_t * block, uint32_t size, uint8_t * dst, uint32_t dst_capacity, uint32_t ops_capacity);
+
+#endif /* TOOLS_HOST_FLASH_TOOL_DELTA_H_ */
@@ -0,0 +1,137 @@
+/*
+ * flash_tool_lz4.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ *
+ * Greedy LZ4 block compressor: one hash table slot per 4 byte sequence, the first match found is taken.
+ * Ratio is a bit below the reference compressor but images are only compressed once per download.
+ */
+#include <stdbool.h>
+#include <string.h>
+#include "flash_tool_lz4.h"
+
+#define LZ4_MIN_MATCH (4)
+#define LZ4_LENGTH_EXTENDED (15)
+#define LZ4_MAX_OFFSET (UINT16_MAX)
+/* Format rules kept for the reference decoder: last match starts 12 bytes before the end at the latest,
+ * last 5 bytes are always literals */
+#define LZ4_MATCH_START_LIMIT (12)
+#define LZ4_LAST_LITERALS (5)
+#define LZ4_HASH_BITS (12)
+
+/**
+ * @brief Hash the 4 bytes at 'data'.
+ *
+ * @param data Data.
+ * @return Hash table index.
+ */
+static uint32_t flash_tool_lz4_hash(const uint8_t * data);
+/**
+ * @brief Write the length bytes that follow a token nibble.
+ *
+ * @param op Output pointer, moved past the written bytes.
+ * @param op_end End of output.
+ * @param length Length minus what the nibble holds.
+ * @return true if it fits in output.
+ */
+static bool flash_tool_lz4_write_length(uint8_t ** op, uint8_t * op_end, uint32_t length);
+/**
+ * @brief Write one sequence.
+ *
+ * @param op Output pointer, moved past the sequence.
+ * @param op_end End of output.
+ * @param literal Literals.
+ * @param literal_size Literals size.
+ * @param offset Match offset. 0 for the last sequence, which has no match.
+ * @param match_size Match size.
+ * @return true if it fits in output.
+ */
+static bool flash_tool_lz4_write_sequence(uint8_t ** op, uint8_t * op_end, const uint8_t * literal, uint32_t literal_size, uint32_t offset, uint32_t match_size);
+
+static uint32_t flash_tool_lz4_hash(const uint8_t * data)
+{
+	uint32_t sequence = 0;
+	memcpy(&sequence, data, sizeof(sequence));
+	return (sequence * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+static bool flash_tool_lz4_write_length(uint8_t ** op, uint8_t * op_end, uint32_t length)
+{
+	for(; length >= UINT8_MAX; length -= UINT8_MAX)
+	{
+		if(*op >= op_end)
+			return false;
+		*(*op)++ = UINT8_MAX;
+	}
+	if(*op >= op_end)
+		return false;
+	*(*op)++ = (uint8_t)length;
+	return true;
+}
+
+static bool flash_tool_lz4_write_sequence(uint8_t ** op, uint8_t * op_end, const uint8_t * literal, uint32_t literal_size, uint32_t offset, uint32_t match_size)
+{
+	if(*op >= op_end)
+		return false;
+	uint8_t * token = (*op)++;
+	*token = (literal_size < LZ4_LENGTH_EXTENDED)? (literal_size << 4) : (LZ4_LENGTH_EXTENDED << 4);
+	if(literal_size >= LZ4_LENGTH_EXTENDED && !flash_tool_lz4_write_length(op, op_end, literal_size - LZ4_LENGTH_EXTENDED))
+		return false;
+
+	if((uint32_t)(op_end - *op) < literal_size)
+		return false;
+	memcpy(*op, literal, literal_size);
+	*op += literal_size;
+
+	if(offset == 0)
+		return true;
+
+	if(op_end - *op < 2)
+		return false;
+	*(*op)++ = (uint8_t)offset;
+	*(*op)++ = (uint8_t)(offset >> 8);
+
+	match_size -= LZ4_MIN_MATCH;
+	*token |= (match_size < LZ4_LENGTH_EXTENDED)? match_size : LZ4_LENGTH_EXTENDED;
+	if(match_size >= LZ4_LENGTH_EXTENDED && !flash_tool_lz4_write_length(op, op_end, match_size - LZ4_LENGTH_EXTENDED))
+		return false;
+	return true;
+}
+
+uint32_t flash_tool_lz4_compress(const uint8_t * src, uint32_t src_size, uint8_t * dst, uint32_t dst_capacity)
+{
+	int64_t table[1 << LZ4_HASH_BITS];
+	for(uint32_t i = 0; i < sizeof(table) / sizeof(table[0]); i++)
+		table[i] = -1;
+
+	uint8_t * op = dst;
+	uint8_t * op_end = dst + dst_capacity;
+	uint32_t anchor = 0;
+	uint32_t pos = 0;
+
+	while(src_size > LZ4_MATCH_START_LIMIT && pos < src_size - LZ4_MATCH_START_LIMIT)
+	{
+		uint32_t hash = flash_tool_lz4_hash(src + pos);
+		int64_t ref = table[hash];
+		table[hash] = pos;
+		if(ref < 0 || pos - ref > LZ4_MAX_OFFSET || memcmp(src + ref, src + pos, LZ4_MIN_MATCH) != 0)
+		{
+			pos++;
+			continue;
+		}
+
+		uint32_t match_size = LZ4_MIN_MATCH;
+		while(pos + match_size < src_size - LZ4_LAST_LITERALS && src[ref + match_size] == src[pos + match_size])
+			match_size++;
+
+		if(!flash_tool_lz4_write_sequence(&op, op_end, src + anchor, pos - anchor, pos - (uint32_t)ref, match_size))
+			return 0;
+		pos += match_size;
+		anchor = pos;
+	}
+
+	if(!flash_tool_lz4_write_sequence(&op, op_end, src + anchor, src_size - anchor, 0, 0))
+		return 0;
+	return (uint32_t)(op - dst);
+}
@@ -0,0 +1,25 @@
+/*
+ * flash_tool_lz4.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: guirespi
+ */
+
+#ifndef TOOLS_HOST_FLASH_TOOL_LZ4_H_
+#define TOOLS_HOST_FLASH_TOOL_LZ4_H_
+
+#include <stdint.h>
+
+/**
+ * @brief Compress data into one LZ4 block (block format, no frame). Output decodes with
+ * app_bootloader_lz4_decompress and with the reference LZ4 decoder.
+ *
+ * @param src Data.
+ * @param src_size Data size. Offsets are 16 bit, so matches never reach further than 64 KiB back.
+ * @param dst Output buffer.
+ * @param dst_capacity Output buffer size.
+ * @return Compressed size. 0 if it does not fit in 'dst_capacity'.
+ */
+uint32_t flash_tool_lz4_compress(const uint8_t * src, uint32_t src_size, uint8_t * dst, uint32_t dst_capacity);
+
+#endif /* TOOLS_HOST_FLASH_TOOL_LZ4_H_ */